@@ -64,10 +64,16 @@ void DFContextShared::readName(t_name & name, uint32_t address)
     }
     p->readSTLString(address + name_firstname_offset , name.first_name, 128);
     p->readSTLString(address + name_nickname_offset , name.nickname, 128);
-    p->read(address + name_words_offset, 7*4, (uint8_t *)name.words);
-    p->read(address + name_parts_offset, 7*2, (uint8_t *)name.parts_of_speech);
-    name.language = p->readDWord(address + name_language_offset);
-    name.has_name = p->readByte(address + name_set_offset);
+    uint8_t has_name;
+    t_readop ops[] =
+    {
+        {address + name_words_offset, 7*4, (uint8_t *)name.words},
+        {address + name_parts_offset, 7*2, (uint8_t *)name.parts_of_speech},
+        {address + name_language_offset, 4, (uint8_t *)&name.language},
+        {address + name_set_offset, 1, &has_name}
+    };
+    p->readBatch(ops, sizeof(ops) / sizeof(t_readop));
+    name.has_name = has_name;
 }
 
 void DFContextShared::copyName(uint32_t address, uint32_t target)
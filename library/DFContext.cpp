@@ -37,6 +37,7 @@ using namespace std;
 
 #include "private/ContextShared.h"
 #include "private/ModuleFactory.h"
+#include "private/ProcessFactory.h"
 
 using namespace DFHack;
 
@@ -137,6 +138,11 @@ void Context::WriteRaw (const uint32_t offset, const uint32_t size, uint8_t *sou
     d->p->write (offset, size, source);
 }
 
+bool Context::WriteSnapshot (const std::string & path, const std::string & parent)
+{
+    return writeSnapshot(d->p, path, parent);
+}
+
 VersionInfo *Context::getMemoryInfo()
 {
     return d->offset_descriptor;
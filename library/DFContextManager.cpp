@@ -27,6 +27,10 @@ distribution.
 #include <string>
 #include <vector>
 #include <map>
+#include <sstream>
+#include <cstdio>
+#include <iostream>
+#include <cstdlib>
 using namespace std;
 
 #include "dfhack/VersionInfoFactory.h"
@@ -37,6 +41,7 @@ using namespace std;
 #include "dfhack/DFContext.h"
 #include "dfhack/DFContextManager.h"
 #include "private/ContextShared.h"
+#include "private/ProcessFactory.h"
 
 using namespace DFHack;
 namespace DFHack
@@ -44,11 +49,30 @@ namespace DFHack
     class ContextManager::Private
     {
         public:
-            Private(){};
-            ~Private(){};
+            Private(){ vinfo_factory = 0; num_traces = 0; use_synthetic = false; };
+            ~Private(){ if(vinfo_factory) delete vinfo_factory; };
             string xml; // path to xml
             vector <Context *> contexts;
             ProcessEnumerator * pEnum;
+            // snapshots, replays and synthetic images aren't tracked by the enumerator, so we own them
+            vector <Process *> snapshots;
+            VersionInfoFactory * vinfo_factory;
+            // trace recorder -> the process it records
+            map <Process *, Process *> tracers;
+            string trace_path;
+            string replay_path;
+            uint32_t num_traces;
+            // serve a synthetic image instead of live processes
+            bool use_synthetic;
+            t_synthetic_params synthetic;
+            // get the enumerator's process behind a context's process
+            Process * unwrap(Process * p)
+            {
+                map <Process *, Process *>::iterator it = tracers.find(p);
+                if(it != tracers.end())
+                    return it->second;
+                return p;
+            }
     };
 }
 class DFHack::BadContexts::Private
@@ -125,6 +149,24 @@ ContextManager::ContextManager (const string path_to_xml) : d (new Private())
     d->xml += "/";
     d->xml += path_to_xml;
     d->pEnum = new ProcessEnumerator(d->xml);
+    const char * env = getenv("DFHACK_TRACE");
+    if(env)
+        d->trace_path = env;
+    env = getenv("DFHACK_REPLAY");
+    if(env)
+        d->replay_path = env;
+    env = getenv("DFHACK_SYNTHETIC");
+    if(env)
+    {
+        // XxYxZ[,creatures[,items[,buildings]]]
+        t_synthetic_params & sp = d->synthetic;
+        int n = sscanf(env, "%ux%ux%u,%u,%u,%u", &sp.x_blocks, &sp.y_blocks, &sp.z_blocks,
+                       &sp.creatures, &sp.items, &sp.buildings);
+        if(n >= 3)
+            d->use_synthetic = true;
+        else
+            cerr << "DFHACK_SYNTHETIC should look like 12x12x40,100,2000,50" << endl;
+    }
 }
 
 ContextManager::~ContextManager()
@@ -142,6 +184,19 @@ ContextManager::~ContextManager()
 
 uint32_t ContextManager::Refresh( BadContexts* bad_contexts )
 {
+    // a replay stands in for all the live processes
+    if(!d->replay_path.empty())
+    {
+        if(d->contexts.empty())
+            OpenTrace(d->replay_path);
+        return d->contexts.size();
+    }
+    if(d->use_synthetic)
+    {
+        if(d->contexts.empty())
+            OpenSynthetic(d->synthetic);
+        return d->contexts.size();
+    }
     // handle expired processes, remove stale Contexts
     {
         BadProcesses expired;
@@ -152,14 +207,20 @@ uint32_t ContextManager::Refresh( BadContexts* bad_contexts )
         vector <Context*>::iterator it = d->contexts.begin();;
         while(it != d->contexts.end())
         {
-            Process * test = (*it)->getProcess();
+            Process * outer = (*it)->getProcess();
+            Process * test = d->unwrap(outer);
             if(expired.Contains(test))
             {
+                bool traced = outer != test;
+                if(traced)
+                    d->tracers.erase(outer);
                 // ok. we have an expired context here.
                 if(!bad_contexts)
                 {
                     // with nowhere to put the context, we have to destroy it
                     delete *it;
+                    if(traced)
+                        delete outer;
                     // stop tracking it and advance the iterator
                     it = d->contexts.erase(it);
                     continue;
@@ -173,6 +234,9 @@ uint32_t ContextManager::Refresh( BadContexts* bad_contexts )
                     // remove process from the 'expired' container, it is tracked by bad_contexts now
                     // (which is responsible for freeing it).
                     expired.excise(test);
+                    // bad_contexts only knows the recorder, it has to take the process along
+                    if(traced)
+                        adoptTracedProcess(outer);
                     continue;
                 }
             }
@@ -192,7 +256,7 @@ uint32_t ContextManager::Refresh( BadContexts* bad_contexts )
         // scan context vector for this process
         for(int j = 0; j < numContexts; j++)
         {
-            if((d->contexts[j])->getProcess() == test)
+            if(d->unwrap((d->contexts[j])->getProcess()) == test)
             {
                 // already have that one, skip
                 exists = true;
@@ -201,7 +265,26 @@ uint32_t ContextManager::Refresh( BadContexts* bad_contexts )
         if(!exists)
         {
             // new process needs a new context
-            Context * c = new Context(d->pEnum->operator[](i));
+            Process * p = test;
+            if(!d->trace_path.empty())
+            {
+                // the first one gets the name as it is, any others get their PID appended
+                string path = d->trace_path;
+                if(d->num_traces)
+                {
+                    stringstream ss;
+                    ss << path << "." << test->getPID();
+                    path = ss.str();
+                }
+                Process * recorder = createTraceRecorder(test, path);
+                if(recorder)
+                {
+                    d->tracers[recorder] = test;
+                    d->num_traces++;
+                    p = recorder;
+                }
+            }
+            Context * c = new Context(p);
             newContexts.push_back(c);
         }
     }
@@ -237,10 +320,103 @@ Context * ContextManager::getSingleContext()
     throw DFHack::Error::NoProcess();
 }
 
+Context * ContextManager::OpenSnapshot(const string & path)
+{
+    // the enumerator's version list isn't accessible, load our own
+    if(!d->vinfo_factory)
+        d->vinfo_factory = new VersionInfoFactory(d->xml);
+    Process * p = createSnapshotProcess(path, d->vinfo_factory);
+    if(!p->isIdentified())
+    {
+        delete p;
+        return 0;
+    }
+    d->snapshots.push_back(p);
+    Context * c = new Context(p);
+    d->contexts.push_back(c);
+    return c;
+}
+
+void ContextManager::setTraceFile(const string & path)
+{
+    d->trace_path = path;
+    d->num_traces = 0;
+}
+
+void ContextManager::setReplayFile(const string & path)
+{
+    d->replay_path = path;
+}
+
+Context * ContextManager::OpenTrace(const string & path)
+{
+    if(!d->vinfo_factory)
+        d->vinfo_factory = new VersionInfoFactory(d->xml);
+    Process * p = createTraceReplay(path, d->vinfo_factory);
+    if(!p->isIdentified())
+    {
+        delete p;
+        return 0;
+    }
+    d->snapshots.push_back(p);
+    Context * c = new Context(p);
+    d->contexts.push_back(c);
+    return c;
+}
+
+Context * ContextManager::OpenSynthetic(const t_synthetic_params & params)
+{
+    if(!d->vinfo_factory)
+        d->vinfo_factory = new VersionInfoFactory(d->xml);
+    Process * p = createSyntheticProcess(params, d->vinfo_factory);
+    if(!p->isIdentified())
+    {
+        delete p;
+        return 0;
+    }
+    d->snapshots.push_back(p);
+    Context * c = new Context(p);
+    d->contexts.push_back(c);
+    return c;
+}
+
+Context * ContextManager::OpenSHM(uint32_t pid)
+{
+    if(!d->vinfo_factory)
+        d->vinfo_factory = new VersionInfoFactory(d->xml);
+    Process * p;
+    try
+    {
+        p = createSHMProcess(pid, d->vinfo_factory);
+    }
+    catch (Error::All &)
+    {
+        return 0;
+    }
+    // the constructor doesn't tell us if there was a server at all
+    if(!p->attach())
+    {
+        delete p;
+        return 0;
+    }
+    p->detach();
+    d->snapshots.push_back(p);
+    Context * c = new Context(p);
+    d->contexts.push_back(c);
+    return c;
+}
+
 void ContextManager::purge(void)
 {
     for(unsigned int i = 0; i < d->contexts.size();i++)
         delete d->contexts[i];
     d->contexts.clear();
+    // recorders go before the processes they record
+    for(map <Process *, Process *>::iterator it = d->tracers.begin(); it != d->tracers.end(); ++it)
+        delete it->first;
+    d->tracers.clear();
+    for(unsigned int i = 0; i < d->snapshots.size();i++)
+        delete d->snapshots[i];
+    d->snapshots.clear();
     d->pEnum->purge();
 }
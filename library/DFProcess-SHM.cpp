@@ -27,6 +27,7 @@ distribution.
 #include <vector>
 #include <map>
 #include <cstring>
+#include <algorithm>
 using namespace std;
 
 #include "SHMProcess.h"
@@ -132,7 +133,7 @@ bool SHMProcess::suspend()
             throw Error::SHMLockingError("if(!d->SetAndWait(CORE_STEP))");
         }
         */
-        D_SHMCMD = CORE_STEP;
+        d->Post(CORE_STEP);
     }
     else
     {
@@ -144,7 +145,7 @@ bool SHMProcess::suspend()
             throw Error::SHMLockingError("if(!d->SetAndWait(CORE_SUSPEND))");
         }
         */
-        D_SHMCMD = CORE_SUSPEND;
+        d->Post(CORE_SUSPEND);
     }
     //fprintf(stderr,"waiting for lock\n");
     // we wait for the server to give up our suspend lock (held by default)
@@ -188,11 +189,11 @@ bool SHMProcess::asyncSuspend()
         }
         else if(cmd == CORE_RUN)
         {
-            D_SHMCMD = CORE_STEP;
+            d->Post(CORE_STEP);
         }
         else
         {
-            D_SHMCMD = CORE_SUSPEND;
+            d->Post(CORE_SUSPEND);
         }
         return false;
     }
@@ -249,11 +250,31 @@ bool SHMProcess::getModuleIndex (const char * name, const uint32_t version, uint
     return true;
 }
 
+void SHMProcess::Private::StreamWait(volatile uint32_t & counter, uint32_t target)
+{
+    uint32_t cnt = 0;
+    while(counter < target)
+    {
+        CPU_RELAX
+        if(++cnt == 100000)
+        {
+            if(!AreLocksOk())// DF not there anymore?
+            {
+                ServerDisappeared();
+            }
+            cnt = 0;
+        }
+    }
+    full_barrier
+}
+
 bool SHMProcess::Private::Aux_Core_Attach(bool & versionOK, pid_t & PID)
 {
     if(!locked) throw Error::MemoryAccessDenied(0xdeadbeef);
 
     SHMDATA(coreattach)->cl_affinity = OS_getAffinity();
+    SHMDATA(coreattach)->cl_useFutex = SHM_HAS_FUTEX;
+    SHMDATA(coreattach)->cl_slots = SHM_STREAM_SLOTS;
     if(!SetAndWait(CORE_ATTACH)) return false;
     /*
     cerr <<"CORE_VERSION" << CORE_VERSION << endl;
@@ -262,6 +283,9 @@ bool SHMProcess::Private::Aux_Core_Attach(bool & versionOK, pid_t & PID)
     versionOK =( SHMDATA(coreattach)->sv_version == CORE_VERSION );
     PID = SHMDATA(coreattach)->sv_PID;
     useYield = SHMDATA(coreattach)->sv_useYield;
+    useFutex = SHMDATA(coreattach)->sv_useFutex;
+    spin = SHM_SPIN_START;
+    slots = SHMDATA(coreattach)->sv_slots;
     #ifdef DEBUG
         if(useYield) cerr << "Using Yield!" << endl;
     #endif
@@ -281,6 +305,28 @@ void SHMProcess::read (uint32_t src_address, uint32_t size, uint8_t *target_buff
         d->SetAndWait(CORE_READ);
         memcpy (target_buffer, D_SHMDATA(void),size);
     }
+    // a big read, the server fills one slot while we empty another
+    else if(d->slots > 1)
+    {
+        uint32_t slotsize = SHM_BODY / d->slots;
+        D_SHMHDR->address = src_address;
+        D_SHMHDR->length = size;
+        D_SHMHDR->value = d->slots;
+        D_SHMHDR->filled = D_SHMHDR->drained = 0;
+        full_barrier
+        d->Post(CORE_READ_STREAM);
+        for(uint32_t chunk = 0; size; chunk++)
+        {
+            uint32_t to_read = min(size, slotsize);
+            d->StreamWait(D_SHMHDR->filled, chunk + 1);
+            memcpy (target_buffer, D_SHMDATA(char) + (chunk % d->slots) * slotsize, to_read);
+            full_barrier
+            D_SHMHDR->drained = chunk + 1;
+            size -= to_read;
+            target_buffer += to_read;
+        }
+        d->Wait(CORE_READ_STREAM);
+    }
     // a big read, we pull data over the shm in iterations
     else
     {
@@ -305,6 +351,180 @@ void SHMProcess::read (uint32_t src_address, uint32_t size, uint8_t *target_buff
     }
 }
 
+void SHMProcess::readBatch (const t_readop * ops, size_t n)
+{
+    if(!n) return;
+    if(!d->locked) throw Error::MemoryAccessDenied(ops[0].address);
+
+    size_t i = 0;
+    while (i < n)
+    {
+        // pack as many reads as the SHM can take, descriptors first, data behind them
+        size_t first = i;
+        uint32_t used = 0;
+        while (i < n && used + sizeof(shm_readop) + ops[i].length <= SHM_BODY)
+        {
+            used += sizeof(shm_readop) + ops[i].length;
+            i++;
+        }
+        // doesn't fit at all, read() splits it up
+        if(i == first)
+        {
+            read(ops[i].address, ops[i].length, ops[i].buffer);
+            i++;
+            continue;
+        }
+        uint32_t count = i - first;
+        shm_readop * desc = D_SHMDATA(shm_readop);
+        for(uint32_t j = 0; j < count; j++)
+        {
+            desc[j].address = ops[first + j].address;
+            desc[j].length = ops[first + j].length;
+        }
+        D_SHMHDR->value = count;
+        full_barrier
+        d->SetAndWait(CORE_READ_BATCH);
+        char * data = D_SHMDATA(char) + count * sizeof(shm_readop);
+        for(uint32_t j = 0; j < count; j++)
+        {
+            memcpy(ops[first + j].buffer, data, ops[first + j].length);
+            data += ops[first + j].length;
+        }
+    }
+}
+
+uint32_t SHMProcess::gatherVector(uint32_t address, int32_t offset, uint32_t length, vector<uint8_t> & out)
+{
+    if(!d->locked) throw Error::MemoryAccessDenied(address);
+    // elements that don't fit the window go through the batch reads
+    if(!length || length > SHM_BODY - sizeof(shm_gather))
+        return Process::gatherVector(address, offset, length, out);
+
+    shm_gather * gather = D_SHMDATA(shm_gather);
+    uint32_t first = 0;
+    uint32_t total = 0;
+    out.clear();
+    do
+    {
+        gather->vector = address + d->vector_start;
+        gather->offset = offset;
+        gather->length = length;
+        gather->first = first;
+        full_barrier
+        d->SetAndWait(CORE_GATHER);
+        total = gather->total;
+        out.resize(total * length);
+        if(gather->count)
+            memcpy(&out[first * length], gather + 1, gather->count * length);
+        first += gather->count;
+    } while (first < total);
+    return total;
+}
+
+/*
+ * CORE_SCAN: the request is the shm_scan, the ranges and the needle. the rest of the body
+ * is for the addresses.
+ */
+namespace {
+    bool scanRangeBefore(const shm_scanrange & a, const shm_scanrange & b)
+    {
+        return a.start < b.start;
+    }
+    // readable ranges below 4GB, sorted
+    void scanRanges(const vector<t_memrange> & ranges, vector<shm_scanrange> & out)
+    {
+        out.clear();
+        for(size_t i = 0; i < ranges.size(); i++)
+        {
+            const t_memrange & r = ranges[i];
+            if(!r.read || r.start >= r.end || r.start >= 0xFFFFF000)
+                continue;
+            shm_scanrange sr = {(uint32_t) r.start, (uint32_t) min<uint64_t>(r.end, 0xFFFFF000)};
+            out.push_back(sr);
+        }
+        sort(out.begin(), out.end(), scanRangeBefore);
+    }
+    // write the request into the body, return where the addresses go and how many fit
+    uint32_t * scanRequest(char * body, const vector<shm_scanrange> & ranges, const t_scanquery & query, uint32_t & room)
+    {
+        shm_scan * req = (shm_scan *) body;
+        req->kind = query.kind;
+        req->increment = query.increment;
+        req->value = query.value;
+        req->size = query.kind == SCAN_INT ? query.size : query.needle.size();
+        req->numranges = ranges.size();
+        req->numcandidates = 0;
+        char * out = (char *) (req + 1);
+        uint32_t request = sizeof(shm_scan) + ranges.size() * sizeof(shm_scanrange) + ((req->size + 3) & ~3);
+        // leave some room for the addresses
+        if(request + 4096 > SHM_BODY)
+        {
+            room = 0;
+            return 0;
+        }
+        if(!ranges.empty())
+            memcpy(out, &ranges[0], ranges.size() * sizeof(shm_scanrange));
+        out += ranges.size() * sizeof(shm_scanrange);
+        if(query.kind != SCAN_INT)
+            memcpy(out, query.needle.data(), query.needle.size());
+        out += (req->size + 3) & ~3;
+        room = (body + SHM_BODY - out) / sizeof(uint32_t);
+        return (uint32_t *) out;
+    }
+}
+
+bool SHMProcess::scan(const vector<t_memrange> & ranges, const t_scanquery & query, vector<uint64_t> & found)
+{
+    if(!d->locked) throw Error::MemoryAccessDenied(0);
+    found.clear();
+    vector<shm_scanrange> sranges;
+    scanRanges(ranges, sranges);
+    if(sranges.empty())
+        return true;
+    uint32_t room;
+    uint32_t * addresses = scanRequest(D_SHMDATA(char), sranges, query, room);
+    if(!addresses)
+        return false;
+    shm_scan * req = D_SHMDATA(shm_scan);
+    req->range = 0;
+    req->offset = 0;
+    do
+    {
+        full_barrier
+        d->SetAndWait(CORE_SCAN);
+        for(uint32_t i = 0; i < req->count; i++)
+            found.push_back(addresses[i]);
+    } while (req->range < req->numranges);
+    return true;
+}
+
+bool SHMProcess::filter(const vector<t_memrange> & ranges, const t_scanquery & query, vector<uint64_t> & found)
+{
+    if(!d->locked) throw Error::MemoryAccessDenied(0);
+    vector<shm_scanrange> sranges;
+    scanRanges(ranges, sranges);
+    uint32_t room;
+    uint32_t * addresses = scanRequest(D_SHMDATA(char), sranges, query, room);
+    if(!addresses)
+        return false;
+    shm_scan * req = D_SHMDATA(shm_scan);
+    // the server packs the survivors of each page in place
+    size_t kept = 0;
+    for(size_t first = 0; first < found.size(); first += room)
+    {
+        uint32_t n = min<size_t>(room, found.size() - first);
+        for(uint32_t i = 0; i < n; i++)
+            addresses[i] = found[first + i];
+        req->numcandidates = n;
+        full_barrier
+        d->SetAndWait(CORE_SCAN);
+        for(uint32_t i = 0; i < req->count; i++)
+            found[kept++] = addresses[i];
+    }
+    found.resize(kept);
+    return true;
+}
+
 void SHMProcess::readByte (const uint32_t offset, uint8_t &val )
 {
     if(!d->locked) throw Error::MemoryAccessDenied(offset);
@@ -413,6 +633,30 @@ void SHMProcess::write (uint32_t dst_address, uint32_t size, uint8_t *source_buf
         full_barrier
         d->SetAndWait(CORE_WRITE);
     }
+    // a big write, we fill one slot while the server empties another
+    else if(d->slots > 1)
+    {
+        uint32_t slotsize = SHM_BODY / d->slots;
+        D_SHMHDR->address = dst_address;
+        D_SHMHDR->length = size;
+        D_SHMHDR->value = d->slots;
+        D_SHMHDR->filled = D_SHMHDR->drained = 0;
+        full_barrier
+        d->Post(CORE_WRITE_STREAM);
+        for(uint32_t chunk = 0; size; chunk++)
+        {
+            uint32_t to_write = min(size, slotsize);
+            if(chunk >= d->slots)
+                d->StreamWait(D_SHMHDR->drained, chunk - d->slots + 1);
+            memcpy (D_SHMDATA(char) + (chunk % d->slots) * slotsize, source_buffer, to_write);
+            full_barrier
+            D_SHMHDR->filled = chunk + 1;
+            size -= to_write;
+            source_buffer += to_write;
+        }
+        // the last chunks have to be in before we go on
+        d->Wait(CORE_WRITE_STREAM);
+    }
     // a big write, we push this over the shm in iterations
     else
     {
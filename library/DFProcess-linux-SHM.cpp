@@ -55,6 +55,9 @@ SHMProcess::Private::Private(SHMProcess * self_)
     attached = false;
     identified = false;
     useYield = false;
+    useFutex = false;
+    spin = SHM_SPIN_START;
+    slots = 1;
     server_lock = -1;
     client_lock = -1;
     suspend_lock = -1;
@@ -62,16 +65,39 @@ SHMProcess::Private::Private(SHMProcess * self_)
     self = self_;
 }
 
-bool SHMProcess::Private::SetAndWait (uint32_t state)
+void SHMProcess::Private::ServerDisappeared()
+{
+    //detach the shared memory
+    shmdt(shm_addr);
+    FreeLocks();
+    attached = locked = identified = false;
+    // we aren't the current process anymore
+    throw Error::SHMServerDisappeared();
+}
+
+void SHMProcess::Private::Post (uint32_t state)
 {
-    uint32_t cnt = 0;
-    if(!attached) return false;
     SHMCMD = state;
+    SHM_ring(SLEEPERS);
+}
 
+bool SHMProcess::Private::Wait (uint32_t state)
+{
+    uint32_t cnt = 0;
     while (SHMCMD == state)
     {
+        if(useFutex)
+        {
+            // spin a bit, then sleep until the server answers
+            if(SHM_waitChange(&SHMCMD, state, &SLEEPERS->client[attachmentIdx], spin, useYield))
+            {
+                break;
+            }
+            // timed out, check on DF
+            cnt = 10000;
+        }
         // yield the CPU, only on single-core CPUs
-        if(useYield)
+        else if(useYield)
         {
             SCHED_YIELD
         }
@@ -79,12 +105,7 @@ bool SHMProcess::Private::SetAndWait (uint32_t state)
         {
             if(!AreLocksOk())// DF not there anymore?
             {
-                //detach the shared memory
-                shmdt(shm_addr);
-                FreeLocks();
-                attached = locked = identified = false;
-                // we aren't the current process anymore
-                throw Error::SHMServerDisappeared();
+                ServerDisappeared();
             }
             else
             {
@@ -101,6 +122,13 @@ bool SHMProcess::Private::SetAndWait (uint32_t state)
     return true;
 }
 
+bool SHMProcess::Private::SetAndWait (uint32_t state)
+{
+    if(!attached) return false;
+    Post(state);
+    return Wait(state);
+}
+
 /*
 Yeah. with no way to synchronize things (locks are slow, the OS doesn't give us
 enough control over scheduling)
@@ -249,8 +277,8 @@ bool SHMProcess::Private::validate(VersionInfoFactory * factory)
     VersionInfo * vinfo = factory->getVersionInfoByMD5(hash);
     if(vinfo)
     {
-        memdescriptor = vinfo;
-        // FIXME: BIG BAD BUG RIGHT HERE!!!!
+        // our own copy, it gets deleted along with the process
+        memdescriptor = new VersionInfo(*vinfo);
         memdescriptor->setParentProcess(self);
         identified = true;
         vector_start = memdescriptor->getGroup("vector")->getOffset("start");
@@ -417,5 +445,5 @@ char * SHMProcess::getSHMStart (void)
 {
     if(!d->locked) return 0; //THROW HERE!
 
-    return d->shm_addr;
+    return SHM_LANE(d->shm_addr, d->attachmentIdx);
 }
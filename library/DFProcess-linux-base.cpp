@@ -28,22 +28,37 @@ distribution.
 #include <cstring>
 #include <vector>
 #include <map>
+#include <set>
 #include <cstdio>
 using namespace std;
 
 #include "LinuxProcess.h"
+#include "PageCache.h"
+#include "WriteBuffer.h"
 #include "dfhack/VersionInfo.h"
 #include "dfhack/DFError.h"
 #include <errno.h>
+#include <limits.h>
 #include <sys/ptrace.h>
+#include <sys/uio.h>
 using namespace DFHack;
 
+// the kernel won't take more iovecs than this in one call
+#ifndef IOV_MAX
+    #define IOV_MAX 1024
+#endif
+
 LinuxProcessBase::LinuxProcessBase(uint32_t pid)
 : my_pid(pid)
 {
     my_descriptor = NULL;
     attached = false;
     suspended = false;
+    use_vm_readv = true;
+    use_vm_writev = true;
+    ranges_stale = true;
+    cache = 0;
+    wbuf = 0;
     memFileHandle = 0;
 }
 
@@ -66,6 +81,10 @@ LinuxProcessBase::~LinuxProcessBase()
     // destroy our copy of the memory descriptor
     if(my_descriptor)
         delete my_descriptor;
+    if(cache)
+        delete cache;
+    if(wbuf)
+        delete wbuf;
 }
 
 VersionInfo * LinuxProcessBase::getDescriptor()
@@ -117,26 +136,45 @@ bool LinuxProcessBase::getThreadIDs(vector<uint32_t> & threads )
     return true;
 }
 
+// the whole /proc/PID/maps file, so we can tell when it changes
+static string readMaps(pid_t pid)
+{
+    char buffer[4096];
+    string text;
+    sprintf(buffer, "/proc/%lu/maps", (long unsigned)pid);
+    FILE *mapFile = ::fopen(buffer, "r");
+    if(!mapFile)
+        return text;
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), mapFile)) > 0)
+        text.append(buffer, n);
+    fclose(mapFile);
+    return text;
+}
+
 //FIXME: cross-reference with ELF segment entries?
-void LinuxProcessBase::getMemRanges( vector<t_memrange> & ranges )
+static void parseMaps(const string & text, vector<t_memrange> & ranges)
 {
-    char buffer[1024];
     char permissions[5]; // r/-, w/-, x/-, p/s, 0
-
-    sprintf(buffer, "/proc/%lu/maps", (long unsigned)my_pid);
-    FILE *mapFile = ::fopen(buffer, "r");
     size_t start, end, offset, device1, device2, node;
-
-    while (fgets(buffer, 1024, mapFile))
+    size_t pos = 0;
+    while (pos < text.size())
     {
+        size_t eol = text.find('\n', pos);
+        if(eol == string::npos)
+            eol = text.size();
+        string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+
         t_memrange temp;
         temp.name[0] = 0;
-        sscanf(buffer, "%zx-%zx %s %zx %2zu:%2zu %zu %[^\n]s",
+        if(sscanf(line.c_str(), "%zx-%zx %4s %zx %2zu:%2zu %zu %1023[^\n]s",
                &start,
                &end,
                (char*)&permissions,
                &offset, &device1, &device2, &node,
-               (char*)&temp.name);
+               (char*)&temp.name) < 7)
+            continue;
         temp.start = start;
         temp.end = end;
         temp.read = permissions[0] == 'r';
@@ -148,16 +186,56 @@ void LinuxProcessBase::getMemRanges( vector<t_memrange> & ranges )
     }
 }
 
+void LinuxProcessBase::getMemRanges( vector<t_memrange> & ranges )
+{
+    parseMaps(readMaps(my_pid), ranges);
+}
+
+/*
+ * The memory map can only change while DF runs. While it's suspended,
+ * we check the maps file once and keep using the index until it resumes.
+ */
+const t_memrange * LinuxProcessBase::rangeOf(uint32_t address)
+{
+    if(!suspended || ranges_stale)
+    {
+        string text = readMaps(my_pid);
+        if(text != maps_text)
+        {
+            vector<t_memrange> ranges;
+            parseMaps(text, ranges);
+            rangeIndex.build(ranges);
+            maps_text.swap(text);
+        }
+        ranges_stale = !suspended;
+    }
+    return rangeIndex.rangeOf(address);
+}
+
 void LinuxProcessBase::read (const uint32_t offset, const uint32_t size, uint8_t *target)
 {
     if(size == 0) return;
+    // DF only holds still while suspended
+    if(cache && suspended)
+        readCached(offset, size, target);
+    else
+        readDirect(offset, size, target);
+    // read-after-write has to see what we wrote
+    if(wbuf)
+        wbuf->overlay(offset, size, target);
+}
 
+/*
+ * The raw reads, on their own so the readers of other threads can share them.
+ */
+static void preadAll (int fd, const uint32_t offset, const uint32_t size, uint8_t *target)
+{
     ssize_t result;
     ssize_t total = 0;
     ssize_t remaining = size;
     while (total != size)
     {
-        result = pread(memFileHandle, target + total ,remaining,offset + total);
+        result = pread(fd, target + total ,remaining,offset + total);
         if(result == -1)
         {
             cerr << "pread failed: can't read " << size << " bytes at addres " << offset << endl;
@@ -173,6 +251,374 @@ void LinuxProcessBase::read (const uint32_t offset, const uint32_t size, uint8_t
     }
 }
 
+void LinuxProcessBase::readDirect (const uint32_t offset, const uint32_t size, uint8_t *target)
+{
+    preadAll(memFileHandle, offset, size, target);
+}
+
+/*
+ * pread stops at the first page it can't read and returns what it got so far.
+ * Skip the bad page and carry on with the rest in one go again.
+ * Bypasses the cache, scans would only push everything else out of it.
+ */
+bool LinuxProcessBase::readTolerant (uint32_t offset, uint32_t size, uint8_t *target, vector<bool> & pages, uint8_t fill)
+{
+    uint64_t first = offset & ~(uint64_t)(tolerant_page - 1);
+    uint64_t end = (uint64_t) offset + size;
+    pages.assign((end - first + tolerant_page - 1) / tolerant_page, true);
+    bool all = true;
+    uint64_t pos = offset;
+    while (pos < end)
+    {
+        ssize_t result = pread(memFileHandle, target + (pos - offset), end - pos, pos);
+        if(result > 0)
+        {
+            pos += result;
+            continue;
+        }
+        uint64_t page_end = min(end, (pos & ~(uint64_t)(tolerant_page - 1)) + tolerant_page);
+        memset(target + (pos - offset), fill, page_end - pos);
+        pages[(pos - first) / tolerant_page] = false;
+        all = false;
+        pos = page_end;
+    }
+    errno = 0;
+    if(wbuf)
+        wbuf->overlay(offset, size, target);
+    return all;
+}
+
+/*
+ * Scatter/gather read. With the cache on, all the missing pages are fetched
+ * by one batch and the elements are then copied out of the cache.
+ */
+void LinuxProcessBase::readBatch (const t_readop * ops, size_t n)
+{
+    if(!cache || !suspended)
+    {
+        readBatchDirect(ops, n);
+        if(wbuf)
+        {
+            for(size_t i = 0; i < n; i++)
+                wbuf->overlay(ops[i].address, ops[i].length, ops[i].buffer);
+        }
+        return;
+    }
+    // collect the pages we don't have yet
+    set<uint32_t> missing;
+    for(size_t i = 0; i < n; i++)
+    {
+        if(ops[i].length == 0)
+            continue;
+        uint64_t end = (uint64_t) ops[i].address + ops[i].length;
+        for(uint64_t page = ops[i].address & PageCache::page_mask; page < end; page += PageCache::page_size)
+        {
+            if(!missing.count(page) && !cache->contains(page))
+                missing.insert(page);
+        }
+    }
+    // more than the cache can take without pushing out pages we are about to use.
+    // going page by page would be slower than not caching at all
+    if(missing.size() > cache->getCapacity() / 2)
+    {
+        readBatchDirect(ops, n);
+        if(wbuf)
+        {
+            for(size_t i = 0; i < n; i++)
+                wbuf->overlay(ops[i].address, ops[i].length, ops[i].buffer);
+        }
+        return;
+    }
+    // fetch them all in one go
+    if(!missing.empty())
+    {
+        vector<t_readop> fill;
+        fill.reserve(missing.size());
+        for(set<uint32_t>::iterator it = missing.begin(); it != missing.end(); ++it)
+        {
+            t_readop op;
+            op.address = *it;
+            op.length = PageCache::page_size;
+            op.buffer = cache->insert(*it);
+            fill.push_back(op);
+        }
+        try
+        {
+            readBatchDirect(&fill[0], fill.size());
+        }
+        catch(Error::MemoryAccessDenied &)
+        {
+            // some page isn't readable. forget the half-filled pages and let readCached sort it out
+            for(set<uint32_t>::iterator it = missing.begin(); it != missing.end(); ++it)
+                cache->erase(*it);
+            missing.clear();
+        }
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        if(ops[i].length)
+            readCached(ops[i].address, ops[i].length, ops[i].buffer, &missing);
+        if(wbuf)
+            wbuf->overlay(ops[i].address, ops[i].length, ops[i].buffer);
+    }
+}
+
+/*
+ * Serve a read from cached pages, fetching the pages we don't have.
+ */
+void LinuxProcessBase::readCached (const uint32_t offset, const uint32_t size, uint8_t *target, const set<uint32_t> * prefetched)
+{
+    uint64_t end = (uint64_t) offset + size;
+    uint64_t pos = offset;
+    while (pos < end)
+    {
+        uint32_t page = (uint32_t) pos & PageCache::page_mask;
+        uint8_t * data;
+        if(prefetched && prefetched->count(page))
+            data = cache->peek(page);
+        else
+            data = cache->find(page);
+        if(!data)
+        {
+            data = cache->insert(page);
+            try
+            {
+                readDirect(page, PageCache::page_size, data);
+            }
+            catch(Error::MemoryAccessDenied &)
+            {
+                cache->erase(page);
+                throw Error::MemoryAccessDenied(offset);
+            }
+        }
+        uint64_t chunk = min(end, (uint64_t) page + PageCache::page_size) - pos;
+        memcpy(target + (pos - offset), data + (pos - page), chunk);
+        pos += chunk;
+    }
+}
+
+bool LinuxProcessBase::setReadCache(bool enable, uint32_t max_pages)
+{
+    if(!enable)
+    {
+        if(cache)
+            delete cache;
+        cache = 0;
+    }
+    else if(cache)
+        cache->setCapacity(max_pages);
+    else
+        cache = new PageCache(max_pages);
+    return true;
+}
+
+bool LinuxProcessBase::getReadCacheStats(uint64_t & hits, uint64_t & misses)
+{
+    if(!cache)
+        return false;
+    hits = cache->hits;
+    misses = cache->misses;
+    return true;
+}
+
+void LinuxProcessBase::invalidateCache()
+{
+    if(cache)
+        cache->clear();
+    ranges_stale = true;
+}
+
+bool LinuxProcessBase::setWriteBuffer(bool enable)
+{
+    if(enable && !wbuf)
+        wbuf = new WriteBuffer();
+    else if(!enable && wbuf)
+    {
+        commitWrites();
+        delete wbuf;
+        wbuf = 0;
+    }
+    return true;
+}
+
+/*
+ * Send the merged write spans with process_vm_writev, IOV_MAX at a time.
+ * The kernel refuses to write read-only pages that ptrace can write, so whatever
+ * it didn't take goes through the old word-by-word write().
+ */
+void LinuxProcessBase::commitWrites()
+{
+    if(!wbuf || wbuf->empty())
+        return;
+    // take the buffer out of the way, so write() below goes straight to DF
+    WriteBuffer * pending = wbuf;
+    wbuf = 0;
+    const WriteBuffer::span_map & spans = pending->getSpans();
+    WriteBuffer::span_map::const_iterator it = spans.begin();
+    struct iovec local[IOV_MAX];
+    struct iovec remote[IOV_MAX];
+    try
+    {
+        while (it != spans.end())
+        {
+            if(!use_vm_writev)
+            {
+                for(; it != spans.end(); ++it)
+                    write(it->first, it->second.size(), (uint8_t *) &it->second[0]);
+                break;
+            }
+            size_t chunk = 0;
+            WriteBuffer::span_map::const_iterator chunk_end = it;
+            for(; chunk < IOV_MAX && chunk_end != spans.end(); ++chunk, ++chunk_end)
+            {
+                local[chunk].iov_base = (void *) &chunk_end->second[0];
+                local[chunk].iov_len = chunk_end->second.size();
+                remote[chunk].iov_base = (void *) (uintptr_t) chunk_end->first;
+                remote[chunk].iov_len = chunk_end->second.size();
+            }
+            ssize_t result = process_vm_writev(my_pid, local, chunk, remote, chunk, 0);
+            if(result == -1)
+            {
+                // old kernel or not allowed -> never try again
+                if(errno == ENOSYS || errno == EPERM)
+                {
+                    use_vm_writev = false;
+                    errno = 0;
+                    continue;
+                }
+                errno = 0;
+                result = 0;
+            }
+            // skip over the spans that were written completely
+            size_t got = result;
+            while (it != chunk_end && got >= it->second.size())
+            {
+                if(cache)
+                    cache->write(it->first, it->second.size(), &it->second[0]);
+                got -= it->second.size();
+                ++it;
+            }
+            // the first one that wasn't goes the slow way
+            if(it != chunk_end)
+            {
+                write(it->first, it->second.size(), (uint8_t *) &it->second[0]);
+                ++it;
+            }
+        }
+    }
+    catch(...)
+    {
+        pending->clear();
+        wbuf = pending;
+        throw;
+    }
+    pending->clear();
+    wbuf = pending;
+}
+
+/*
+ * Scatter/gather read. One process_vm_readv per IOV_MAX elements instead of one pread per element.
+ * The kernel stops at the first element it can't read, so we push that element through
+ * preadAll() (which throws like it always did) and continue after it.
+ */
+static void readvAll (pid_t pid, int fd, bool & use_vm_readv, const t_readop * ops, size_t n)
+{
+    struct iovec local[IOV_MAX];
+    struct iovec remote[IOV_MAX];
+    size_t done = 0;
+    while (done < n)
+    {
+        if(!use_vm_readv)
+        {
+            for(; done < n; done++)
+                preadAll(fd, ops[done].address, ops[done].length, ops[done].buffer);
+            return;
+        }
+        size_t chunk = min(n - done, (size_t) IOV_MAX);
+        for(size_t i = 0; i < chunk; i++)
+        {
+            const t_readop & op = ops[done + i];
+            local[i].iov_base = op.buffer;
+            local[i].iov_len = op.length;
+            remote[i].iov_base = (void *) (uintptr_t) op.address;
+            remote[i].iov_len = op.length;
+        }
+        ssize_t result = process_vm_readv(pid, local, chunk, remote, chunk, 0);
+        if(result == -1)
+        {
+            // old kernel or not allowed -> never try again
+            if(errno == ENOSYS || errno == EPERM)
+            {
+                use_vm_readv = false;
+                errno = 0;
+                continue;
+            }
+            errno = 0;
+            result = 0;
+        }
+        // skip over the elements that were read completely
+        size_t got = result;
+        size_t i = 0;
+        while (i < chunk && got >= ops[done + i].length)
+        {
+            got -= ops[done + i].length;
+            i++;
+        }
+        // the first one that wasn't goes the slow way
+        if(i < chunk)
+        {
+            const t_readop & op = ops[done + i];
+            preadAll(fd, op.address, op.length, op.buffer);
+            i++;
+        }
+        done += i;
+    }
+}
+
+void LinuxProcessBase::readBatchDirect (const t_readop * ops, size_t n)
+{
+    bool vm_readv = use_vm_readv;
+    readvAll(my_pid, memFileHandle, vm_readv, ops, n);
+    use_vm_readv = vm_readv;
+}
+
+namespace {
+    // its own /proc/PID/mem handle, and the same kernel calls as the process. owns the handle
+    class LinuxReader : public ProcessReader
+    {
+        public:
+            LinuxReader(pid_t pid, int fd, bool use_vm_readv)
+            : pid(pid), fd(fd), use_vm_readv(use_vm_readv) {};
+            ~LinuxReader()
+            {
+                close(fd);
+            }
+            void readBatch(const t_readop * ops, size_t n)
+            {
+                readvAll(pid, fd, use_vm_readv, ops, n);
+            }
+        private:
+            pid_t pid;
+            int fd;
+            bool use_vm_readv;
+    };
+}
+
+ProcessReader * LinuxProcessBase::createReader()
+{
+    // a reader wouldn't see the buffered writes
+    if(!attached || (wbuf && !wbuf->empty()))
+        return 0;
+    // without a handle of its own, the reader would fail as soon as it has to fall back to pread
+    int fd = open(memFile.c_str(), O_RDONLY);
+    if(fd == -1)
+    {
+        errno = 0;
+        return 0;
+    }
+    return new LinuxReader(my_pid, fd, use_vm_readv);
+}
+
 void LinuxProcessBase::readByte (const uint32_t offset, uint8_t &val )
 {
     read(offset, 1, &val);
@@ -204,16 +650,28 @@ void LinuxProcessBase::readQuad (const uint32_t offset, uint64_t &val)
 
 void LinuxProcessBase::writeQuad (uint32_t offset, const uint64_t data)
 {
+    if(wbuf)
+    {
+        wbuf->add(offset, 8, (const uint8_t *) &data);
+        return;
+    }
     #ifdef HAVE_64_BIT
         ptrace(PTRACE_POKEDATA,my_pid, offset, data);
     #else
         ptrace(PTRACE_POKEDATA,my_pid, offset, (uint32_t) data);
         ptrace(PTRACE_POKEDATA,my_pid, offset+4, (uint32_t) (data >> 32));
     #endif
+    if(cache)
+        cache->write(offset, 8, (const uint8_t *) &data);
 }
 
 void LinuxProcessBase::writeDWord (uint32_t offset, uint32_t data)
 {
+    if(wbuf)
+    {
+        wbuf->add(offset, 4, (const uint8_t *) &data);
+        return;
+    }
     #ifdef HAVE_64_BIT
         uint64_t orig = Process::readQuad(offset);
         orig &= 0xFFFFFFFF00000000;
@@ -222,11 +680,18 @@ void LinuxProcessBase::writeDWord (uint32_t offset, uint32_t data)
     #else
         ptrace(PTRACE_POKEDATA,my_pid, offset, data);
     #endif
+    if(cache)
+        cache->write(offset, 4, (const uint8_t *) &data);
 }
 
 // using these is expensive.
 void LinuxProcessBase::writeWord (uint32_t offset, uint16_t data)
 {
+    if(wbuf)
+    {
+        wbuf->add(offset, 2, (const uint8_t *) &data);
+        return;
+    }
     #ifdef HAVE_64_BIT
         uint64_t orig = Process::readQuad(offset);
         orig &= 0xFFFFFFFFFFFF0000;
@@ -238,10 +703,17 @@ void LinuxProcessBase::writeWord (uint32_t offset, uint16_t data)
         orig |= data;
         ptrace(PTRACE_POKEDATA,my_pid, offset, orig);
     #endif
+    if(cache)
+        cache->write(offset, 2, (const uint8_t *) &data);
 }
 
 void LinuxProcessBase::writeByte (uint32_t offset, uint8_t data)
 {
+    if(wbuf)
+    {
+        wbuf->add(offset, 1, (const uint8_t *) &data);
+        return;
+    }
     #ifdef HAVE_64_BIT
         uint64_t orig = Process::readQuad(offset);
         orig &= 0xFFFFFFFFFFFFFF00;
@@ -253,11 +725,18 @@ void LinuxProcessBase::writeByte (uint32_t offset, uint8_t data)
         orig |= data;
         ptrace(PTRACE_POKEDATA,my_pid, offset, orig);
     #endif
+    if(cache)
+        cache->write(offset, 1, (const uint8_t *) &data);
 }
 
 // blah. THIS IS RIDICULOUS
 void LinuxProcessBase::write (uint32_t offset, uint32_t size, uint8_t *source)
 {
+    if(wbuf)
+    {
+        wbuf->add(offset, size, source);
+        return;
+    }
     uint32_t indexptr = 0;
     while (size > 0)
     {
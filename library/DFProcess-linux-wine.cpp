@@ -239,6 +239,9 @@ bool WineProcess::resume()
 {
     if(!suspended)
         return true;
+    commitWrites();
+    // whatever we cached is about to go stale
+    invalidateCache();
     int result = 0;
     // close /proc/PID/mem
     result = close(memFileHandle);
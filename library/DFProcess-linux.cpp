@@ -281,6 +281,9 @@ bool NormalProcess::resume()
         return false;
     if(!suspended)
         return true;
+    commitWrites();
+    // whatever we cached is about to go stale
+    invalidateCache();
 
     bool ok = true;
     for (set<uint32_t>::iterator it = thread_ids.begin(); it != thread_ids.end(); ++it) {
@@ -381,6 +384,7 @@ bool NormalProcess::detach()
 {
     if(!attached) return true;
     if(!suspended) suspend();
+    commitWrites();
     int result = 0;
     // close /proc/PID/mem
     result = close(memFileHandle);
@@ -404,6 +408,7 @@ bool NormalProcess::detach()
             thread_ids.erase(it++);
         }
 
+        invalidateCache();
         attached = false;
         return true;
     }
@@ -0,0 +1,739 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+#include "Internal.h"
+#include "PlatformInternal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "ProcessFactory.h"
+#include "SnapshotFile.h"
+#include "MicrosoftSTL.h"
+#include "dfhack/VersionInfo.h"
+#include "dfhack/DFError.h"
+#ifdef LINUX_BUILD
+    #include <sys/mman.h>
+#endif
+using namespace DFHack;
+
+namespace {
+    struct t_snaprange
+    {
+        uint64_t start;
+        uint64_t end;
+        // contents of each page, 0 if the page couldn't be read
+        vector <uint8_t *> pages;
+        // content hash of each page
+        const uint64_t * hashes;
+    };
+    struct t_snaprange_less
+    {
+        bool operator() (const t_snaprange & a, const t_snaprange & b) const
+        {
+            return a.start < b.start;
+        }
+    };
+    struct t_snaprange_before
+    {
+        bool operator() (uint64_t address, const t_snaprange & r) const
+        {
+            return address < r.start;
+        }
+    };
+
+    /*
+     * One mapped snapshot file and the parent snapshots it depends on.
+     * The file is mapped copy-on-write: writes never reach the file.
+     */
+    class SnapshotImage
+    {
+        private:
+            uint8_t * mapping;
+            uint64_t mapping_size;
+            #ifndef LINUX_BUILD
+                HANDLE file_handle;
+                HANDLE map_handle;
+            #endif
+            SnapshotImage * parent;
+            bool mapFile(const string & path);
+            void unmapFile();
+        public:
+            SnapshotImage();
+            ~SnapshotImage();
+            bool open(const string & path, int depth = 0);
+
+            t_snapshot_header header;
+            // readable ranges, sorted
+            vector <t_snaprange> ranges;
+            // everything we know about, for getMemRanges
+            vector <t_memrange> memranges;
+
+            // get the range containing address, 0 if there's none
+            t_snaprange * rangeOf(uint64_t address);
+            // find a page by address. 0 if it isn't there or wasn't readable
+            uint8_t * getPage(uint64_t page, uint64_t * hash = 0);
+    };
+
+    /*
+     * A frozen copy of a DF process, read from a file created by writeSnapshot.
+     * Reads are plain memcpy from the mapped file(s).
+     */
+    class SnapshotProcess : public Process
+    {
+        private:
+            VersionInfo * my_descriptor;
+            SnapshotImage image;
+            uint8_t vector_start;
+            bool attached:1;
+            bool identified:1;
+            MicrosoftSTL stl;
+        public:
+            SnapshotProcess(const string & path, VersionInfoFactory * factory);
+            ~SnapshotProcess();
+
+            bool attach() { attached = true; return true; };
+            bool detach() { attached = false; return true; };
+            // a snapshot never runs
+            bool suspend() { return true; };
+            bool asyncSuspend() { return true; };
+            bool resume() { return true; };
+            bool forceresume() { return true; };
+
+            void readQuad(const uint32_t address, uint64_t & value) { read(address, 8, (uint8_t *) &value); };
+            void writeQuad(const uint32_t address, const uint64_t value) { write(address, 8, (uint8_t *) &value); };
+            void readDWord(const uint32_t address, uint32_t & value) { read(address, 4, (uint8_t *) &value); };
+            void writeDWord(const uint32_t address, const uint32_t value) { write(address, 4, (uint8_t *) &value); };
+            void readFloat(const uint32_t address, float & value) { read(address, 4, (uint8_t *) &value); };
+            void readWord(const uint32_t address, uint16_t & value) { read(address, 2, (uint8_t *) &value); };
+            void writeWord(const uint32_t address, const uint16_t value) { write(address, 2, (uint8_t *) &value); };
+            void readByte(const uint32_t address, uint8_t & value) { read(address, 1, &value); };
+            void writeByte(const uint32_t address, const uint8_t value) { write(address, 1, (uint8_t *) &value); };
+
+            void read( uint32_t address, uint32_t length, uint8_t* buffer);
+            void write(uint32_t address, uint32_t length, uint8_t* buffer);
+
+            const std::string readSTLString (uint32_t offset);
+            size_t readSTLString (uint32_t offset, char * buffer, size_t bufcapacity);
+            size_t writeSTLString(const uint32_t address, const std::string writeString) { return 0; };
+            void readSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            void writeSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            std::string doReadClassName(uint32_t vptr);
+            const std::string readCString (uint32_t offset);
+
+            bool isSuspended() { return true; };
+            bool isAttached() { return attached; };
+            bool isIdentified() { return identified; };
+            bool isSnapshot() { return true; };
+            bool getChangedPages(Process * other, std::vector<uint32_t> & pages);
+
+            bool getThreadIDs(std::vector<uint32_t> & threads ) { threads.clear(); return false; };
+            void getMemRanges(std::vector<t_memrange> & ranges );
+            const t_memrange * rangeOf(uint32_t address) { return rangeIndex.rangeOf(address); };
+            VersionInfo *getDescriptor() { return my_descriptor; };
+            int getPID() { return image.header.pid; };
+            std::string getPath() { return image.header.path; };
+            bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) { OUTPUT = 0; return false; };
+            char * getSHMStart (void) { return 0; };
+            bool SetAndWait (uint32_t state) { return false; };
+    };
+}
+
+// FNV-1a, good enough to tell pages apart
+static uint64_t hashPage(const uint8_t * data)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < SNAPSHOT_PAGE; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+SnapshotImage::SnapshotImage()
+{
+    mapping = 0;
+    mapping_size = 0;
+    parent = 0;
+    #ifndef LINUX_BUILD
+        file_handle = 0;
+        map_handle = 0;
+    #endif
+    memset(&header, 0, sizeof(header));
+}
+
+SnapshotImage::~SnapshotImage()
+{
+    if(parent)
+        delete parent;
+    unmapFile();
+}
+
+bool SnapshotImage::open(const string & path, int depth)
+{
+    if(!mapFile(path))
+        return false;
+    if(mapping_size < sizeof(t_snapshot_header))
+    {
+        cerr << path << " is not a snapshot" << endl;
+        return false;
+    }
+    memcpy(&header, mapping, sizeof(header));
+    header.md5[sizeof(header.md5) - 1] = 0;
+    header.path[sizeof(header.path) - 1] = 0;
+    header.parent[sizeof(header.parent) - 1] = 0;
+    if(strcmp(header.magic, SNAPSHOT_MAGIC) != 0 || header.version != SNAPSHOT_VERSION)
+    {
+        cerr << path << " is not a snapshot or has the wrong version" << endl;
+        return false;
+    }
+    uint64_t table_end = sizeof(t_snapshot_header) + (uint64_t) header.num_ranges * sizeof(t_snapshot_range);
+    if(table_end > mapping_size)
+    {
+        cerr << path << " is truncated" << endl;
+        return false;
+    }
+    // deltas need the whole chain down to the full snapshot
+    if(header.parent[0])
+    {
+        // guard against loops
+        if(depth > 1000)
+            return false;
+        string parent_path = header.parent;
+        size_t slash = path.find_last_of("/\\");
+        // the parent may have moved along with the delta
+        FILE * test = fopen(parent_path.c_str(), "rb");
+        if(test)
+            fclose(test);
+        else if(slash != string::npos)
+        {
+            size_t parent_slash = parent_path.find_last_of("/\\");
+            string parent_name = parent_slash == string::npos ? parent_path : parent_path.substr(parent_slash + 1);
+            parent_path = path.substr(0, slash + 1) + parent_name;
+        }
+        parent = new SnapshotImage();
+        if(!parent->open(parent_path, depth + 1))
+        {
+            cerr << "couldn't open parent snapshot " << parent_path << endl;
+            return false;
+        }
+    }
+
+    t_snapshot_range * table = (t_snapshot_range *) (mapping + sizeof(t_snapshot_header));
+    for(uint32_t i = 0; i < header.num_ranges; i++)
+    {
+        t_snapshot_range & sr = table[i];
+        uint64_t num_pages = (sr.end - sr.start + SNAPSHOT_PAGE - 1) / SNAPSHOT_PAGE;
+        bool captured = (sr.flags & SNAP_CAPTURED)
+                     && sr.hashes + num_pages * 8 <= mapping_size
+                     && sr.pages + num_pages * 8 <= mapping_size;
+        t_memrange mr;
+        mr.start = sr.start;
+        mr.end = sr.end;
+        strncpy(mr.name, sr.name, sizeof(mr.name));
+        mr.name[sizeof(mr.name) - 1] = 0;
+        mr.read = false;
+        mr.write = (sr.flags & SNAP_WRITE) != 0;
+        mr.execute = (sr.flags & SNAP_EXECUTE) != 0;
+        mr.shared = (sr.flags & SNAP_SHARED) != 0;
+        mr.valid = true;
+        mr.buffer = 0;
+        if(captured)
+        {
+            t_snaprange r;
+            r.start = sr.start;
+            r.end = sr.end;
+            r.hashes = (const uint64_t *) (mapping + sr.hashes);
+            r.pages.resize(num_pages);
+            const uint64_t * offsets = (const uint64_t *) (mapping + sr.pages);
+            for(uint64_t j = 0; j < num_pages; j++)
+            {
+                uint64_t off = offsets[j];
+                if(off == SNAPSHOT_PARENT_PAGE)
+                    r.pages[j] = parent ? parent->getPage(sr.start + j * SNAPSHOT_PAGE) : 0;
+                else if(off != SNAPSHOT_BAD_PAGE && off + SNAPSHOT_PAGE <= mapping_size)
+                    r.pages[j] = mapping + off;
+                else
+                    r.pages[j] = 0;
+                if(r.pages[j])
+                    mr.read = true;
+            }
+            ranges.push_back(r);
+        }
+        memranges.push_back(mr);
+    }
+    // the parents aren't needed after resolving, except for their mappings
+    for(SnapshotImage * p = parent; p; p = p->parent)
+    {
+        p->ranges.clear();
+        p->memranges.clear();
+    }
+    sort(ranges.begin(), ranges.end(), t_snaprange_less());
+    return true;
+}
+Process* DFHack::createSnapshotProcess(const string & path, VersionInfoFactory * factory)
+{
+    return new SnapshotProcess(path, factory);
+}
+
+SnapshotProcess::SnapshotProcess(const string & path, VersionInfoFactory * factory)
+{
+    my_descriptor = 0;
+    attached = false;
+    identified = false;
+    vector_start = 0;
+
+    if(!image.open(path))
+        return;
+    rangeIndex.build(image.memranges);
+
+    // find out what version of DF this was
+    t_snapshot_header & header = image.header;
+    VersionInfo * vinfo = 0;
+    if(header.md5[0])
+        vinfo = factory->getVersionInfoByMD5(header.md5);
+    if(!vinfo && header.pe)
+        vinfo = factory->getVersionInfoByPETimestamp(header.pe);
+    if(!vinfo)
+        return;
+    my_descriptor = new VersionInfo(*vinfo);
+    if(my_descriptor->getOS() == OS_WINDOWS && header.base && header.base != my_descriptor->getBase())
+        my_descriptor->RebaseAll(header.base);
+    my_descriptor->setParentProcess(this);
+    vector_start = my_descriptor->getGroup("vector")->getOffset("start");
+    if(my_descriptor->getOS() == OS_WINDOWS)
+        stl.init(this);
+    identified = true;
+}
+
+SnapshotProcess::~SnapshotProcess()
+{
+    if(my_descriptor)
+        delete my_descriptor;
+}
+
+#ifdef LINUX_BUILD
+bool SnapshotImage::mapFile(const string & path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+    {
+        cerr << "couldn't open snapshot " << path << endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    // private and writable: writes stay in our copy of the pages
+    void * m = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED)
+    {
+        perror("snapshot mmap");
+        return false;
+    }
+    mapping = (uint8_t *) m;
+    mapping_size = st.st_size;
+    return true;
+}
+
+void SnapshotImage::unmapFile()
+{
+    if(mapping)
+        munmap(mapping, mapping_size);
+    mapping = 0;
+}
+#else
+bool SnapshotImage::mapFile(const string & path)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file_handle == INVALID_HANDLE_VALUE)
+    {
+        cerr << "couldn't open snapshot " << path << endl;
+        file_handle = 0;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file_handle, &size) || size.QuadPart == 0)
+    {
+        unmapFile();
+        return false;
+    }
+    // copy on write: writes stay in our copy of the pages
+    map_handle = CreateFileMapping(file_handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(!map_handle)
+    {
+        unmapFile();
+        return false;
+    }
+    mapping = (uint8_t *) MapViewOfFile(map_handle, FILE_MAP_COPY, 0, 0, 0);
+    if(!mapping)
+    {
+        unmapFile();
+        return false;
+    }
+    mapping_size = size.QuadPart;
+    return true;
+}
+
+void SnapshotImage::unmapFile()
+{
+    if(mapping)
+        UnmapViewOfFile(mapping);
+    if(map_handle)
+        CloseHandle(map_handle);
+    if(file_handle)
+        CloseHandle(file_handle);
+    mapping = 0;
+    map_handle = 0;
+    file_handle = 0;
+}
+#endif
+
+t_snaprange * SnapshotImage::rangeOf(uint64_t address)
+{
+    // first range starting after address, the one before it is our candidate
+    vector<t_snaprange>::iterator it = upper_bound(ranges.begin(), ranges.end(), address, t_snaprange_before());
+    if(it == ranges.begin())
+        return 0;
+    --it;
+    if(address < it->end)
+        return &(*it);
+    return 0;
+}
+
+uint8_t * SnapshotImage::getPage(uint64_t page, uint64_t * hash)
+{
+    t_snaprange * r = rangeOf(page);
+    if(!r)
+        return 0;
+    uint64_t index = (page - r->start) / SNAPSHOT_PAGE;
+    if(hash)
+        *hash = r->hashes[index];
+    return r->pages[index];
+}
+
+void SnapshotProcess::read (uint32_t address, uint32_t length, uint8_t *buffer)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    // ranges are only page-aligned relative to their own start
+    while (pos < end)
+    {
+        t_snaprange * r = image.rangeOf(pos);
+        if(!r)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t index = (pos - r->start) / SNAPSHOT_PAGE;
+        uint64_t page_start = r->start + index * SNAPSHOT_PAGE;
+        uint8_t * data = r->pages[index];
+        if(!data)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t chunk = min(min(end, r->end), page_start + SNAPSHOT_PAGE) - pos;
+        memcpy(buffer + (pos - address), data + (pos - page_start), chunk);
+        pos += chunk;
+    }
+}
+
+void SnapshotProcess::write (uint32_t address, uint32_t length, uint8_t *buffer)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    while (pos < end)
+    {
+        t_snaprange * r = image.rangeOf(pos);
+        if(!r)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t index = (pos - r->start) / SNAPSHOT_PAGE;
+        uint64_t page_start = r->start + index * SNAPSHOT_PAGE;
+        uint8_t * data = r->pages[index];
+        if(!data)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t chunk = min(min(end, r->end), page_start + SNAPSHOT_PAGE) - pos;
+        memcpy(data + (pos - page_start), buffer + (pos - address), chunk);
+        pos += chunk;
+    }
+}
+
+void SnapshotProcess::getMemRanges( vector<t_memrange> & ranges )
+{
+    ranges.insert(ranges.end(), image.memranges.begin(), image.memranges.end());
+}
+
+/*
+ * Compare the page hashes of two snapshots. Pages only one of them has count as changed.
+ */
+bool SnapshotProcess::getChangedPages(Process * other, vector<uint32_t> & pages)
+{
+    if(!other->isSnapshot())
+        return false;
+    SnapshotImage & theirs = ((SnapshotProcess *) other)->image;
+    pages.clear();
+    for(size_t i = 0; i < image.ranges.size(); i++)
+    {
+        t_snaprange & r = image.ranges[i];
+        for(size_t j = 0; j < r.pages.size(); j++)
+        {
+            uint64_t address = r.start + j * SNAPSHOT_PAGE;
+            uint64_t hash = 0;
+            uint8_t * their_page = theirs.getPage(address, &hash);
+            if((their_page != 0) != (r.pages[j] != 0) || (their_page && hash != r.hashes[j]))
+                pages.push_back(address);
+        }
+    }
+    for(size_t i = 0; i < theirs.ranges.size(); i++)
+    {
+        t_snaprange & r = theirs.ranges[i];
+        for(size_t j = 0; j < r.pages.size(); j++)
+        {
+            uint64_t address = r.start + j * SNAPSHOT_PAGE;
+            if(r.pages[j] && !image.rangeOf(address))
+                pages.push_back(address);
+        }
+    }
+    sort(pages.begin(), pages.end());
+    pages.erase(unique(pages.begin(), pages.end()), pages.end());
+    return true;
+}
+
+void SnapshotProcess::readSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    read(address + vector_start, sizeof(triplet), (uint8_t *) &triplet);
+}
+
+void SnapshotProcess::writeSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    write(address + vector_start, sizeof(triplet), (uint8_t *) &triplet);
+}
+
+const std::string SnapshotProcess::readCString (uint32_t offset)
+{
+    std::string temp;
+    char r;
+    while ((r = Process::readByte(offset++)))
+        temp.append(1,r);
+    return temp;
+}
+
+/*
+ * Strings and RTTI depend on the compiler DF was built with.
+ * Windows builds use MSVC, see MicrosoftSTL. Linux builds use GCC, same as in NormalProcess.
+ */
+struct _Rep_base
+{
+    uint32_t _M_length;
+    uint32_t _M_capacity;
+    int32_t _M_refcount;
+};
+
+size_t SnapshotProcess::readSTLString (uint32_t offset, char * buffer, size_t bufcapacity)
+{
+    if(my_descriptor->getOS() == OS_WINDOWS)
+        return stl.readSTLString(offset, buffer, bufcapacity);
+    _Rep_base header;
+    offset = Process::readDWord(offset);
+    read(offset - sizeof(_Rep_base),sizeof(_Rep_base),(uint8_t *)&header);
+    size_t read_real = min((size_t)header._M_length, bufcapacity-1);// keep space for null termination
+    read(offset,read_real,(uint8_t * )buffer);
+    buffer[read_real] = 0;
+    return read_real;
+}
+
+const string SnapshotProcess::readSTLString (uint32_t offset)
+{
+    if(my_descriptor->getOS() == OS_WINDOWS)
+        return stl.readSTLString(offset);
+    _Rep_base header;
+    offset = Process::readDWord(offset);
+    read(offset - sizeof(_Rep_base),sizeof(_Rep_base),(uint8_t *)&header);
+    string ret(header._M_length, 0);
+    if(header._M_length)
+        read(offset, header._M_length, (uint8_t *) &ret[0]);
+    return ret;
+}
+
+string SnapshotProcess::doReadClassName (uint32_t vptr)
+{
+    if(my_descriptor->getOS() == OS_WINDOWS)
+        return stl.readClassName(vptr);
+    int typeinfo = Process::readDWord(vptr - 0x4);
+    int typestring = Process::readDWord(typeinfo + 0x4);
+    string raw = readCString(typestring);
+    size_t  start = raw.find_first_of("abcdefghijklmnopqrstuvwxyz");// trim numbers
+    size_t end = raw.length();
+    return raw.substr(start,end-start);
+}
+
+/*
+ * Capture all the ranges of a suspended process into a snapshot file.
+ * With a parent snapshot, pages that hash the same as the parent's aren't stored again.
+ */
+bool DFHack::writeSnapshot(Process * p, const string & path, const string & parent_path)
+{
+    if(!p->isSuspended())
+    {
+        cerr << "refusing to snapshot a running process" << endl;
+        return false;
+    }
+    SnapshotImage parent;
+    if(!parent_path.empty() && !parent.open(parent_path))
+    {
+        cerr << "couldn't open parent snapshot " << parent_path << endl;
+        return false;
+    }
+    vector<t_memrange> mr;
+    p->getMemRanges(mr);
+
+    t_snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, SNAPSHOT_MAGIC);
+    header.version = SNAPSHOT_VERSION;
+    header.pid = p->getPID();
+    header.num_ranges = mr.size();
+    strncpy(header.path, p->getPath().c_str(), sizeof(header.path) - 1);
+    if(!parent_path.empty())
+    {
+        header.generation = parent.header.generation + 1;
+        strncpy(header.parent, parent_path.c_str(), sizeof(header.parent) - 1);
+    }
+    VersionInfo * vinfo = p->getDescriptor();
+    if(vinfo)
+    {
+        string md5;
+        header.os = vinfo->getOS();
+        header.base = vinfo->getBase();
+        vinfo->getPE(header.pe);
+        if(vinfo->getMD5(md5))
+            strncpy(header.md5, md5.c_str(), sizeof(header.md5) - 1);
+    }
+    else
+        header.os = OS_BAD;
+
+    vector<t_snapshot_range> table(mr.size());
+    vector< vector<uint64_t> > hashes(mr.size());
+    vector< vector<uint64_t> > offsets(mr.size());
+    for(size_t i = 0; i < mr.size(); i++)
+    {
+        t_snapshot_range & sr = table[i];
+        memset(&sr, 0, sizeof(sr));
+        sr.start = mr[i].start;
+        sr.end = mr[i].end;
+        strncpy(sr.name, mr[i].name, sizeof(sr.name) - 1);
+        sr.flags = (mr[i].read ? SNAP_READ : 0) | (mr[i].write ? SNAP_WRITE : 0)
+                 | (mr[i].execute ? SNAP_EXECUTE : 0) | (mr[i].shared ? SNAP_SHARED : 0);
+        // we can only read 32bit addresses anyway
+        if(mr[i].read && sr.end <= 0x100000000ULL && sr.end > sr.start)
+            sr.flags |= SNAP_CAPTURED;
+    }
+
+    FILE * f = fopen(path.c_str(), "wb");
+    if(!f)
+    {
+        cerr << "couldn't create snapshot " << path << endl;
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if(ok && !table.empty())
+        ok = fwrite(&table[0], sizeof(t_snapshot_range), table.size(), f) == table.size();
+    uint64_t written = sizeof(t_snapshot_header) + table.size() * sizeof(t_snapshot_range);
+
+    // pad up to the first page
+    const uint32_t chunk_size = 256 * SNAPSHOT_PAGE;
+    vector<uint8_t> chunk(chunk_size);
+    vector<bool> good;
+    size_t pad = SNAPSHOT_ALIGN - written % SNAPSHOT_ALIGN;
+    if(ok)
+        ok = fwrite(&chunk[0], 1, pad, f) == pad;
+    written += pad;
+
+    for(size_t i = 0; ok && i < table.size(); i++)
+    {
+        t_snapshot_range & sr = table[i];
+        if(!(sr.flags & SNAP_CAPTURED))
+            continue;
+        for(uint64_t pos = sr.start; ok && pos < sr.end; pos += chunk_size)
+        {
+            uint32_t len = min(sr.end - pos, (uint64_t) chunk_size);
+            // the last page of a range may be partial, keep the rest zeroed
+            memset(&chunk[0], 0, chunk_size);
+            p->readTolerant(pos, len, &chunk[0], good);
+            for(uint32_t off = 0; ok && off < len; off += SNAPSHOT_PAGE)
+            {
+                uint8_t * page = &chunk[off];
+                if(!good[off / SNAPSHOT_PAGE])
+                {
+                    hashes[i].push_back(0);
+                    offsets[i].push_back(SNAPSHOT_BAD_PAGE);
+                    continue;
+                }
+                uint64_t hash = hashPage(page);
+                uint64_t parent_hash;
+                hashes[i].push_back(hash);
+                if(parent.getPage(pos + off, &parent_hash) && parent_hash == hash)
+                {
+                    offsets[i].push_back(SNAPSHOT_PARENT_PAGE);
+                    continue;
+                }
+                offsets[i].push_back(written);
+                ok = fwrite(page, 1, SNAPSHOT_PAGE, f) == SNAPSHOT_PAGE;
+                written += SNAPSHOT_PAGE;
+            }
+        }
+    }
+    // page tables go after the pages
+    for(size_t i = 0; ok && i < table.size(); i++)
+    {
+        t_snapshot_range & sr = table[i];
+        if(!(sr.flags & SNAP_CAPTURED))
+            continue;
+        size_t n = hashes[i].size();
+        sr.hashes = written;
+        sr.pages = written + n * 8;
+        ok = fwrite(&hashes[i][0], 8, n, f) == n
+          && fwrite(&offsets[i][0], 8, n, f) == n;
+        written += n * 16;
+    }
+    // now the range table is complete
+    if(ok && !table.empty())
+    {
+        ok = fseek(f, sizeof(t_snapshot_header), SEEK_SET) == 0
+          && fwrite(&table[0], sizeof(t_snapshot_range), table.size(), f) == table.size();
+    }
+    if(fclose(f) != 0)
+        ok = false;
+    if(!ok)
+    {
+        cerr << "couldn't write snapshot " << path << endl;
+        remove(path.c_str());
+    }
+    return ok;
+}
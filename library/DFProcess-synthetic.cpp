@@ -0,0 +1,1160 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+#include "Internal.h"
+#include "PlatformInternal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stddef.h>
+#include <iostream>
+using namespace std;
+
+#include "ProcessFactory.h"
+#include "dfhack/VersionInfo.h"
+#include "dfhack/DFError.h"
+#include "dfhack/DFTileTypes.h"
+#include "dfhack/DFTypes.h"
+#include "dfhack/modules/Maps.h"
+#include "dfhack/modules/Materials.h"
+#include "dfhack/modules/Items.h"
+#include "dfhack/modules/Creatures.h"
+using namespace DFHack;
+
+namespace {
+    // where our own things go. DF's globals are wherever Memory.xml says
+    const uint32_t text_start = 0x0C000000;
+    const uint32_t heap_start = 0x10000000;
+    const uint32_t blocks_start = 0x20000000;
+    const uint32_t synth_page = 4096;
+    // veins per map block, at most
+    const uint32_t max_veins = 4;
+    const uint32_t vein_size = 48;
+
+    // a part of the fake address space kept in memory
+    struct t_synthrange
+    {
+        uint32_t start;
+        vector <uint8_t> data;
+        uint32_t end() const { return start + data.size(); }
+    };
+
+    // where the fields of a map block are
+    struct t_blocklayout
+    {
+        uint32_t type;
+        uint32_t designation;
+        uint32_t occupancy;
+        uint32_t temperature1;
+        uint32_t temperature2;
+        uint32_t biome_stuffs;
+        uint32_t veinvector;
+        int32_t feature_local;
+        int32_t feature_global;
+        // our additions after DF's fields: the block flags and the veins
+        uint32_t flags;
+        uint32_t vein_ptrs;
+        uint32_t veins;
+        uint32_t stride;
+    };
+
+    // a generated block, so reading one a piece at a time doesn't generate it over and over
+    struct t_scratch
+    {
+        vector <uint8_t> data;
+        uint32_t block;
+    };
+
+    /*
+     * A fake DF process. The memory is laid out like a linux DF would have it, using the
+     * offsets of a Memory.xml entry. Everything is generated from the parameters and the seed.
+     * The map blocks don't take any memory until they're written to, they're generated
+     * whenever they're read. This allows benchmarking with the biggest maps.
+     */
+    class SyntheticProcess : public Process
+    {
+        private:
+            VersionInfo * my_descriptor;
+            t_synthetic_params params;
+            bool attached:1;
+            bool identified:1;
+            uint32_t vector_start;
+            // DF's globals
+            t_synthrange data;
+            // vtables, type names and code
+            t_synthrange text;
+            t_synthrange heap;
+            vector <t_memrange> memranges;
+
+            t_blocklayout block;
+            uint32_t num_blocks;
+            uint32_t surface_z;
+            // blocks that were written to, by index
+            map <uint32_t, uint8_t *> written_blocks;
+            // the last generated block
+            t_scratch scratch;
+            uint32_t vein_vptr;
+            int16_t tt_air, tt_wall, tt_vein, tt_floor, tt_grass;
+            uint32_t empty_string;
+            uint32_t rng;
+
+            bool build(VersionInfo * vinfo);
+            bool planData(VersionInfo * vinfo);
+            bool buildMap(OffsetGroup * maps);
+            void buildGeology(OffsetGroup * maps);
+            void buildMaterials(OffsetGroup * materials);
+            void buildCreatures(OffsetGroup * creatures, OffsetGroup * names);
+            void buildItems(OffsetGroup * items);
+            void buildBuildings(OffsetGroup * buildings);
+            void generateBlock(uint32_t index, uint8_t * out);
+
+            uint8_t * locate(uint64_t address, uint64_t & available, bool writing, t_scratch & s);
+            uint8_t * locate(uint64_t address, uint64_t & available, bool writing) { return locate(address, available, writing, scratch); };
+            uint32_t alloc(t_synthrange & r, uint32_t size, uint32_t align = 4);
+            void put(uint32_t address, const void * src, uint32_t length);
+            void put32(uint32_t address, uint32_t value) { put(address, &value, 4); };
+            void put16(uint32_t address, uint16_t value) { put(address, &value, 2); };
+            void put8(uint32_t address, uint8_t value) { put(address, &value, 1); };
+            uint32_t newString(const string & s);
+            void putVector(uint32_t address, const vector <uint32_t> & elements);
+            uint32_t newVTable(const string & classname, uint32_t slots);
+            uint32_t newCode(const uint8_t * code, uint32_t length);
+            uint32_t random();
+        public:
+            SyntheticProcess(const t_synthetic_params & params, VersionInfoFactory * factory);
+            ~SyntheticProcess();
+
+            bool attach() { attached = true; return true; };
+            bool detach() { attached = false; return true; };
+            // nothing runs in here
+            bool suspend() { return true; };
+            bool asyncSuspend() { return true; };
+            bool resume() { return true; };
+            bool forceresume() { return true; };
+
+            void readQuad(const uint32_t address, uint64_t & value) { read(address, 8, (uint8_t *) &value); };
+            void writeQuad(const uint32_t address, const uint64_t value) { write(address, 8, (uint8_t *) &value); };
+            void readDWord(const uint32_t address, uint32_t & value) { read(address, 4, (uint8_t *) &value); };
+            void writeDWord(const uint32_t address, const uint32_t value) { write(address, 4, (uint8_t *) &value); };
+            void readFloat(const uint32_t address, float & value) { read(address, 4, (uint8_t *) &value); };
+            void readWord(const uint32_t address, uint16_t & value) { read(address, 2, (uint8_t *) &value); };
+            void writeWord(const uint32_t address, const uint16_t value) { write(address, 2, (uint8_t *) &value); };
+            void readByte(const uint32_t address, uint8_t & value) { read(address, 1, &value); };
+            void writeByte(const uint32_t address, const uint8_t value) { write(address, 1, (uint8_t *) &value); };
+
+            void read( uint32_t address, uint32_t length, uint8_t* buffer);
+            void write(uint32_t address, uint32_t length, uint8_t* buffer);
+            // for the readers, which generate blocks into their own scratch
+            void read( uint32_t address, uint32_t length, uint8_t* buffer, t_scratch & s);
+            ProcessReader * createReader();
+
+            const std::string readSTLString (uint32_t offset);
+            size_t readSTLString (uint32_t offset, char * buffer, size_t bufcapacity);
+            size_t writeSTLString(const uint32_t address, const std::string writeString) { return 0; };
+            void readSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            void writeSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            std::string doReadClassName(uint32_t vptr);
+            const std::string readCString (uint32_t offset);
+
+            bool isSuspended() { return true; };
+            bool isAttached() { return attached; };
+            bool isIdentified() { return identified; };
+
+            bool getThreadIDs(std::vector<uint32_t> & threads ) { threads.clear(); return false; };
+            void getMemRanges(std::vector<t_memrange> & ranges );
+            const t_memrange * rangeOf(uint32_t address) { return rangeIndex.rangeOf(address); };
+            VersionInfo *getDescriptor() { return my_descriptor; };
+            int getPID() { return 0; };
+            std::string getPath() { return "synthetic"; };
+            bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) { OUTPUT = 0; return false; };
+            char * getSHMStart (void) { return 0; };
+            bool SetAndWait (uint32_t state) { return false; };
+    };
+}
+
+// integer hash, gives every tile of the map its own random number
+static uint32_t mix(uint32_t a)
+{
+    a ^= a >> 16;
+    a *= 0x7feb352d;
+    a ^= a >> 15;
+    a *= 0x846ca68b;
+    a ^= a >> 16;
+    return a;
+}
+
+static inline uint32_t roundUp(uint32_t value, uint32_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+// make size cover a field of a group, if the group has it
+static void cover(uint32_t & size, OffsetGroup * group, const char * name, uint32_t length)
+{
+    int32_t offset;
+    if(group && group->getSafeOffset(name, offset) && offset >= 0)
+        size = max(size, (uint32_t) offset + length);
+}
+
+static uint32_t safeAddress(OffsetGroup * group, const char * name)
+{
+    uint32_t address = 0;
+    if(group)
+        group->getSafeAddress(name, address);
+    return address;
+}
+
+Process* DFHack::createSyntheticProcess(const t_synthetic_params & params, VersionInfoFactory * factory)
+{
+    return new SyntheticProcess(params, factory);
+}
+
+SyntheticProcess::SyntheticProcess(const t_synthetic_params & _params, VersionInfoFactory * factory)
+{
+    params = _params;
+    my_descriptor = 0;
+    attached = false;
+    identified = false;
+    vector_start = 0;
+    num_blocks = 0;
+    surface_z = 0;
+    scratch.block = 0;
+    vein_vptr = 0;
+    empty_string = 0;
+    rng = mix(params.seed) | 1;
+    memset(&block, 0, sizeof(block));
+
+    // find the Memory.xml entry to imitate
+    VersionInfo * vinfo = 0;
+    for(size_t i = 0; i < factory->versions.size(); i++)
+    {
+        VersionInfo * v = factory->versions[i];
+        string md5;
+        if(params.version.empty())
+        {
+            // the newest linux version that knows where the map is
+            if(v->getOS() == OS_LINUX && safeAddress(v->getGroup("Maps"), "map_data"))
+                vinfo = v;
+        }
+        else if(v->getVersion() == params.version || (v->getMD5(md5) && md5 == params.version))
+        {
+            vinfo = v;
+            break;
+        }
+    }
+    if(!vinfo)
+    {
+        cerr << "synthetic: no usable Memory.xml entry" << endl;
+        return;
+    }
+    if(vinfo->getOS() != OS_LINUX)
+    {
+        cerr << "synthetic: only linux memory layouts can be generated" << endl;
+        return;
+    }
+    my_descriptor = new VersionInfo(*vinfo);
+    my_descriptor->setParentProcess(this);
+    try
+    {
+        identified = build(my_descriptor);
+    }
+    catch (exception & e)
+    {
+        cerr << "synthetic: " << e.what() << endl;
+        identified = false;
+    }
+}
+
+SyntheticProcess::~SyntheticProcess()
+{
+    for(map <uint32_t, uint8_t *>::iterator it = written_blocks.begin(); it != written_blocks.end(); ++it)
+        delete [] it->second;
+    if(my_descriptor)
+        delete my_descriptor;
+}
+
+bool SyntheticProcess::build(VersionInfo * vinfo)
+{
+    if(params.x_blocks == 0 || params.x_blocks > 48 || params.y_blocks == 0 || params.y_blocks > 48 || params.z_blocks == 0)
+    {
+        cerr << "synthetic: bad map size " << params.x_blocks << "x" << params.y_blocks << "x" << params.z_blocks << endl;
+        return false;
+    }
+    vector_start = vinfo->getGroup("vector")->getOffset("start");
+    if(!planData(vinfo))
+        return false;
+    text.start = text_start;
+    heap.start = heap_start;
+
+    // tiles we use
+    tt_air = findTileType(EMPTY, AIR, tilevariant_invalid, tilespecial_invalid, TileDirection());
+    tt_wall = findTileType(WALL, STONE, VAR_1, TILE_NORMAL, TileDirection());
+    tt_vein = findTileType(WALL, VEIN, VAR_1, TILE_NORMAL, TileDirection());
+    tt_floor = findTileType(FLOOR, SOIL, VAR_1, TILE_NORMAL, TileDirection());
+    tt_grass = findTileType(FLOOR, GRASS, VAR_1, TILE_NORMAL, TileDirection());
+
+    // GCC keeps one shared empty string around, so do we
+    empty_string = newString("");
+    vein_vptr = newVTable("block_square_event_mineralst", 8);
+
+    OffsetGroup * maps = vinfo->getGroup("Maps");
+    if(!maps || !buildMap(maps))
+        return false;
+    buildGeology(maps);
+    buildMaterials(vinfo->getGroup("Materials"));
+    buildCreatures(vinfo->getGroup("Creatures"), vinfo->getGroup("name"));
+    buildItems(vinfo->getGroup("Items"));
+    buildBuildings(vinfo->getGroup("Buildings"));
+
+    // everything is built, pad the ranges to whole pages
+    data.data.resize(roundUp(data.data.size(), synth_page));
+    text.data.resize(roundUp(text.data.size(), synth_page));
+    heap.data.resize(roundUp(heap.data.size(), synth_page));
+    if(heap.end() > blocks_start)
+    {
+        cerr << "synthetic: the heap doesn't fit" << endl;
+        return false;
+    }
+
+    t_memrange mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.valid = true;
+    mr.read = true;
+    mr.write = true;
+    strcpy(mr.name, "/synthetic/libs/Dwarf_Fortress");
+    mr.start = data.start;
+    mr.end = data.end();
+    memranges.push_back(mr);
+    mr.write = false;
+    mr.execute = true;
+    mr.start = text.start;
+    mr.end = text.end();
+    memranges.push_back(mr);
+    mr.write = true;
+    mr.execute = false;
+    strcpy(mr.name, "[heap]");
+    mr.start = heap.start;
+    mr.end = heap.end();
+    memranges.push_back(mr);
+    strcpy(mr.name, "[map blocks]");
+    mr.start = blocks_start;
+    mr.end = blocks_start + (uint64_t) num_blocks * block.stride;
+    memranges.push_back(mr);
+    rangeIndex.build(memranges);
+
+    scratch.data.resize(block.stride);
+    scratch.block = num_blocks;
+    return true;
+}
+
+/*
+ * DF's globals are spread over a few MB. Take a window around the ones we fill in,
+ * so the modules find zeroed (empty) data where we didn't put anything.
+ */
+bool SyntheticProcess::planData(VersionInfo * vinfo)
+{
+    static const char * wanted[][2] =
+    {
+        {"Maps", "map_data"}, {"Maps", "x_count_block"}, {"Maps", "y_count_block"}, {"Maps", "z_count_block"},
+        {"Maps", "region_x"}, {"Maps", "region_y"}, {"Maps", "region_z"}, {"Maps", "world_data"},
+        {"Creatures", "vector"}, {"Creatures", "current_race"}, {"Creatures", "current_civ"},
+        {"Items", "items_vector"}, {"Buildings", "buildings_vector"}, {"Vegetation", "vector"},
+        {"Position", "cursor_xyz"}, {"Position", "window_x"}, {"World", "control_mode"},
+        {"World", "current_weather"}, {"GUI", "pause_state"}, {"Translations", "language_vector"},
+        {"Materials", "inorganics"}, {"Constructions", "vector"}
+    };
+    const uint32_t slack = 0x400000;
+    uint32_t low = 0xFFFFFFFF;
+    uint32_t high = 0;
+    for(size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++)
+    {
+        uint32_t address = safeAddress(vinfo->getGroup(wanted[i][0]), wanted[i][1]);
+        if(!address)
+            continue;
+        low = min(low, address);
+        high = max(high, address);
+    }
+    if(!high)
+        return false;
+    low = low > slack ? (low - slack) & ~(synth_page - 1) : synth_page;
+    high = roundUp(high + slack, synth_page);
+    if(high > text_start)
+    {
+        cerr << "synthetic: DF's globals are where we want to put our stuff" << endl;
+        return false;
+    }
+    data.start = low;
+    data.data.resize(high - low);
+    return true;
+}
+
+bool SyntheticProcess::buildMap(OffsetGroup * maps)
+{
+    OffsetGroup * og_block = maps->getGroup("block");
+    uint32_t map_data = safeAddress(maps, "map_data");
+    if(!og_block || !map_data)
+        return false;
+    block.type = og_block->getOffset("type");
+    block.designation = og_block->getOffset("designation");
+    block.occupancy = og_block->getOffset("occupancy");
+    block.temperature1 = og_block->getOffset("temperature1");
+    block.temperature2 = og_block->getOffset("temperature2");
+    block.biome_stuffs = og_block->getOffset("biome_stuffs");
+    block.veinvector = og_block->getOffset("vein_vector");
+    block.feature_local = -1;
+    block.feature_global = -1;
+    og_block->getSafeOffset("feature_local", block.feature_local);
+    og_block->getSafeOffset("feature_global", block.feature_global);
+
+    // DF's part of the block ends with the last field we know about
+    uint32_t size = 4;
+    cover(size, og_block, "type", sizeof(tiletypes40d));
+    cover(size, og_block, "designation", sizeof(designations40d));
+    cover(size, og_block, "occupancy", sizeof(occupancies40d));
+    cover(size, og_block, "temperature1", sizeof(t_temperatures));
+    cover(size, og_block, "temperature2", sizeof(t_temperatures));
+    cover(size, og_block, "biome_stuffs", sizeof(biome_indices40d));
+    cover(size, og_block, "vein_vector", 12);
+    cover(size, og_block, "vegetation_vector", 12);
+    cover(size, og_block, "feature_local", 2);
+    cover(size, og_block, "feature_global", 2);
+    cover(size, og_block, "mystery_offset", 4);
+    block.flags = roundUp(size, 4);
+    block.vein_ptrs = block.flags + 4;
+    block.veins = block.vein_ptrs + 4 * max_veins;
+    block.stride = roundUp(block.veins + vein_size * max_veins, 64);
+
+    uint32_t mx = params.x_blocks;
+    uint32_t my = params.y_blocks;
+    uint32_t mz = params.z_blocks;
+    num_blocks = mx * my * mz;
+    if((uint64_t) num_blocks * block.stride > 0xFFFFF000ULL - blocks_start)
+    {
+        cerr << "synthetic: the map doesn't fit into 32 bits" << endl;
+        return false;
+    }
+    surface_z = mz * 2 / 3;
+
+    // x -> y -> z arrays of block pointers, same as Maps::Start expects
+    uint32_t x_array = alloc(heap, mx * 4);
+    uint32_t y_arrays = alloc(heap, mx * my * 4);
+    uint32_t z_arrays = alloc(heap, mx * my * mz * 4);
+    for(uint32_t x = 0; x < mx; x++)
+    {
+        put32(x_array + x * 4, y_arrays + x * my * 4);
+        for(uint32_t y = 0; y < my; y++)
+        {
+            uint32_t column = x * my + y;
+            put32(y_arrays + column * 4, z_arrays + column * mz * 4);
+            for(uint32_t z = 0; z < mz; z++)
+            {
+                uint32_t index = column * mz + z;
+                put32(z_arrays + index * 4, blocks_start + index * block.stride);
+            }
+        }
+    }
+    put32(map_data, x_array);
+    put32(maps->getAddress("x_count_block"), mx);
+    put32(maps->getAddress("y_count_block"), my);
+    put32(maps->getAddress("z_count_block"), mz);
+    uint32_t address;
+    if(maps->getSafeAddress("x_count", address))
+        put32(address, mx * 16);
+    if(maps->getSafeAddress("y_count", address))
+        put32(address, my * 16);
+    if(maps->getSafeAddress("z_count", address))
+        put32(address, mz);
+    return true;
+}
+
+/*
+ * A world of a single region with a single geology block, so Maps::ReadGeology has something to read.
+ */
+void SyntheticProcess::buildGeology(OffsetGroup * maps)
+{
+    OffsetGroup * geology = maps->getGroup("geology");
+    uint32_t world_data = safeAddress(maps, "world_data");
+    int32_t size_x, size_y, regions_off, geoblocks_off, geo_index, layers_off, layer_type;
+    if(!geology || !world_data
+       || !maps->getSafeOffset("world_size_x_from_wdata", size_x)
+       || !maps->getSafeOffset("world_size_y_from_wdata", size_y)
+       || !geology->getSafeOffset("ptr2_region_array_from_wdata", regions_off)
+       || !geology->getSafeOffset("geoblock_vector_from_wdata", geoblocks_off)
+       || !geology->getSafeOffset("region_geo_index_off", geo_index)
+       || !geology->getSafeOffset("geolayer_geoblock_offset", layers_off)
+       || !geology->getSafeOffset("type_inside_geolayer", layer_type))
+        return;
+    uint32_t region_size = geology->getHexValue("region_size");
+
+    uint32_t world = alloc(heap, 0x1000);
+    put32(world_data, world);
+    put16(world + size_x, 1);
+    put16(world + size_y, 1);
+    uint32_t regions = alloc(heap, 4);
+    uint32_t column = alloc(heap, region_size);
+    put32(world + regions_off, regions);
+    put32(regions, column);
+    put16(column + geo_index, 0);
+
+    vector <uint32_t> layers;
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        uint32_t layer = alloc(heap, layer_type + 16);
+        put16(layer + layer_type, i);
+        layers.push_back(layer);
+    }
+    uint32_t geoblock = alloc(heap, layers_off + 16);
+    putVector(geoblock + layers_off, layers);
+    putVector(world + geoblocks_off, vector <uint32_t> (1, geoblock));
+}
+
+/*
+ * Material and race tables. Just the IDs, which is all the modules read of them.
+ * Veins, layers and creatures use the first few entries.
+ */
+void SyntheticProcess::buildMaterials(OffsetGroup * materials)
+{
+    static const char * inorganics[] =
+    {
+        "SANDSTONE", "SILTSTONE", "MUDSTONE", "SHALE", "CLAYSTONE", "ROCK_SALT", "LIMESTONE", "CONGLOMERATE",
+        "DOLOMITE", "CHERT", "CHALK", "GRANITE", "DIORITE", "GABBRO", "RHYOLITE", "BASALT",
+        "ANDESITE", "DACITE", "OBSIDIAN", "QUARTZITE", "SLATE", "PHYLLITE", "SCHIST", "GNEISS",
+        "MARBLE", "HEMATITE", "LIMONITE", "GARNIERITE", "NATIVE_GOLD", "NATIVE_SILVER", "NATIVE_COPPER", "MALACHITE"
+    };
+    static const char * races[] =
+    {
+        "DWARF", "HUMAN", "ELF", "GOBLIN", "KOBOLD", "CAT", "DOG", "HORSE", "COW", "DONKEY", "GOAT",
+        "PIG", "SHEEP", "LLAMA", "ALPACA", "YAK", "WATER_BUFFALO", "MULE", "RAT", "CROW", "GIANT_EAGLE"
+    };
+    uint32_t address;
+    vector <uint32_t> all;
+    if(materials && materials->getSafeAddress("inorganics", address))
+    {
+        for(size_t i = 0; i < sizeof(inorganics) / sizeof(inorganics[0]); i++)
+        {
+            uint32_t mat = alloc(heap, 0x100);
+            put32(mat, newString(inorganics[i]));
+            all.push_back(mat);
+        }
+        putVector(address, all);
+    }
+    all.clear();
+    if(materials && materials->getSafeAddress("creature_type_vector", address))
+    {
+        for(size_t i = 0; i < sizeof(races) / sizeof(races[0]); i++)
+        {
+            uint32_t race = alloc(heap, 0x100);
+            put32(race, newString(races[i]));
+            all.push_back(race);
+        }
+        putVector(address, all);
+    }
+}
+
+void SyntheticProcess::buildCreatures(OffsetGroup * creatures, OffsetGroup * names)
+{
+    static const char * first_names[] =
+    {
+        "Urist", "Kogan", "Bomrek", "Litast", "Zon", "Ast", "Doren", "Cerol", "Edem", "Mafol"
+    };
+    OffsetGroup * og_creature = creatures ? creatures->getGroup("creature") : 0;
+    uint32_t vector_addr = safeAddress(creatures, "vector");
+    if(!og_creature || !names || !vector_addr)
+        return;
+    OffsetGroup * og_advanced = og_creature->getGroup("advanced");
+    OffsetGroup * og_soul = creatures->getGroup("soul");
+
+    uint32_t address;
+    const uint32_t race = 0;
+    const uint32_t civ = 1;
+    if(creatures->getSafeAddress("current_race", address))
+        put32(address, race);
+    if(creatures->getSafeAddress("current_civ", address))
+        put32(address, civ);
+
+    // everything the creature module could look at, and then some
+    uint32_t size = 0x100;
+    static const char * fields[] =
+    {
+        "name", "custom_profession", "profession", "race", "position", "flags1", "flags2",
+        "caste", "sex", "id", "civ", "mood", "birth_year", "birth_time", "inventory_vector",
+        "owned_items_vector", "current_job", "current_job_skill", "physical", "appearance_vector",
+        "artifact_name", "soul_vector", "current_soul", "labors", "happiness"
+    };
+    for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        cover(size, og_creature, fields[i], 0x100);
+        cover(size, og_advanced, fields[i], 0x100);
+    }
+    uint32_t soul_size = 0x100;
+    cover(soul_size, og_soul, "mental", 0x100);
+    cover(soul_size, og_soul, "skills_vector", 12);
+    cover(soul_size, og_soul, "traits", 2 * NUM_CREATURE_TRAITS);
+
+    int32_t first = names->getOffset("first");
+    int32_t nick = names->getOffset("nick");
+    int32_t words = names->getOffset("second_words");
+    int32_t off;
+
+    vector <uint32_t> all;
+    for(uint32_t i = 0; i < params.creatures; i++)
+    {
+        uint32_t c = alloc(heap, size);
+        int32_t name = og_creature->getOffset("name");
+        put32(c + name + first, newString(first_names[random() % 10]));
+        put32(c + name + nick, empty_string);
+        for(int w = 0; w < 7; w++)
+            put32(c + name + words + w * 4, 0xFFFFFFFF);
+        put32(c + og_creature->getOffset("custom_profession"), empty_string);
+        put16(c + og_creature->getOffset("profession"), random() % 100);
+        // mostly dwarves, some visitors
+        bool dwarf = random() % 5 != 0;
+        put32(c + og_creature->getOffset("race"), dwarf ? race : 1 + random() % 20);
+        put32(c + og_creature->getOffset("civ"), dwarf ? civ : 0xFFFFFFFF);
+        put32(c + og_creature->getOffset("id"), i);
+        put8(c + og_creature->getOffset("sex"), random() % 2);
+        int16_t pos[3] =
+        {
+            (int16_t) (random() % (params.x_blocks * 16)),
+            (int16_t) (random() % (params.y_blocks * 16)),
+            (int16_t) surface_z
+        };
+        put(c + og_creature->getOffset("position"), pos, sizeof(pos));
+        if(!og_advanced)
+        {
+            all.push_back(c);
+            continue;
+        }
+        if(og_advanced->getSafeOffset("mood", off))
+            put16(c + off, 0xFFFF);
+        if(og_advanced->getSafeOffset("birth_year", off))
+            put32(c + off, 100 + random() % 150);
+        if(og_advanced->getSafeOffset("happiness", off))
+            put32(c + off, random() % 200);
+        if(og_advanced->getSafeOffset("artifact_name", off))
+        {
+            put32(c + off + first, empty_string);
+            put32(c + off + nick, empty_string);
+        }
+        if(og_advanced->getSafeOffset("labors", off))
+        {
+            for(int l = 0; l < NUM_CREATURE_LABORS; l++)
+                put8(c + off + l, random() % 4 == 0);
+        }
+        int32_t souls_off, current_off;
+        if(og_soul && og_advanced->getSafeOffset("soul_vector", souls_off)
+           && og_advanced->getSafeOffset("current_soul", current_off))
+        {
+            uint32_t soul = alloc(heap, soul_size);
+            putVector(c + souls_off, vector <uint32_t> (1, soul));
+            put32(c + current_off, soul);
+            if(og_soul->getSafeOffset("skills_vector", off))
+            {
+                vector <uint32_t> skills;
+                uint32_t num = random() % 8;
+                for(uint32_t s = 0; s < num; s++)
+                {
+                    uint32_t skill = alloc(heap, 12);
+                    put32(skill, random() % 100);
+                    put32(skill + 4, random() % 16);
+                    put32(skill + 8, random() % 1000);
+                    skills.push_back(skill);
+                }
+                putVector(soul + off, skills);
+            }
+            if(og_soul->getSafeOffset("traits", off))
+            {
+                for(int t = 0; t < NUM_CREATURE_TRAITS; t++)
+                    put16(soul + off + t * 2, random() % 101);
+            }
+        }
+        all.push_back(c);
+    }
+    putVector(vector_addr, all);
+}
+
+/*
+ * Item properties are read through the accessor methods in the vtables. The accessors are
+ * real x86 code: constants for the item type, [this+offset] loads for the rest.
+ */
+void SyntheticProcess::buildItems(OffsetGroup * items)
+{
+    static const struct
+    {
+        const char * name;
+        uint8_t type;
+    } classes[] =
+    {
+        {"item_barst", 0}, {"item_smallgemst", 1}, {"item_blocksst", 2}, {"item_roughst", 3},
+        {"item_boulderst", 4}, {"item_woodst", 5}, {"item_doorst", 6}, {"item_seedsst", 52}
+    };
+    static const char * accessors[] =
+    {
+        "item_subtype_accessor", "item_subindex_accessor", "item_index_accessor",
+        "item_quality_accessor", "item_wear_accessor", "item_quantity_accessor"
+    };
+    const int num_classes = sizeof(classes) / sizeof(classes[0]);
+    const int num_accessors = sizeof(accessors) / sizeof(accessors[0]);
+    uint32_t vector_addr = safeAddress(items, "items_vector");
+    int32_t type_slot;
+    if(!vector_addr || !items->getSafeOffset("item_type_accessor", type_slot))
+        return;
+
+    // the accessed fields go after the ones DF's item has
+    uint32_t size = sizeof(t_item);
+    cover(size, items, "id", 4);
+    cover(size, items, "item_ref_vector", 12);
+    uint32_t extra = roundUp(size, 4);
+    // subtype, subindex, index: int32. quality, wear: int16. quantity: int32
+    const uint32_t field_off[] = {extra, extra + 4, extra + 8, extra + 12, extra + 14, extra + 16};
+    const bool field_short[] = {false, false, false, true, true, false};
+    size = extra + 20;
+
+    uint32_t slots = type_slot / 4 + 1;
+    int32_t accessor_slot[num_accessors];
+    uint32_t accessor_code[num_accessors];
+    for(int i = 0; i < num_accessors; i++)
+    {
+        accessor_slot[i] = -1;
+        if(!items->getSafeOffset(accessors[i], accessor_slot[i]))
+            continue;
+        slots = max(slots, (uint32_t) accessor_slot[i] / 4 + 1);
+        // mov eax, [esp+4]
+        uint8_t code[16] = {0x8B, 0x44, 0x24, 0x04};
+        uint32_t len = 4;
+        // mov eax, [eax+off] or movsx eax, word [eax+off]
+        if(field_short[i])
+        {
+            code[len++] = 0x0F;
+            code[len++] = 0xBF;
+        }
+        else
+            code[len++] = 0x8B;
+        if(field_off[i] < 0x80)
+        {
+            code[len++] = 0x40;
+            code[len++] = field_off[i];
+        }
+        else
+        {
+            code[len++] = 0x80;
+            memcpy(code + len, &field_off[i], 4);
+            len += 4;
+        }
+        // ret
+        code[len++] = 0xC3;
+        accessor_code[i] = newCode(code, len);
+    }
+    const uint8_t ret = 0xC3;
+    uint32_t ret_code = newCode(&ret, 1);
+
+    uint32_t vtables[num_classes];
+    for(int c = 0; c < num_classes; c++)
+    {
+        vtables[c] = newVTable(classes[c].name, slots);
+        for(uint32_t s = 0; s < slots; s++)
+            put32(vtables[c] + s * 4, ret_code);
+        // mov eax, type ; ret
+        uint8_t code[6] = {0xB8, classes[c].type, 0, 0, 0, 0xC3};
+        put32(vtables[c] + type_slot, newCode(code, sizeof(code)));
+        for(int i = 0; i < num_accessors; i++)
+        {
+            if(accessor_slot[i] != -1)
+                put32(vtables[c] + accessor_slot[i], accessor_code[i]);
+        }
+    }
+
+    int32_t id_off = items->getOffset("id");
+    vector <uint32_t> all;
+    for(uint32_t i = 0; i < params.items; i++)
+    {
+        uint32_t item = alloc(heap, size);
+        t_item base;
+        memset(&base, 0, sizeof(base));
+        base.vtable = vtables[random() % num_classes];
+        base.x = random() % (params.x_blocks * 16);
+        base.y = random() % (params.y_blocks * 16);
+        base.z = surface_z;
+        put(item, &base, sizeof(base));
+        put32(item + id_off, i);
+        put32(item + field_off[0], random() % 10);
+        put32(item + field_off[1], 0xFFFFFFFF);
+        put32(item + field_off[2], random() % 100);
+        put16(item + field_off[3], random() % 6);
+        put16(item + field_off[4], random() % 4);
+        put32(item + field_off[5], 1 + random() % 3);
+        all.push_back(item);
+    }
+    putVector(vector_addr, all);
+}
+
+void SyntheticProcess::buildBuildings(OffsetGroup * buildings)
+{
+    static const char * classes[] =
+    {
+        "building_bedst", "building_tablest", "building_chairst", "building_doorst",
+        "building_stockpilest", "building_farmplotst", "building_tradedepotst", "building_wagonst"
+    };
+    const int num_classes = sizeof(classes) / sizeof(classes[0]);
+    uint32_t vector_addr = safeAddress(buildings, "buildings_vector");
+    if(!vector_addr)
+        return;
+    uint32_t vtables[num_classes];
+    for(int c = 0; c < num_classes; c++)
+        vtables[c] = newVTable(classes[c], 8);
+
+    vector <uint32_t> all;
+    for(uint32_t i = 0; i < params.buildings; i++)
+    {
+        // vtable, x1, y1, centerx, x2, y2, centery, z, height, material
+        uint32_t b = alloc(heap, 0x100);
+        uint32_t x1 = random() % (params.x_blocks * 16);
+        uint32_t y1 = random() % (params.y_blocks * 16);
+        uint32_t w = random() % 3;
+        uint32_t fields[9] = {vtables[random() % num_classes], x1, y1, x1 + w / 2, x1 + w, y1 + w, y1 + w / 2, surface_z, 1};
+        put(b, fields, sizeof(fields));
+        all.push_back(b);
+    }
+    putVector(vector_addr, all);
+}
+
+/*
+ * Fill in one map block. Air above the surface, grass and soil on it, rock with a few
+ * tunnels and veins below.
+ */
+void SyntheticProcess::generateBlock(uint32_t index, uint8_t * out)
+{
+    uint32_t z = index % params.z_blocks;
+    uint32_t address = blocks_start + index * block.stride;
+    uint32_t seed = mix(params.seed ^ mix(index));
+    memset(out, 0, block.stride);
+
+    // the flags are behind a pointer at the start of the block
+    *(uint32_t *) out = address + block.flags;
+    if(block.feature_local >= 0)
+        *(int16_t *) (out + block.feature_local) = -1;
+    if(block.feature_global >= 0)
+        *(int16_t *) (out + block.feature_global) = -1;
+
+    uint16_t * types = (uint16_t *) (out + block.type);
+    t_designation * designations = (t_designation *) (out + block.designation);
+    uint16_t * temp1 = (uint16_t *) (out + block.temperature1);
+    uint16_t * temp2 = (uint16_t *) (out + block.temperature2);
+    memset(out + block.biome_stuffs, 4, sizeof(biome_indices40d));
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        // tiles are stored column by column: [x][y]
+        uint32_t r = mix(seed + i);
+        t_designation & des = designations[i];
+        if(z > surface_z)
+        {
+            types[i] = tt_air;
+            des.bits.skyview = 1;
+            des.bits.light = 1;
+        }
+        else if(z == surface_z)
+        {
+            types[i] = r % 8 ? tt_grass : tt_floor;
+            des.bits.skyview = 1;
+            des.bits.light = 1;
+        }
+        else
+        {
+            types[i] = r % 16 ? tt_wall : tt_floor;
+            des.bits.hidden = 1;
+            des.bits.subterranean = 1;
+            des.bits.geolayer_index = min((surface_z - z) / 8, 3u);
+        }
+        temp1[i] = 10015;
+        temp2[i] = 10015;
+    }
+
+    // veins only grow in rock
+    uint32_t num_veins = z < surface_z ? seed % (max_veins + 1) : 0;
+    t_vecTriplet veins;
+    veins.start = address + block.vein_ptrs;
+    veins.end = veins.start + num_veins * 4;
+    veins.alloc_end = veins.end;
+    if(num_veins)
+        memcpy(out + block.veinvector + vector_start, &veins, sizeof(veins));
+    for(uint32_t v = 0; v < num_veins; v++)
+    {
+        uint32_t vein_addr = address + block.veins + v * vein_size;
+        t_vein vein;
+        memset(&vein, 0, sizeof(vein));
+        vein.vtable = vein_vptr;
+        vein.type = mix(seed + 1000 + v) % 32;
+        for(int row = 0; row < 16; row++)
+            vein.assignment[row] = mix(seed + 2000 + v * 16 + row) & mix(seed + 3000 + v * 16 + row)
+                                 & mix(seed + 4000 + v * 16 + row);
+        ((uint32_t *) (out + block.vein_ptrs))[v] = vein_addr;
+        memcpy(out + block.veins + v * vein_size, &vein, offsetof(t_vein, address_of));
+        // the walls the vein runs through are vein walls
+        for(uint32_t x = 0; x < 16; x++)
+            for(uint32_t y = 0; y < 16; y++)
+        {
+            if((vein.assignment[y] & (1 << x)) && types[x * 16 + y] == tt_wall)
+                types[x * 16 + y] = tt_vein;
+        }
+    }
+}
+
+/*
+ * Memory access
+ */
+
+uint8_t * SyntheticProcess::locate(uint64_t address, uint64_t & available, bool writing, t_scratch & s)
+{
+    t_synthrange * ranges[] = {&data, &text, &heap};
+    for(int i = 0; i < 3; i++)
+    {
+        t_synthrange & r = *ranges[i];
+        if(address >= r.start && address < r.end())
+        {
+            available = r.end() - address;
+            return &r.data[address - r.start];
+        }
+    }
+    if(address < blocks_start || address >= blocks_start + (uint64_t) num_blocks * block.stride)
+        return 0;
+    uint32_t index = (address - blocks_start) / block.stride;
+    uint32_t offset = (address - blocks_start) % block.stride;
+    available = block.stride - offset;
+    map <uint32_t, uint8_t *>::iterator it = written_blocks.find(index);
+    if(it != written_blocks.end())
+        return it->second + offset;
+    if(writing)
+    {
+        // from now on, this block lives in memory
+        uint8_t * stored = new uint8_t[block.stride];
+        generateBlock(index, stored);
+        written_blocks[index] = stored;
+        if(scratch.block == index)
+            scratch.block = num_blocks;
+        return stored + offset;
+    }
+    if(s.block != index)
+    {
+        generateBlock(index, &s.data[0]);
+        s.block = index;
+    }
+    return &s.data[offset];
+}
+
+void SyntheticProcess::read (uint32_t address, uint32_t length, uint8_t *buffer)
+{
+    read(address, length, buffer, scratch);
+}
+
+void SyntheticProcess::read (uint32_t address, uint32_t length, uint8_t *buffer, t_scratch & s)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    while (pos < end)
+    {
+        uint64_t available;
+        uint8_t * src = locate(pos, available, false, s);
+        if(!src)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t chunk = min(available, end - pos);
+        memcpy(buffer + (pos - address), src, chunk);
+        pos += chunk;
+    }
+}
+
+void SyntheticProcess::write (uint32_t address, uint32_t length, uint8_t *buffer)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    while (pos < end)
+    {
+        uint64_t available;
+        uint8_t * dst = locate(pos, available, true);
+        if(!dst)
+            throw Error::MemoryAccessDenied(address);
+        uint64_t chunk = min(available, end - pos);
+        memcpy(dst, buffer + (pos - address), chunk);
+        pos += chunk;
+    }
+}
+
+namespace {
+    // nothing but a scratch block of its own. only good as long as nobody writes to the process
+    class SyntheticReader : public ProcessReader
+    {
+        public:
+            SyntheticReader(SyntheticProcess * owner, const t_scratch & scratch)
+            : owner(owner), scratch(scratch) {};
+            void readBatch(const t_readop * ops, size_t n)
+            {
+                for(size_t i = 0; i < n; i++)
+                    owner->read(ops[i].address, ops[i].length, ops[i].buffer, scratch);
+            }
+        private:
+            SyntheticProcess * owner;
+            t_scratch scratch;
+    };
+}
+
+ProcessReader * SyntheticProcess::createReader()
+{
+    return new SyntheticReader(this, scratch);
+}
+
+void SyntheticProcess::getMemRanges( vector<t_memrange> & ranges )
+{
+    ranges.insert(ranges.end(), memranges.begin(), memranges.end());
+}
+
+/*
+ * Building the image
+ */
+
+uint32_t SyntheticProcess::alloc(t_synthrange & r, uint32_t size, uint32_t align)
+{
+    uint32_t offset = roundUp(r.data.size(), align);
+    r.data.resize(offset + size);
+    return r.start + offset;
+}
+
+void SyntheticProcess::put(uint32_t address, const void * src, uint32_t length)
+{
+    uint64_t available;
+    uint8_t * dst = locate(address, available, false);
+    // only for the ranges kept in memory
+    if(!dst || available < length || address >= blocks_start)
+        throw Error::MemoryAccessDenied(address);
+    memcpy(dst, src, length);
+}
+
+// GCC string: a pointer to the characters, with the length, capacity and refcount before them
+uint32_t SyntheticProcess::newString(const string & s)
+{
+    uint32_t rep = alloc(heap, 12 + s.size() + 1);
+    uint32_t header[3] = {(uint32_t) s.size(), (uint32_t) s.size(), 0};
+    put(rep, header, sizeof(header));
+    put(rep + 12, s.c_str(), s.size() + 1);
+    return rep + 12;
+}
+
+void SyntheticProcess::putVector(uint32_t address, const vector <uint32_t> & elements)
+{
+    t_vecTriplet triplet;
+    triplet.start = triplet.end = triplet.alloc_end = 0;
+    if(!elements.empty())
+    {
+        triplet.start = alloc(heap, elements.size() * 4);
+        put(triplet.start, &elements[0], elements.size() * 4);
+        triplet.end = triplet.alloc_end = triplet.start + elements.size() * 4;
+    }
+    put(address + vector_start, &triplet, sizeof(triplet));
+}
+
+// GCC RTTI: the vtable is preceded by a pointer to the typeinfo, which points to the mangled name
+uint32_t SyntheticProcess::newVTable(const string & classname, uint32_t slots)
+{
+    char mangled[256];
+    snprintf(mangled, sizeof(mangled), "%u%s", (unsigned) classname.size(), classname.c_str());
+    uint32_t name = alloc(text, strlen(mangled) + 1, 1);
+    put(name, mangled, strlen(mangled) + 1);
+    uint32_t typeinfo = alloc(text, 8);
+    put32(typeinfo + 4, name);
+    uint32_t vtable = alloc(text, 4 + slots * 4, 16) + 4;
+    put32(vtable - 4, typeinfo);
+    return vtable;
+}
+
+uint32_t SyntheticProcess::newCode(const uint8_t * code, uint32_t length)
+{
+    uint32_t address = alloc(text, length, 16);
+    put(address, code, length);
+    return address;
+}
+
+// xorshift. only used while building, the blocks are hashed from their index
+uint32_t SyntheticProcess::random()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/*
+ * Same as a linux DF: GCC strings and RTTI
+ */
+
+void SyntheticProcess::readSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    read(address + vector_start, sizeof(triplet), (uint8_t *) &triplet);
+}
+
+void SyntheticProcess::writeSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    write(address + vector_start, sizeof(triplet), (uint8_t *) &triplet);
+}
+
+const std::string SyntheticProcess::readCString (uint32_t offset)
+{
+    std::string temp;
+    char r;
+    while ((r = Process::readByte(offset++)))
+        temp.append(1,r);
+    return temp;
+}
+
+size_t SyntheticProcess::readSTLString (uint32_t offset, char * buffer, size_t bufcapacity)
+{
+    uint32_t header[3];
+    offset = Process::readDWord(offset);
+    read(offset - sizeof(header), sizeof(header), (uint8_t *) header);
+    size_t read_real = min((size_t) header[0], bufcapacity - 1);
+    read(offset, read_real, (uint8_t *) buffer);
+    buffer[read_real] = 0;
+    return read_real;
+}
+
+const string SyntheticProcess::readSTLString (uint32_t offset)
+{
+    uint32_t header[3];
+    offset = Process::readDWord(offset);
+    read(offset - sizeof(header), sizeof(header), (uint8_t *) header);
+    string ret(header[0], 0);
+    if(header[0])
+        read(offset, header[0], (uint8_t *) &ret[0]);
+    return ret;
+}
+
+string SyntheticProcess::doReadClassName (uint32_t vptr)
+{
+    int typeinfo = Process::readDWord(vptr - 0x4);
+    int typestring = Process::readDWord(typeinfo + 0x4);
+    string raw = readCString(typestring);
+    size_t  start = raw.find_first_of("abcdefghijklmnopqrstuvwxyz");// trim numbers
+    size_t end = raw.length();
+    return raw.substr(start,end-start);
+}
@@ -0,0 +1,697 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Internal.h"
+#include "PlatformInternal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "ProcessFactory.h"
+#include "TraceFile.h"
+#include "dfhack/VersionInfo.h"
+#include "dfhack/DFError.h"
+using namespace DFHack;
+
+namespace {
+    /*
+     * Forwards everything to another Process and writes what it hands out and what it is
+     * given into a trace file. The SHM interface is hidden, so everything goes through
+     * plain memory access and ends up in the trace.
+     */
+    class TraceRecorder : public Process
+    {
+        private:
+            Process * inner;
+            FILE * f;
+            VersionInfo * my_descriptor;
+            bool owns_inner:1;
+            // memory ranges are recorded once per suspend
+            bool ranges_recorded:1;
+            void record(uint8_t type, uint32_t address, uint32_t length, const void * data);
+            void recordRanges(const vector<t_memrange> & ranges);
+        public:
+            TraceRecorder(Process * inner, FILE * f);
+            ~TraceRecorder();
+            void adopt() { owns_inner = true; };
+
+            bool attach() { return inner->attach(); };
+            bool detach() { return inner->detach(); };
+            bool suspend();
+            bool asyncSuspend();
+            bool resume();
+            bool forceresume();
+
+            void readQuad(const uint32_t address, uint64_t & value);
+            void writeQuad(const uint32_t address, const uint64_t value);
+            void readDWord(const uint32_t address, uint32_t & value);
+            void writeDWord(const uint32_t address, const uint32_t value);
+            void readFloat(const uint32_t address, float & value);
+            void readWord(const uint32_t address, uint16_t & value);
+            void writeWord(const uint32_t address, const uint16_t value);
+            void readByte(const uint32_t address, uint8_t & value);
+            void writeByte(const uint32_t address, const uint8_t value);
+
+            void read( uint32_t address, uint32_t length, uint8_t* buffer);
+            void write(uint32_t address, uint32_t length, uint8_t* buffer);
+            void readBatch(const t_readop * ops, size_t n);
+            bool readTolerant(uint32_t address, uint32_t length, uint8_t* buffer,
+                              std::vector<bool> & pages, uint8_t fill = 0xCC);
+
+            bool setReadCache(bool enable, uint32_t max_pages = 1024) { return inner->setReadCache(enable, max_pages); };
+            bool getReadCacheStats(uint64_t & hits, uint64_t & misses) { return inner->getReadCacheStats(hits, misses); };
+            bool setWriteBuffer(bool enable) { return inner->setWriteBuffer(enable); };
+            void commitWrites() { inner->commitWrites(); };
+
+            const std::string readSTLString (uint32_t offset);
+            size_t readSTLString (uint32_t offset, char * buffer, size_t bufcapacity);
+            size_t writeSTLString(const uint32_t address, const std::string writeString);
+            void readSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            void writeSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            std::string doReadClassName(uint32_t vptr);
+            const std::string readCString (uint32_t offset);
+
+            bool isSuspended() { return inner->isSuspended(); };
+            bool isAttached() { return inner->isAttached(); };
+            bool isIdentified() { return inner->isIdentified(); };
+
+            bool getThreadIDs(std::vector<uint32_t> & threads ) { return inner->getThreadIDs(threads); };
+            void getMemRanges(std::vector<t_memrange> & ranges );
+            const t_memrange * rangeOf(uint32_t address);
+            VersionInfo *getDescriptor() { return my_descriptor; };
+            int getPID() { return inner->getPID(); };
+            std::string getPath() { return inner->getPath(); };
+            bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) { OUTPUT = 0; return false; };
+            char * getSHMStart (void) { return 0; };
+            bool SetAndWait (uint32_t state) { return false; };
+    };
+
+    struct t_tracepage
+    {
+        enum { size = 4096 };
+        uint8_t data[size];
+        // non-zero for the bytes the trace has seen
+        uint8_t known[size];
+    };
+
+    /*
+     * Serves the calls recorded by a TraceRecorder. All the recorded memory is merged into
+     * one image, later records win. Anything the trace hasn't seen isn't readable.
+     */
+    class TraceReplay : public Process
+    {
+        private:
+            t_trace_header header;
+            VersionInfo * my_descriptor;
+            bool attached:1;
+            bool suspended:1;
+            bool identified:1;
+            map <uint32_t, t_tracepage *> image;
+            map <uint32_t, string> stl_strings;
+            map <uint32_t, string> c_strings;
+            map <uint32_t, string> classnames;
+            map <uint32_t, t_vecTriplet> vectors;
+            vector <t_memrange> memranges;
+            bool load(const string & path);
+            void apply(uint32_t address, uint32_t length, const uint8_t * data);
+        public:
+            TraceReplay(const string & path, VersionInfoFactory * factory);
+            ~TraceReplay();
+
+            bool attach() { attached = true; return true; };
+            bool detach() { attached = false; return true; };
+            bool suspend() { suspended = true; return true; };
+            bool asyncSuspend() { suspended = true; return true; };
+            bool resume() { suspended = false; return true; };
+            bool forceresume() { suspended = false; return true; };
+
+            void readQuad(const uint32_t address, uint64_t & value) { read(address, 8, (uint8_t *) &value); };
+            void writeQuad(const uint32_t address, const uint64_t value) { write(address, 8, (uint8_t *) &value); };
+            void readDWord(const uint32_t address, uint32_t & value) { read(address, 4, (uint8_t *) &value); };
+            void writeDWord(const uint32_t address, const uint32_t value) { write(address, 4, (uint8_t *) &value); };
+            void readFloat(const uint32_t address, float & value) { read(address, 4, (uint8_t *) &value); };
+            void readWord(const uint32_t address, uint16_t & value) { read(address, 2, (uint8_t *) &value); };
+            void writeWord(const uint32_t address, const uint16_t value) { write(address, 2, (uint8_t *) &value); };
+            void readByte(const uint32_t address, uint8_t & value) { read(address, 1, &value); };
+            void writeByte(const uint32_t address, const uint8_t value) { write(address, 1, (uint8_t *) &value); };
+
+            void read( uint32_t address, uint32_t length, uint8_t* buffer);
+            void write(uint32_t address, uint32_t length, uint8_t* buffer) { apply(address, length, buffer); };
+
+            const std::string readSTLString (uint32_t offset);
+            size_t readSTLString (uint32_t offset, char * buffer, size_t bufcapacity);
+            size_t writeSTLString(const uint32_t address, const std::string writeString);
+            void readSTLVector(const uint32_t address, t_vecTriplet & triplet);
+            void writeSTLVector(const uint32_t address, t_vecTriplet & triplet) { vectors[address] = triplet; };
+            std::string doReadClassName(uint32_t vptr);
+            const std::string readCString (uint32_t offset);
+
+            bool isSuspended() { return suspended; };
+            bool isAttached() { return attached; };
+            bool isIdentified() { return identified; };
+
+            bool getThreadIDs(std::vector<uint32_t> & threads ) { threads.clear(); return false; };
+            void getMemRanges(std::vector<t_memrange> & ranges );
+            const t_memrange * rangeOf(uint32_t address) { return rangeIndex.rangeOf(address); };
+            VersionInfo *getDescriptor() { return my_descriptor; };
+            int getPID() { return header.pid; };
+            std::string getPath() { return header.path; };
+            bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) { OUTPUT = 0; return false; };
+            char * getSHMStart (void) { return 0; };
+            bool SetAndWait (uint32_t state) { return false; };
+    };
+}
+
+Process* DFHack::createTraceRecorder(Process * inner, const string & path)
+{
+    FILE * f = fopen(path.c_str(), "wb");
+    if(!f)
+    {
+        cerr << "couldn't create trace " << path << endl;
+        return 0;
+    }
+    return new TraceRecorder(inner, f);
+}
+
+void DFHack::adoptTracedProcess(Process * recorder)
+{
+    ((TraceRecorder *) recorder)->adopt();
+}
+
+Process* DFHack::createTraceReplay(const string & path, VersionInfoFactory * factory)
+{
+    return new TraceReplay(path, factory);
+}
+
+TraceRecorder::TraceRecorder(Process * inner, FILE * f)
+{
+    this->inner = inner;
+    this->f = f;
+    owns_inner = false;
+    ranges_recorded = false;
+    my_descriptor = 0;
+    // traces tend to be big, don't flush all the time
+    setvbuf(f, 0, _IOFBF, 1024 * 1024);
+
+    t_trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.pid = inner->getPID();
+    strncpy(header.path, inner->getPath().c_str(), sizeof(header.path) - 1);
+    VersionInfo * vinfo = inner->getDescriptor();
+    if(vinfo)
+    {
+        string md5;
+        header.os = vinfo->getOS();
+        header.base = vinfo->getBase();
+        vinfo->getPE(header.pe);
+        if(vinfo->getMD5(md5))
+            strncpy(header.md5, md5.c_str(), sizeof(header.md5) - 1);
+        // class lookups of the modules have to come through us
+        my_descriptor = new VersionInfo(*vinfo);
+        my_descriptor->setParentProcess(this);
+    }
+    fwrite(&header, sizeof(header), 1, f);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    fclose(f);
+    if(my_descriptor)
+        delete my_descriptor;
+    if(owns_inner)
+        delete inner;
+}
+
+void TraceRecorder::record(uint8_t type, uint32_t address, uint32_t length, const void * data)
+{
+    uint8_t head[TRACE_RECORD_HEADER];
+    head[0] = type;
+    memcpy(head + 1, &address, 4);
+    memcpy(head + 5, &length, 4);
+    fwrite(head, TRACE_RECORD_HEADER, 1, f);
+    if(length)
+        fwrite(data, length, 1, f);
+}
+
+void TraceRecorder::recordRanges(const vector<t_memrange> & ranges)
+{
+    vector<uint8_t> data;
+    for(size_t i = 0; i < ranges.size(); i++)
+    {
+        const t_memrange & r = ranges[i];
+        uint32_t flags = (r.read ? TRACE_RANGE_READ : 0) | (r.write ? TRACE_RANGE_WRITE : 0)
+                       | (r.execute ? TRACE_RANGE_EXECUTE : 0) | (r.shared ? TRACE_RANGE_SHARED : 0);
+        uint32_t namelen = strlen(r.name);
+        size_t pos = data.size();
+        data.resize(pos + 24 + namelen);
+        memcpy(&data[pos], &r.start, 8);
+        memcpy(&data[pos + 8], &r.end, 8);
+        memcpy(&data[pos + 16], &flags, 4);
+        memcpy(&data[pos + 20], &namelen, 4);
+        memcpy(&data[pos + 24], r.name, namelen);
+    }
+    record(TRACE_MEMRANGES, ranges.size(), data.size(), data.empty() ? 0 : &data[0]);
+    ranges_recorded = true;
+}
+
+bool TraceRecorder::suspend()
+{
+    bool ret = inner->suspend();
+    record(TRACE_SUSPEND, 0, 0, 0);
+    return ret;
+}
+
+bool TraceRecorder::asyncSuspend()
+{
+    bool ret = inner->asyncSuspend();
+    record(TRACE_SUSPEND, 0, 0, 0);
+    return ret;
+}
+
+bool TraceRecorder::resume()
+{
+    record(TRACE_RESUME, 0, 0, 0);
+    ranges_recorded = false;
+    return inner->resume();
+}
+
+bool TraceRecorder::forceresume()
+{
+    record(TRACE_RESUME, 0, 0, 0);
+    ranges_recorded = false;
+    return inner->forceresume();
+}
+
+void TraceRecorder::readQuad(const uint32_t address, uint64_t & value)
+{
+    inner->readQuad(address, value);
+    record(TRACE_READ, address, sizeof(value), &value);
+}
+
+void TraceRecorder::writeQuad(const uint32_t address, const uint64_t value)
+{
+    record(TRACE_WRITE, address, sizeof(value), &value);
+    inner->writeQuad(address, value);
+}
+
+void TraceRecorder::readDWord(const uint32_t address, uint32_t & value)
+{
+    inner->readDWord(address, value);
+    record(TRACE_READ, address, sizeof(value), &value);
+}
+
+void TraceRecorder::writeDWord(const uint32_t address, const uint32_t value)
+{
+    record(TRACE_WRITE, address, sizeof(value), &value);
+    inner->writeDWord(address, value);
+}
+
+void TraceRecorder::readFloat(const uint32_t address, float & value)
+{
+    inner->readFloat(address, value);
+    record(TRACE_READ, address, sizeof(value), &value);
+}
+
+void TraceRecorder::readWord(const uint32_t address, uint16_t & value)
+{
+    inner->readWord(address, value);
+    record(TRACE_READ, address, sizeof(value), &value);
+}
+
+void TraceRecorder::writeWord(const uint32_t address, const uint16_t value)
+{
+    record(TRACE_WRITE, address, sizeof(value), &value);
+    inner->writeWord(address, value);
+}
+
+void TraceRecorder::readByte(const uint32_t address, uint8_t & value)
+{
+    inner->readByte(address, value);
+    record(TRACE_READ, address, sizeof(value), &value);
+}
+
+void TraceRecorder::writeByte(const uint32_t address, const uint8_t value)
+{
+    record(TRACE_WRITE, address, sizeof(value), &value);
+    inner->writeByte(address, value);
+}
+
+void TraceRecorder::read(uint32_t address, uint32_t length, uint8_t* buffer)
+{
+    inner->read(address, length, buffer);
+    record(TRACE_READ, address, length, buffer);
+}
+
+void TraceRecorder::write(uint32_t address, uint32_t length, uint8_t* buffer)
+{
+    record(TRACE_WRITE, address, length, buffer);
+    inner->write(address, length, buffer);
+}
+
+void TraceRecorder::readBatch(const t_readop * ops, size_t n)
+{
+    inner->readBatch(ops, n);
+    for(size_t i = 0; i < n; i++)
+        record(TRACE_READ, ops[i].address, ops[i].length, ops[i].buffer);
+}
+
+bool TraceRecorder::readTolerant(uint32_t address, uint32_t length, uint8_t* buffer, vector<bool> & pages, uint8_t fill)
+{
+    bool all = inner->readTolerant(address, length, buffer, pages, fill);
+    // only the good parts go into the trace
+    uint64_t first = address & ~(uint64_t)(tolerant_page - 1);
+    uint64_t end = (uint64_t) address + length;
+    size_t i = 0;
+    while (i < pages.size())
+    {
+        if(!pages[i])
+        {
+            i++;
+            continue;
+        }
+        size_t j = i;
+        while (j < pages.size() && pages[j])
+            j++;
+        uint64_t from = max((uint64_t) address, first + i * tolerant_page);
+        uint64_t to = min(end, first + j * tolerant_page);
+        record(TRACE_READ, from, to - from, buffer + (from - address));
+        i = j;
+    }
+    return all;
+}
+
+const string TraceRecorder::readSTLString (uint32_t offset)
+{
+    string s = inner->readSTLString(offset);
+    record(TRACE_STL_STRING, offset, s.size(), s.data());
+    return s;
+}
+
+size_t TraceRecorder::readSTLString (uint32_t offset, char * buffer, size_t bufcapacity)
+{
+    // record the whole string, a replay may ask for more of it
+    string s = readSTLString(offset);
+    size_t len = min(s.size(), bufcapacity - 1);
+    memcpy(buffer, s.data(), len);
+    buffer[len] = 0;
+    return len;
+}
+
+size_t TraceRecorder::writeSTLString(const uint32_t address, const string writeString)
+{
+    record(TRACE_WRITE_STL_STRING, address, writeString.size(), writeString.data());
+    return inner->writeSTLString(address, writeString);
+}
+
+void TraceRecorder::readSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    inner->readSTLVector(address, triplet);
+    record(TRACE_STL_VECTOR, address, sizeof(triplet), &triplet);
+}
+
+void TraceRecorder::writeSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    record(TRACE_WRITE_STL_VECTOR, address, sizeof(triplet), &triplet);
+    inner->writeSTLVector(address, triplet);
+}
+
+string TraceRecorder::doReadClassName(uint32_t vptr)
+{
+    string s = inner->readClassName(vptr);
+    record(TRACE_CLASSNAME, vptr, s.size(), s.data());
+    return s;
+}
+
+const string TraceRecorder::readCString (uint32_t offset)
+{
+    string s = inner->readCString(offset);
+    record(TRACE_C_STRING, offset, s.size(), s.data());
+    return s;
+}
+
+void TraceRecorder::getMemRanges(vector<t_memrange> & ranges)
+{
+    inner->getMemRanges(ranges);
+    recordRanges(ranges);
+}
+
+const t_memrange * TraceRecorder::rangeOf(uint32_t address)
+{
+    if(!ranges_recorded || !inner->isSuspended())
+    {
+        vector<t_memrange> ranges;
+        inner->getMemRanges(ranges);
+        recordRanges(ranges);
+    }
+    return inner->rangeOf(address);
+}
+
+TraceReplay::TraceReplay(const string & path, VersionInfoFactory * factory)
+{
+    my_descriptor = 0;
+    attached = false;
+    suspended = false;
+    identified = false;
+    memset(&header, 0, sizeof(header));
+
+    if(!load(path))
+        return;
+    rangeIndex.build(memranges);
+
+    // find out what version of DF this was
+    VersionInfo * vinfo = 0;
+    if(header.md5[0])
+        vinfo = factory->getVersionInfoByMD5(header.md5);
+    if(!vinfo && header.pe)
+        vinfo = factory->getVersionInfoByPETimestamp(header.pe);
+    if(!vinfo)
+        return;
+    my_descriptor = new VersionInfo(*vinfo);
+    if(my_descriptor->getOS() == OS_WINDOWS && header.base && header.base != my_descriptor->getBase())
+        my_descriptor->RebaseAll(header.base);
+    my_descriptor->setParentProcess(this);
+    identified = true;
+}
+
+TraceReplay::~TraceReplay()
+{
+    if(my_descriptor)
+        delete my_descriptor;
+    for(map<uint32_t, t_tracepage *>::iterator it = image.begin(); it != image.end(); ++it)
+        delete it->second;
+}
+
+bool TraceReplay::load(const string & path)
+{
+    FILE * f = fopen(path.c_str(), "rb");
+    if(!f)
+    {
+        cerr << "couldn't open trace " << path << endl;
+        return false;
+    }
+    if(fread(&header, sizeof(header), 1, f) != 1
+       || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+       || header.version != TRACE_VERSION)
+    {
+        cerr << path << " isn't a trace file this version of dfhack can read" << endl;
+        fclose(f);
+        return false;
+    }
+    header.path[sizeof(header.path) - 1] = 0;
+    header.md5[sizeof(header.md5) - 1] = 0;
+
+    uint8_t head[TRACE_RECORD_HEADER];
+    vector<uint8_t> data;
+    while (fread(head, TRACE_RECORD_HEADER, 1, f) == 1)
+    {
+        uint8_t type = head[0];
+        uint32_t address, length;
+        memcpy(&address, head + 1, 4);
+        memcpy(&length, head + 5, 4);
+        data.resize(length + 1);
+        if(length && fread(&data[0], length, 1, f) != 1)
+        {
+            cerr << "trace " << path << " is truncated" << endl;
+            break;
+        }
+        string s((const char *) &data[0], length);
+        switch(type)
+        {
+            case TRACE_READ:
+            case TRACE_WRITE:
+                apply(address, length, &data[0]);
+                break;
+            case TRACE_STL_STRING:
+            case TRACE_WRITE_STL_STRING:
+                stl_strings[address] = s;
+                break;
+            case TRACE_C_STRING:
+                c_strings[address] = s;
+                break;
+            case TRACE_CLASSNAME:
+                classnames[address] = s;
+                break;
+            case TRACE_STL_VECTOR:
+            case TRACE_WRITE_STL_VECTOR:
+                if(length == sizeof(t_vecTriplet))
+                    memcpy(&vectors[address], &data[0], sizeof(t_vecTriplet));
+                break;
+            case TRACE_MEMRANGES:
+            {
+                memranges.clear();
+                size_t pos = 0;
+                for(uint32_t i = 0; i < address && pos + 24 <= length; i++)
+                {
+                    t_memrange r;
+                    memset(&r, 0, sizeof(r));
+                    uint32_t flags, namelen;
+                    memcpy(&r.start, &data[pos], 8);
+                    memcpy(&r.end, &data[pos + 8], 8);
+                    memcpy(&flags, &data[pos + 16], 4);
+                    memcpy(&namelen, &data[pos + 20], 4);
+                    pos += 24;
+                    namelen = min(namelen, (uint32_t) (length - pos));
+                    memcpy(r.name, &data[pos], min(namelen, (uint32_t) sizeof(r.name) - 1));
+                    pos += namelen;
+                    r.read = flags & TRACE_RANGE_READ;
+                    r.write = flags & TRACE_RANGE_WRITE;
+                    r.execute = flags & TRACE_RANGE_EXECUTE;
+                    r.shared = flags & TRACE_RANGE_SHARED;
+                    r.valid = true;
+                    memranges.push_back(r);
+                }
+                break;
+            }
+            default:
+                // suspend/resume markers and things we don't know
+                break;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+void TraceReplay::apply(uint32_t address, uint32_t length, const uint8_t * data)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    while (pos < end)
+    {
+        uint32_t page = pos & ~(uint64_t)(t_tracepage::size - 1);
+        t_tracepage *& p = image[page];
+        if(!p)
+        {
+            p = new t_tracepage;
+            memset(p->known, 0, sizeof(p->known));
+        }
+        uint64_t chunk = min(end, (uint64_t) page + t_tracepage::size) - pos;
+        memcpy(p->data + (pos - page), data + (pos - address), chunk);
+        memset(p->known + (pos - page), 1, chunk);
+        pos += chunk;
+    }
+}
+
+void TraceReplay::read(uint32_t address, uint32_t length, uint8_t* buffer)
+{
+    uint64_t pos = address;
+    uint64_t end = pos + length;
+    while (pos < end)
+    {
+        uint32_t page = pos & ~(uint64_t)(t_tracepage::size - 1);
+        map<uint32_t, t_tracepage *>::iterator it = image.find(page);
+        if(it == image.end())
+            throw Error::MemoryAccessDenied(address);
+        t_tracepage * p = it->second;
+        uint64_t chunk = min(end, (uint64_t) page + t_tracepage::size) - pos;
+        if(memchr(p->known + (pos - page), 0, chunk))
+            throw Error::MemoryAccessDenied(address);
+        memcpy(buffer + (pos - address), p->data + (pos - page), chunk);
+        pos += chunk;
+    }
+}
+
+const string TraceReplay::readSTLString (uint32_t offset)
+{
+    map<uint32_t, string>::iterator it = stl_strings.find(offset);
+    if(it == stl_strings.end())
+        throw Error::MemoryAccessDenied(offset);
+    return it->second;
+}
+
+size_t TraceReplay::readSTLString (uint32_t offset, char * buffer, size_t bufcapacity)
+{
+    string s = readSTLString(offset);
+    size_t len = min(s.size(), bufcapacity - 1);
+    memcpy(buffer, s.data(), len);
+    buffer[len] = 0;
+    return len;
+}
+
+size_t TraceReplay::writeSTLString(const uint32_t address, const string writeString)
+{
+    stl_strings[address] = writeString;
+    return writeString.size();
+}
+
+void TraceReplay::readSTLVector(const uint32_t address, t_vecTriplet & triplet)
+{
+    map<uint32_t, t_vecTriplet>::iterator it = vectors.find(address);
+    if(it == vectors.end())
+        throw Error::MemoryAccessDenied(address);
+    triplet = it->second;
+}
+
+string TraceReplay::doReadClassName(uint32_t vptr)
+{
+    map<uint32_t, string>::iterator it = classnames.find(vptr);
+    if(it == classnames.end())
+        throw Error::MemoryAccessDenied(vptr);
+    return it->second;
+}
+
+const string TraceReplay::readCString (uint32_t offset)
+{
+    map<uint32_t, string>::iterator it = c_strings.find(offset);
+    if(it != c_strings.end())
+        return it->second;
+    // maybe it was read as plain memory
+    string temp;
+    char r;
+    while ((r = Process::readByte(offset++)))
+        temp.append(1,r);
+    return temp;
+}
+
+void TraceReplay::getMemRanges( vector<t_memrange> & ranges )
+{
+    ranges.insert(ranges.end(), memranges.begin(), memranges.end());
+}
@@ -46,18 +46,33 @@ SHMProcess::Private::Private(SHMProcess * self_)
     locked = false;
     identified = false;
     useYield = 0;
+    useFutex = false;
+    spin = SHM_SPIN_START;
+    slots = 1;
     DFSVMutex = 0;
     DFCLMutex = 0;
     DFCLSuspendMutex = 0;
     self = self_;
 }
 
-bool SHMProcess::Private::SetAndWait (uint32_t state)
+void SHMProcess::Private::ServerDisappeared()
+{
+    UnmapViewOfFile(shm_addr);
+    FreeLocks();
+    attached = locked = identified = false;
+    // we aren't the current process anymore
+    throw Error::SHMServerDisappeared();
+}
+
+void SHMProcess::Private::Post (uint32_t state)
 {
-    uint32_t cnt = 0;
-    if(!attached) return false;
     SHMCMD = state;
+    SHM_ring(SLEEPERS);
+}
 
+bool SHMProcess::Private::Wait (uint32_t state)
+{
+    uint32_t cnt = 0;
     while (SHMCMD == state)
     {
         // yield the CPU, only on single-core CPUs
@@ -69,11 +84,7 @@ bool SHMProcess::Private::SetAndWait (uint32_t state)
         {
             if(!AreLocksOk())// DF not there anymore?
             {
-                UnmapViewOfFile(shm_addr);
-                FreeLocks();
-                attached = locked = identified = false;
-                // we aren't the current process anymore
-                throw Error::SHMServerDisappeared();
+                ServerDisappeared();
             }
             else
             {
@@ -90,6 +101,13 @@ bool SHMProcess::Private::SetAndWait (uint32_t state)
     return true;
 }
 
+bool SHMProcess::Private::SetAndWait (uint32_t state)
+{
+    if(!attached) return false;
+    Post(state);
+    return Wait(state);
+}
+
 bool SHMProcess::SetAndWait (uint32_t state)
 {
     return d->SetAndWait(state);
@@ -424,5 +442,5 @@ char * SHMProcess::getSHMStart (void)
 {
     if(!d->locked) throw Error::MemoryAccessDenied(0xdeadbeef);
 
-    return d->shm_addr;
+    return SHM_LANE(d->shm_addr, d->attachmentIdx);
 }
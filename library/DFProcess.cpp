@@ -0,0 +1,166 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include "Internal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include "dfhack/DFProcess.h"
+#include "dfhack/DFError.h"
+using namespace DFHack;
+
+uint32_t Process::gatherVector(uint32_t address, int32_t offset, uint32_t length, vector<uint8_t> & out)
+{
+    t_vecTriplet triplet;
+    readSTLVector(address, triplet);
+    uint32_t count = (triplet.end - triplet.start) / sizeof(uint32_t);
+    out.assign(count * length, 0);
+    if(!count || !length)
+        return count;
+    vector<uint32_t> pointers(count);
+    read(triplet.start, count * sizeof(uint32_t), (uint8_t *) &pointers[0]);
+    vector<t_readop> ops;
+    ops.reserve(count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(!pointers[i])
+            continue;
+        t_readop op = {pointers[i] + offset, length, &out[i * length]};
+        ops.push_back(op);
+    }
+    if(!ops.empty())
+        readBatchMerged(&ops[0], ops.size());
+    return count;
+}
+
+namespace
+{
+    struct opAddressLess
+    {
+        const t_readop * ops;
+        bool operator() (size_t a, size_t b) const
+        {
+            return ops[a].address < ops[b].address;
+        }
+    };
+}
+
+/*
+ * Sort the areas by address and grow a span as long as the next area starts
+ * less than max_gap bytes after its end. The spans are read into one buffer as a batch,
+ * then every area gets its part.
+ */
+void Process::readBatchMerged(const t_readop * ops, size_t n, uint32_t max_gap)
+{
+    if(!n)
+        return;
+    vector<size_t> order(n);
+    for(size_t i = 0; i < n; i++)
+        order[i] = i;
+    opAddressLess less = {ops};
+    sort(order.begin(), order.end(), less);
+    vector<t_readop> spans;
+    // where every area is in the buffer
+    vector<size_t> position(n);
+    size_t total = 0;
+    uint64_t span_end = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        const t_readop & op = ops[order[i]];
+        if(spans.empty() || op.address >= span_end + max_gap)
+        {
+            t_readop s = {op.address, 0, 0};
+            spans.push_back(s);
+            span_end = op.address;
+        }
+        t_readop & s = spans.back();
+        span_end = max(span_end, (uint64_t) op.address + op.length);
+        total += (span_end - s.address) - s.length;
+        s.length = span_end - s.address;
+        position[order[i]] = total - s.length + (op.address - s.address);
+    }
+    if(!total)
+        return;
+    // nothing to merge
+    if(spans.size() == n)
+    {
+        readBatch(ops, n);
+        return;
+    }
+    vector<uint8_t> buffer(total);
+    size_t pos = 0;
+    for(size_t i = 0; i < spans.size(); i++)
+    {
+        spans[i].buffer = &buffer[pos];
+        pos += spans[i].length;
+    }
+    readBatch(&spans[0], spans.size());
+    for(size_t i = 0; i < n; i++)
+        memcpy(ops[i].buffer, &buffer[position[i]], ops[i].length);
+}
+
+/*
+ * Try the whole thing first, bad memory is rare. If it fails, go page by page.
+ * Processes that can read without throwing should override this.
+ */
+bool Process::readTolerant(uint32_t address, uint32_t length, uint8_t* buffer, vector<bool> & pages, uint8_t fill)
+{
+    uint64_t first = address & ~(uint64_t)(tolerant_page - 1);
+    uint64_t end = (uint64_t) address + length;
+    pages.assign((end - first + tolerant_page - 1) / tolerant_page, true);
+    if(length == 0)
+        return true;
+    try
+    {
+        read(address, length, buffer);
+        return true;
+    }
+    catch(Error::MemoryAccessDenied &)
+    {
+    }
+    bool all = true;
+    uint64_t pos = address;
+    for(size_t i = 0; i < pages.size(); i++)
+    {
+        uint64_t chunk = min(end, first + (i + 1) * tolerant_page) - pos;
+        try
+        {
+            read(pos, chunk, buffer + (pos - address));
+        }
+        catch(Error::MemoryAccessDenied &)
+        {
+            memset(buffer + (pos - address), fill, chunk);
+            pages[i] = false;
+            all = false;
+        }
+        pos += chunk;
+    }
+    return all;
+}
@@ -0,0 +1,172 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include "Internal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include "GatherPlan.h"
+#include "dfhack/DFProcess.h"
+#include "dfhack/VersionInfo.h"
+using namespace DFHack;
+
+const size_t GatherPlan::no_dest;
+
+GatherPlan::GatherPlan(uint32_t max_gap)
+{
+    this->max_gap = max_gap;
+    stride = 0;
+    planned = false;
+}
+
+size_t GatherPlan::add(int32_t offset, uint32_t size, size_t dest)
+{
+    t_field f = {offset, size, dest, 0};
+    fields.push_back(f);
+    planned = false;
+    return fields.size() - 1;
+}
+
+size_t GatherPlan::add(OffsetGroup * group, const char * name, uint32_t size, size_t dest)
+{
+    return add(group->getOffset(name), size, dest);
+}
+
+void GatherPlan::setMaxGap(uint32_t max_gap)
+{
+    this->max_gap = max_gap;
+    planned = false;
+}
+
+size_t GatherPlan::numSpans()
+{
+    if(!planned)
+        plan();
+    return spans.size();
+}
+
+/*
+ * Walk the fields by offset and grow the current span as long as the next field
+ * starts within max_gap bytes of its end.
+ */
+void GatherPlan::plan()
+{
+    spans.clear();
+    stride = 0;
+    // (offset, index) pairs, sorted by offset
+    vector< pair<int32_t, size_t> > order(fields.size());
+    for(size_t i = 0; i < order.size(); i++)
+        order[i] = make_pair(fields[i].offset, i);
+    sort(order.begin(), order.end());
+    int64_t span_end = 0;
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        t_field & f = fields[order[i].second];
+        if(spans.empty() || f.offset > span_end + max_gap)
+        {
+            t_span s = {f.offset, 0, stride};
+            spans.push_back(s);
+            span_end = f.offset;
+        }
+        t_span & s = spans.back();
+        span_end = max(span_end, (int64_t) f.offset + f.size);
+        stride += (span_end - s.offset) - s.size;
+        s.size = span_end - s.offset;
+        f.position = s.position + (f.offset - s.offset);
+    }
+    planned = true;
+}
+
+void GatherPlan::read(Process * p, uint32_t base, void * out)
+{
+    read(p, &base, 1, out, 0);
+}
+
+bool GatherPlan::prepare(const uint32_t * bases, size_t count, vector<t_readop> & ops)
+{
+    if(!planned)
+        plan();
+    data.resize(stride * count);
+    if(!stride || !count)
+        return false;
+    ops.resize(spans.size() * count);
+    size_t n = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        for(size_t j = 0; j < spans.size(); j++)
+        {
+            t_readop & op = ops[n++];
+            op.address = bases[i] + spans[j].offset;
+            op.length = spans[j].size;
+            op.buffer = &data[i * stride + spans[j].position];
+        }
+    }
+    return true;
+}
+
+void GatherPlan::scatter(size_t count, void * out, size_t out_stride)
+{
+    if(!out)
+        return;
+    for(size_t i = 0; i < count; i++)
+    {
+        uint8_t * target = (uint8_t *) out + i * out_stride;
+        for(size_t j = 0; j < fields.size(); j++)
+        {
+            const t_field & f = fields[j];
+            if(f.dest != no_dest)
+                memcpy(target + f.dest, &data[i * stride + f.position], f.size);
+        }
+    }
+}
+
+void GatherPlan::read(Process * p, const uint32_t * bases, size_t count, void * out, size_t out_stride)
+{
+    vector<t_readop> ops;
+    if(!prepare(bases, count, ops))
+        return;
+    // objects tend to be close to each other, so are their spans
+    p->readBatchMerged(&ops[0], ops.size());
+    scatter(count, out, out_stride);
+}
+
+void GatherPlan::read(ProcessReader * r, const uint32_t * bases, size_t count, void * out, size_t out_stride)
+{
+    vector<t_readop> ops;
+    if(!prepare(bases, count, ops))
+        return;
+    r->readBatch(&ops[0], ops.size());
+    scatter(count, out, out_stride);
+}
+
+const uint8_t * GatherPlan::field(size_t object, size_t index) const
+{
+    return &data[object * stride + fields[index].position];
+}
@@ -0,0 +1,62 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Internal.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#include "dfhack/DFProcess.h"
+using namespace DFHack;
+
+static bool startsBefore(const t_memrange & a, const t_memrange & b)
+{
+    return a.start < b.start;
+}
+
+static bool addressBefore(uint64_t address, const t_memrange & r)
+{
+    return address < r.start;
+}
+
+void MemRangeIndex::build(const vector<t_memrange> & ranges)
+{
+    this->ranges = ranges;
+    sort(this->ranges.begin(), this->ranges.end(), startsBefore);
+}
+
+const t_memrange * MemRangeIndex::rangeOf(uint64_t address) const
+{
+    // first range starting after address, the one before it is our candidate
+    vector<t_memrange>::const_iterator it = upper_bound(ranges.begin(), ranges.end(), address, addressBefore);
+    if(it == ranges.begin())
+        return 0;
+    --it;
+    if(address < it->end)
+        return &(*it);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Internal.h"
+
+#include <string>
+#include <cstring>
+#include <list>
+#include <map>
+using namespace std;
+
+#include "PageCache.h"
+using namespace DFHack;
+
+PageCache::PageCache(uint32_t max_pages)
+{
+    hits = misses = 0;
+    // a cache that can't hold one page is useless
+    this->max_pages = max_pages ? max_pages : 1;
+}
+
+PageCache::~PageCache()
+{
+    clear();
+}
+
+uint8_t * PageCache::find(uint32_t page)
+{
+    uint8_t * data = peek(page);
+    if(data)
+        hits++;
+    return data;
+}
+
+uint8_t * PageCache::peek(uint32_t page)
+{
+    page_map::iterator it = pages.find(page);
+    if(it == pages.end())
+        return 0;
+    // move to the front of the LRU list
+    lru.splice(lru.begin(), lru, it->second.lru);
+    return it->second.data;
+}
+
+uint8_t * PageCache::insert(uint32_t page)
+{
+    page_map::iterator it = pages.find(page);
+    if(it != pages.end())
+    {
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return it->second.data;
+    }
+    misses++;
+    uint8_t * data;
+    if(pages.size() >= max_pages)
+    {
+        // recycle the least recently used page
+        page_map::iterator victim = pages.find(lru.back());
+        data = victim->second.data;
+        pages.erase(victim);
+        lru.pop_back();
+    }
+    else
+    {
+        data = new uint8_t[page_size];
+    }
+    lru.push_front(page);
+    t_page & p = pages[page];
+    p.data = data;
+    p.lru = lru.begin();
+    return data;
+}
+
+void PageCache::erase(uint32_t page)
+{
+    page_map::iterator it = pages.find(page);
+    if(it == pages.end())
+        return;
+    delete [] it->second.data;
+    lru.erase(it->second.lru);
+    pages.erase(it);
+}
+
+void PageCache::clear()
+{
+    for(page_map::iterator it = pages.begin(); it != pages.end(); ++it)
+        delete [] it->second.data;
+    pages.clear();
+    lru.clear();
+}
+
+void PageCache::write(uint32_t address, uint32_t length, const uint8_t * source)
+{
+    if(pages.empty())
+        return;
+    uint64_t end = (uint64_t) address + length;
+    uint64_t pos = address;
+    while (pos < end)
+    {
+        uint32_t page = (uint32_t) pos & page_mask;
+        uint64_t chunk = min(end, (uint64_t) page + page_size) - pos;
+        page_map::iterator it = pages.find(page);
+        if(it != pages.end())
+            memcpy(it->second.data + (pos - page), source + (pos - address), chunk);
+        pos += chunk;
+    }
+}
+
+void PageCache::setCapacity(uint32_t max_pages)
+{
+    this->max_pages = max_pages ? max_pages : 1;
+    while (pages.size() > this->max_pages)
+        erase(lru.back());
+}
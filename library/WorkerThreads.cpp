@@ -0,0 +1,99 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include "Internal.h"
+#include "PlatformInternal.h"
+
+#include <vector>
+using namespace std;
+
+#include "WorkerThreads.h"
+#ifdef LINUX_BUILD
+    #include <pthread.h>
+#endif
+using namespace DFHack;
+
+namespace {
+    struct t_worker
+    {
+        WorkerTask * task;
+        uint32_t index;
+        bool started;
+#ifdef LINUX_BUILD
+        pthread_t thread;
+#else
+        HANDLE thread;
+#endif
+    };
+#ifdef LINUX_BUILD
+    void * workerMain(void * arg)
+    {
+        t_worker * w = (t_worker *) arg;
+        w->task->run(w->index);
+        return 0;
+    }
+#else
+    DWORD WINAPI workerMain(LPVOID arg)
+    {
+        t_worker * w = (t_worker *) arg;
+        w->task->run(w->index);
+        return 0;
+    }
+#endif
+}
+
+void DFHack::runWorkers(WorkerTask & task, uint32_t count)
+{
+    vector <t_worker> workers(count);
+    for(uint32_t i = 1; i < count; i++)
+    {
+        t_worker & w = workers[i];
+        w.task = &task;
+        w.index = i;
+#ifdef LINUX_BUILD
+        w.started = pthread_create(&w.thread, 0, workerMain, &w) == 0;
+#else
+        w.thread = CreateThread(0, 0, workerMain, &w, 0, 0);
+        w.started = w.thread != 0;
+#endif
+    }
+    if(count)
+        task.run(0);
+    for(uint32_t i = 1; i < count; i++)
+    {
+        t_worker & w = workers[i];
+        if(!w.started)
+        {
+            task.run(i);
+            continue;
+        }
+#ifdef LINUX_BUILD
+        pthread_join(w.thread, 0);
+#else
+        WaitForSingleObject(w.thread, INFINITE);
+        CloseHandle(w.thread);
+#endif
+    }
+}
@@ -0,0 +1,91 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Internal.h"
+
+#include <cstring>
+#include <map>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include "WriteBuffer.h"
+using namespace DFHack;
+
+void WriteBuffer::add(uint32_t address, uint32_t length, const uint8_t * source)
+{
+    if(length == 0)
+        return;
+    uint64_t start = address;
+    uint64_t end = start + length;
+    // the span before us may touch or overlap
+    span_map::iterator first = spans.upper_bound(address);
+    if(first != spans.begin())
+    {
+        span_map::iterator prev = first;
+        --prev;
+        if(prev->first + (uint64_t) prev->second.size() >= start)
+            first = prev;
+    }
+    // find everything we touch
+    span_map::iterator last = first;
+    while (last != spans.end() && last->first <= end)
+    {
+        start = min(start, (uint64_t) last->first);
+        end = max(end, last->first + (uint64_t) last->second.size());
+        ++last;
+    }
+    // nothing to merge with, and no reason to copy things around
+    if(first == last)
+    {
+        spans[address].assign(source, source + length);
+        return;
+    }
+    vector<uint8_t> merged(end - start);
+    for(span_map::iterator it = first; it != last; ++it)
+        memcpy(&merged[it->first - start], &it->second[0], it->second.size());
+    memcpy(&merged[address - start], source, length);
+    spans.erase(first, last);
+    spans[(uint32_t) start].swap(merged);
+}
+
+void WriteBuffer::overlay(uint32_t address, uint32_t length, uint8_t * target)
+{
+    if(spans.empty() || length == 0)
+        return;
+    uint64_t start = address;
+    uint64_t end = start + length;
+    span_map::iterator it = spans.upper_bound(address);
+    if(it != spans.begin())
+        --it;
+    for(; it != spans.end() && it->first < end; ++it)
+    {
+        uint64_t s_start = it->first;
+        uint64_t s_end = s_start + it->second.size();
+        uint64_t from = max(start, s_start);
+        uint64_t to = min(end, s_end);
+        if(from < to)
+            memcpy(target + (from - start), &it->second[from - s_start], to - from);
+    }
+}
@@ -61,6 +61,7 @@ public:
     int optind;
     int opterr;
     int optopt;
+    char* optarg;
     
     int operator()()
     {
@@ -210,7 +211,6 @@ private:
     int argc;
     char ** argv;
     const char * optstr;
-    char* optarg;
 
     void increment_index()
     {
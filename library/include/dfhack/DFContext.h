@@ -28,6 +28,7 @@ distribution.
 #define CONTEXT_H_INCLUDED
 
 #include "DFExport.h"
+#include <string>
 namespace DFHack
 {
     class Creatures;
@@ -84,6 +85,15 @@ namespace DFHack
         void ReadRaw (const uint32_t offset, const uint32_t size, uint8_t *target);
         void WriteRaw (const uint32_t offset, const uint32_t size, uint8_t *source);
 
+        /**
+         * save all the memory of the suspended process into a file.
+         * the file can be opened later by ContextManager::OpenSnapshot
+         * @param parent an earlier snapshot. if given, only the pages that changed since then are saved
+         *        and the parent has to stay around to open the new snapshot.
+         * @return false if the snapshot couldn't be written
+         */
+        bool WriteSnapshot (const std::string & path, const std::string & parent = "");
+
         /// get the creatures module
         Creatures * getCreatures();
 
@@ -39,6 +39,28 @@ namespace DFHack
     class Context;
     class BadContexts;
     class Process;
+    /**
+     * Shape of a synthetic DF memory image
+     * @see ContextManager::OpenSynthetic
+     * \ingroup grp_context
+     */
+    struct DFHACK_EXPORT t_synthetic_params
+    {
+        t_synthetic_params()
+            : x_blocks(6), y_blocks(6), z_blocks(20), creatures(100), items(2000), buildings(50), seed(1) {};
+        /// map size in 16x16x1 blocks, up to 48x48 horizontally
+        uint32_t x_blocks;
+        uint32_t y_blocks;
+        uint32_t z_blocks;
+        /// population counts
+        uint32_t creatures;
+        uint32_t items;
+        uint32_t buildings;
+        /// the same seed always gives the same image
+        uint32_t seed;
+        /// name or md5 of a linux Memory.xml entry, empty for the newest one
+        std::string version;
+    };
     /**
      * Used to enumerate, create and destroy Contexts. The very base of DFHack.
      * @see DFHack::Context
@@ -87,6 +109,58 @@ namespace DFHack
         */
         Context * getSingleContext();
 
+        /**
+        * Open a memory snapshot created by Context::WriteSnapshot.
+        * The new Context is tracked along with the others and survives Refresh.
+        * @param path path to the snapshot file
+        * @return pointer to a Context. 0 if the file couldn't be opened or the DF version isn't known.
+        */
+        Context * OpenSnapshot(const std::string & path);
+
+        /**
+        * Record everything read from and written to the processes of Contexts created from now on.
+        * The DFHACK_TRACE environment variable does the same for any tool.
+        * With more than one process, the other trace files get the PID appended to the name.
+        * @param path path to the trace file. empty to stop tracing new Contexts
+        */
+        void setTraceFile(const std::string & path);
+
+        /**
+        * Make Refresh serve a recorded trace instead of the running DF processes.
+        * The DFHACK_REPLAY environment variable does the same for any tool.
+        * @param path path to a trace file recorded by setTraceFile. empty to use live processes again
+        */
+        void setReplayFile(const std::string & path);
+
+        /**
+        * Open a trace file recorded by setTraceFile. Reads are served from the recorded data.
+        * The new Context is tracked along with the others and survives Refresh.
+        * @param path path to the trace file
+        * @return pointer to a Context. 0 if the file couldn't be opened or the DF version isn't known.
+        */
+        Context * OpenTrace(const std::string & path);
+
+        /**
+        * Create a fake DF process with a generated map, creatures, items and buildings.
+        * Everything is laid out like a linux DF would, using the offsets from Memory.xml.
+        * Setting the DFHACK_SYNTHETIC environment variable to XxYxZ[,creatures[,items[,buildings]]]
+        * makes Refresh serve one instead of the running DF processes.
+        * The new Context is tracked along with the others and survives Refresh.
+        * @param params map size and population
+        * @return pointer to a Context. 0 if the image couldn't be built for the requested version.
+        */
+        Context * OpenSynthetic(const t_synthetic_params & params);
+
+        /**
+        * Connect to the SHM server of the process with the given PID.
+        * Unlike the other Contexts, this one is returned even if the DF version isn't known,
+        * so the bridge itself can be used with a stand-in server. Modules need a known version.
+        * The new Context is tracked along with the others and survives Refresh.
+        * @param pid PID of the process running the SHM server
+        * @return pointer to a Context. 0 if there's no usable SHM server.
+        */
+        Context * OpenSHM(uint32_t pid);
+
         /**
         * Destroy all tracked Context objects
         * Normally called during object destruction. Calling this from outside ContextManager is nasty.
@@ -31,6 +31,7 @@ distribution.
 #include "DFExport.h"
 #include <iostream>
 #include <map>
+#include <vector>
 
 namespace DFHack
 {
@@ -88,12 +89,85 @@ namespace DFHack
         bool valid;
         uint8_t * buffer;
     };
+    /**
+     * Structure describing one element of a scatter/gather read
+     * @see Process::readBatch
+     * \ingroup grp_context
+     */
+    struct t_readop
+    {
+        uint32_t address;
+        uint32_t length;
+        uint8_t * buffer;
+    };
+    /**
+     * Sorted copy of memory ranges for O(log n) address lookups
+     * @see Process::rangeOf
+     * \ingroup grp_context
+     */
+    class DFHACK_EXPORT MemRangeIndex
+    {
+        public:
+            /// replace the indexed ranges
+            void build(const std::vector<t_memrange> & ranges);
+            /// @return the range containing address, 0 if there's none
+            const t_memrange * rangeOf(uint64_t address) const;
+        private:
+            std::vector<t_memrange> ranges;
+    };
+    /**
+     * what Process::scan looks for
+     * \ingroup grp_context
+     */
+    enum e_scankind
+    {
+        /// the bytes of the needle
+        SCAN_BYTES,
+        /// an integer of 1, 2 or 4 bytes
+        SCAN_INT,
+        /// a vector triplet with the given length in bytes, or any sane one with SCAN_ANY_LENGTH
+        SCAN_VECTOR,
+        /// a pointer to a zero terminated copy of the needle
+        SCAN_STRING
+    };
+    /// any vector, for SCAN_VECTOR
+    const uint64_t SCAN_ANY_LENGTH = (uint64_t) -1;
+    /**
+     * a query for Process::scan and Process::filter
+     * \ingroup grp_context
+     */
+    struct t_scanquery
+    {
+        e_scankind kind;
+        /// alignment of the matches
+        uint32_t increment;
+        /// SCAN_INT: size of the integer
+        uint32_t size;
+        /// SCAN_INT: the integer. SCAN_VECTOR: length of the vector in bytes or SCAN_ANY_LENGTH
+        uint64_t value;
+        /// SCAN_BYTES: the pattern. SCAN_STRING: the string
+        std::string needle;
+    };
     struct t_vecTriplet
     {
         uint32_t start;
         uint32_t end;
         uint32_t alloc_end;
     };
+    /**
+     * Reads the memory of a process from another thread. Has its own handle on the process
+     * and doesn't share the read cache, the write buffer or anything else with the Process
+     * it came from, so every thread can have one.
+     * @see Process::createReader
+     * \ingroup grp_context
+     */
+    class DFHACK_EXPORT ProcessReader
+    {
+        public:
+            virtual ~ProcessReader(){};
+            /// like Process::readBatch, throws Error::MemoryAccessDenied the same way
+            virtual void readBatch(const t_readop * ops, size_t n) = 0;
+    };
 
     /**
      * Allows low-level access to the memory of an OS process. OS processes can be enumerated by \ref ProcessEnumerator
@@ -103,6 +177,7 @@ namespace DFHack
     {
         protected:
             std::map<uint32_t, std::string> classNameCache;
+            MemRangeIndex rangeIndex;
 
         public:
             /// this is the single most important destructor ever. ~px
@@ -161,6 +236,78 @@ namespace DFHack
             virtual void read( uint32_t address, uint32_t length, uint8_t* buffer) = 0;
             /// write an arbitrary amount of bytes
             virtual void write(uint32_t address, uint32_t length, uint8_t* buffer) = 0;
+            /**
+             * read a batch of arbitrary memory areas in one go
+             * throws Error::MemoryAccessDenied like read() when an area can't be read.
+             * the default implementation issues one read per element
+             */
+            virtual void readBatch(const t_readop * ops, size_t n)
+            {
+                for(size_t i = 0; i < n; i++)
+                    read(ops[i].address, ops[i].length, ops[i].buffer);
+            }
+            /**
+             * like readBatch, but areas close to each other are read together, by one read covering them.
+             * areas are merged when the gap between them is smaller than max_gap. with the default
+             * of a page, no page gets read that none of the areas touch.
+             */
+            void readBatchMerged(const t_readop * ops, size_t n, uint32_t max_gap = 4096);
+            /**
+             * for every pointer in the vector at address, read length bytes at pointer + offset.
+             * the results are packed into out, length bytes apart. null pointers give zeros.
+             * the default implementation reads the vector and does one readBatchMerged
+             * @return number of elements in the vector
+             */
+            virtual uint32_t gatherVector(uint32_t address, int32_t offset, uint32_t length, std::vector<uint8_t> & out);
+            /**
+             * get a reader that can be used from another thread while this Process is in use.
+             * @return a new reader, to be deleted by the caller. 0 if this process can't be read from
+             * other threads, or not right now because a reader wouldn't see the buffered writes
+             */
+            virtual ProcessReader * createReader() { return 0; };
+            /**
+             * search the ranges inside the process, without copying them out. only the
+             * addresses of the matches come back.
+             * @return false if this process can't do that, found is left alone then
+             */
+            virtual bool scan(const std::vector<t_memrange> & ranges, const t_scanquery & query, std::vector<uint64_t> & found) { return false; };
+            /**
+             * keep only the addresses in found that still match the query, checked inside the process
+             * @return false if this process can't do that, found is left alone then
+             */
+            virtual bool filter(const std::vector<t_memrange> & ranges, const t_scanquery & query, std::vector<uint64_t> & found) { return false; };
+            /// granularity of readTolerant
+            enum { tolerant_page = 4096 };
+            /**
+             * read an arbitrary amount of bytes, skipping over what can't be read. never throws.
+             * pages[i] tells if the i-th 4 KiB page touched by the read (counting from the page
+             * containing address) was read. the parts of the buffer that belong to bad pages
+             * are filled with the fill byte.
+             * @return true if everything was read
+             */
+            virtual bool readTolerant(uint32_t address, uint32_t length, uint8_t* buffer,
+                                      std::vector<bool> & pages, uint8_t fill = 0xCC);
+            /**
+             * enable or disable caching of memory pages read from the process.
+             * the cache is only used while the process is suspended and is dropped on resume.
+             * @return false if caching isn't supported by this process type
+             */
+            virtual bool setReadCache(bool enable, uint32_t max_pages = 1024) { return false; };
+            /**
+             * get the read cache counters. hits are page lookups served from the cache,
+             * misses are pages that had to be fetched from the process.
+             * @return false if there is no read cache
+             */
+            virtual bool getReadCacheStats(uint64_t & hits, uint64_t & misses) { return false; };
+            /**
+             * enable or disable buffering of writes. buffered writes are merged and sent to DF
+             * in one go by commitWrites(), resume() or detach(). reads see the buffered data.
+             * disabling the buffer commits the pending writes.
+             * @return false if write buffering isn't supported by this process type
+             */
+            virtual bool setWriteBuffer(bool enable) { return false; };
+            /// send all buffered writes to DF
+            virtual void commitWrites() {};
 
             /// read an STL string
             virtual const std::string readSTLString (uint32_t offset) = 0;
@@ -205,11 +352,45 @@ namespace DFHack
             virtual bool isIdentified() = 0;
             /// @return true if this is a Process snapshot
             virtual bool isSnapshot() { return false; };
+            /**
+             * get the start addresses of memory pages that differ between two snapshots
+             * @return false unless both this and other are snapshots
+             */
+            virtual bool getChangedPages(Process * other, std::vector<uint32_t> & pages) { return false; };
 
             /// find the thread IDs of the process
             virtual bool getThreadIDs(std::vector<uint32_t> & threads ) = 0;
             /// get virtual memory ranges of the process (what is mapped where)
             virtual void getMemRanges(std::vector<t_memrange> & ranges ) = 0;
+            /**
+             * get the memory range containing an address.
+             * the default implementation asks getMemRanges every time, processes that can tell
+             * when their memory map changes keep the index around.
+             * @return the range, valid until the next call. 0 if the address isn't mapped
+             */
+            virtual const t_memrange * rangeOf(uint32_t address)
+            {
+                std::vector<t_memrange> ranges;
+                getMemRanges(ranges);
+                rangeIndex.build(ranges);
+                return rangeIndex.rangeOf(address);
+            }
+            /// @return true if the whole area is in readable memory ranges
+            bool isReadable(uint32_t address, uint32_t length)
+            {
+                uint64_t pos = address;
+                uint64_t end = pos + length;
+                if(end > 0x100000000ULL)
+                    return false;
+                do
+                {
+                    const t_memrange * r = rangeOf(pos);
+                    if(!r || !r->read)
+                        return false;
+                    pos = r->end;
+                } while (pos < end);
+                return true;
+            }
 
             /// get the flattened Memory.xml entry of this process
             virtual VersionInfo *getDescriptor() = 0;
@@ -219,7 +400,7 @@ namespace DFHack
             virtual std::string getPath() = 0;
             /// get module index by name and version. bool 1 = error
             virtual bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) = 0;
-            /// get the SHM start if available
+            /// get the start of the SHM lane (header + data window) of this client if available
             virtual char * getSHMStart (void) = 0;
             /// set a SHM command and wait for a response, return 0 on error or throw exception
             virtual bool SetAndWait (uint32_t state) = 0;
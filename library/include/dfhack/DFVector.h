@@ -33,9 +33,102 @@ distribution.
 #include "DFProcess.h"
 
 #include <string.h>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+#include <vector>
 
 namespace DFHack
 {
+    /**
+     * Where a DfVector keeps its copy of the data. This one goes to the heap every time.
+     */
+    template <class T>
+    class DfVectorAllocator
+    {
+        public:
+            virtual ~DfVectorAllocator(){};
+            // room for at least count elements, capacity says how many fit
+            virtual T * allocate(uint32_t count, uint32_t & capacity)
+            {
+                capacity = count;
+                return new T[count];
+            };
+            virtual void release(T * data, uint32_t capacity)
+            {
+                delete [] data;
+            };
+    };
+
+    /**
+     * Keeps released buffers and hands them out again, so a vector that gets read over and over
+     * doesn't go to the heap every time. Has to outlive the vectors using it.
+     */
+    template <class T>
+    class DfVectorPool : public DfVectorAllocator<T>
+    {
+        private:
+            struct t_buffer
+            {
+                T * data;
+                uint32_t capacity;
+            };
+            std::vector <t_buffer> spare;
+            uint32_t max_spare;
+        public:
+            DfVectorPool(uint32_t max_spare_ = 8) : max_spare(max_spare_){};
+            ~DfVectorPool()
+            {
+                for(size_t i = 0; i < spare.size(); i++)
+                    delete [] spare[i].data;
+            };
+            T * allocate(uint32_t count, uint32_t & capacity)
+            {
+                // the smallest one that fits
+                size_t best = spare.size();
+                for(size_t i = 0; i < spare.size(); i++)
+                {
+                    if(spare[i].capacity >= count && (best == spare.size() || spare[i].capacity < spare[best].capacity))
+                        best = i;
+                }
+                if(best == spare.size())
+                {
+                    capacity = count;
+                    return new T[count];
+                }
+                T * data = spare[best].data;
+                capacity = spare[best].capacity;
+                spare[best] = spare.back();
+                spare.pop_back();
+                return data;
+            };
+            void release(T * data, uint32_t capacity)
+            {
+                t_buffer b = {data, capacity};
+                if(spare.size() < max_spare)
+                {
+                    spare.push_back(b);
+                    return;
+                }
+                // full, the smallest one goes
+                size_t smallest = 0;
+                for(size_t i = 1; i < spare.size(); i++)
+                {
+                    if(spare[i].capacity < spare[smallest].capacity)
+                        smallest = i;
+                }
+                if(max_spare && spare[smallest].capacity < capacity)
+                    std::swap(spare[smallest], b);
+                delete [] b.data;
+            };
+    };
+
+    /**
+     * A copy of a vector in DF.
+     * Normally, the whole vector is read when it's constructed and elements are contiguous.
+     * With a window size, it's lazy: elements are read a window at a time, when they're needed.
+     * References to elements only last until another window is read then.
+     */
     template <class T>
     class DFHACK_EXPORT DfVector
     {
@@ -46,53 +139,190 @@ namespace DFHack
             t_vecTriplet t_read;
             uint32_t _size;// vector size
             
-            T * data; // cached data
+            T * data; // cached data, or the current window
+            uint32_t _capacity; // elements that fit into data
+            DfVectorAllocator<T> * _alloc; // 0 means the heap
+            uint32_t _window; // window size in elements, 0 if everything is read at once
+            uint32_t _first; // first element in the window
+            uint32_t _cached; // elements in the window
 
             bool isMetadataInSync()
             {
                 t_vecTriplet t2;
                 _p->readSTLVector(_address,t2);
-                return (t2.start == t.start || t2.end == t.end || t2.alloc_end == t.alloc_end);
+                return (t2.start == t.start && t2.end == t.end && t2.alloc_end == t.alloc_end);
             }
-        public:
-            DfVector(Process *p, uint32_t address) : _p(p), _address(address)
+            void reserve(uint32_t count)
+            {
+                if(data && _capacity >= count)
+                    return;
+                discard();
+                if(_alloc)
+                    data = _alloc->allocate(count, _capacity);
+                else
+                {
+                    data = new T[count];
+                    _capacity = count;
+                }
+            }
+            void discard()
+            {
+                if(!data)
+                    return;
+                if(_alloc)
+                    _alloc->release(data, _capacity);
+                else
+                    delete [] data;
+                data = 0;
+                _capacity = 0;
+            }
+            // fill the cache from the current triplet
+            void load()
             {
-                p->readSTLVector(address,t);
                 t_read = t;
                 uint32_t byte_size = t.end - t.start;
                 _size = byte_size / sizeof(T);
-                data = new T[_size];
-                p->read(t.start,byte_size, (uint8_t *)data);
+                _first = _cached = 0;
+                if(_window)
+                {
+                    reserve(_window);
+                    return;
+                }
+                reserve(_size);
+                _p->read(t.start,byte_size, (uint8_t *)data);
+            }
+            // the element, from the window it's in
+            const T& fetch(uint32_t index)
+            {
+                if(index - _first >= _cached)
+                {
+                    _first = index - index % _window;
+                    _cached = _first < _size ? _size - _first : 0;
+                    if(_cached > _window)
+                        _cached = _window;
+                    if(_cached)
+                        _p->read(t.start + _first * sizeof(T), _cached * sizeof(T), (uint8_t *) data);
+                }
+                return data[index - _first];
+            }
+        public:
+            /**
+             * Read-only random access iterator. Dereferencing gives a copy of the element,
+             * so it stays valid when a lazy vector moves on to another window.
+             */
+            class const_iterator
+            {
+                public:
+                    typedef std::random_access_iterator_tag iterator_category;
+                    typedef T value_type;
+                    typedef std::ptrdiff_t difference_type;
+                    typedef const T * pointer;
+                    typedef T reference;
+                    const_iterator() : v(0), i(0){};
+                    const_iterator(DfVector * v_, uint32_t i_) : v(v_), i(i_){};
+                    T operator* () const { return (*v)[i]; };
+                    T operator[] (difference_type n) const { return (*v)[i + n]; };
+                    const_iterator& operator++ () { i++; return *this; };
+                    const_iterator operator++ (int) { const_iterator old = *this; i++; return old; };
+                    const_iterator& operator-- () { i--; return *this; };
+                    const_iterator operator-- (int) { const_iterator old = *this; i--; return old; };
+                    const_iterator& operator+= (difference_type n) { i += n; return *this; };
+                    const_iterator& operator-= (difference_type n) { i -= n; return *this; };
+                    const_iterator operator+ (difference_type n) const { return const_iterator(v, i + n); };
+                    const_iterator operator- (difference_type n) const { return const_iterator(v, i - n); };
+                    difference_type operator- (const const_iterator& o) const { return (difference_type) i - (difference_type) o.i; };
+                    bool operator== (const const_iterator& o) const { return i == o.i; };
+                    bool operator!= (const const_iterator& o) const { return i != o.i; };
+                    bool operator< (const const_iterator& o) const { return i < o.i; };
+                    bool operator> (const const_iterator& o) const { return i > o.i; };
+                    bool operator<= (const const_iterator& o) const { return i <= o.i; };
+                    bool operator>= (const const_iterator& o) const { return i >= o.i; };
+                    // index of the element
+                    uint32_t index() const { return i; };
+                private:
+                    DfVector * v;
+                    uint32_t i;
             };
-            DfVector()
+            /**
+             * @param p the process
+             * @param address address of the vector
+             * @param allocator where the copy goes, 0 for the heap. has to outlive the vector
+             * @param window elements per window for a lazy vector, 0 to read everything now
+             */
+            DfVector(Process *p, uint32_t address, DfVectorAllocator<T> * allocator = 0, uint32_t window = 0)
+            : _p(p), _address(address), data(0), _capacity(0), _alloc(allocator), _window(window)
             {
-                data = 0;
+                p->readSTLVector(address,t);
+                load();
+            };
+            DfVector() : _p(0), _address(0), _size(0), data(0), _capacity(0), _alloc(0), _window(0), _first(0), _cached(0)
+            {
+                t.start = t.end = t.alloc_end = 0;
+                t_read = t;
             };
             ~DfVector()
             {
-                if(data)
-                    delete [] data;
+                discard();
             };
+            /**
+             * Read the vector again, into the same storage if it still fits.
+             */
+            void reload()
+            {
+                _p->readSTLVector(_address,t);
+                load();
+            }
+            /**
+             * Read the vector's start, end and allocation end again.
+             * If none of them changed, the copy is kept as it is, nothing else gets read.
+             * Changes to elements that don't move the vector aren't seen: erasing one element
+             * and pushing another leaves all three the same. Only for callers that can live
+             * with that, like when DF stayed suspended since the last read.
+             * @return true if the vector changed and was read again
+             */
+            bool refresh()
+            {
+                if(isMetadataInSync())
+                    return false;
+                _p->readSTLVector(_address,t);
+                load();
+                return true;
+            }
             // get offset of the specified index
             inline const T& operator[] (uint32_t index)
             {
                 // FIXME: vector out of bounds exception
                 //assert(index < size);
+                if(_window)
+                    return fetch(index);
                 return data[index];
             };
             // get offset of the specified index
             inline const T& at (uint32_t index)
             {
                 //assert(index < size);
+                if(_window)
+                    return fetch(index);
                 return data[index];
             };
+            const_iterator begin()
+            {
+                return const_iterator(this, 0);
+            };
+            const_iterator end()
+            {
+                return const_iterator(this, _size);
+            };
             // update value at index
             bool set(uint32_t index, T value)
             {
                 if (index >= _size)
                     return false;
-                data[index] = value;
-                _p->write(t.start + sizeof(T)*index, sizeof(T), (uint8_t *)&data[index]);
+                if(!_window)
+                    data[index] = value;
+                else if(index - _first < _cached)
+                    data[index - _first] = value;
+                _p->write(t.start + sizeof(T)*index, sizeof(T), (uint8_t *)&value);
                 return true;
             }
             // remove value
@@ -104,10 +334,24 @@ namespace DFHack
                 _size--;
                 t.end -= sizeof(T);
                 int tail = (_size-index)*sizeof(T);
-                memmove(&data[index], &data[index+1], tail);
-                // Write back the data
-                if (tail)
-                    _p->write(t.start + sizeof(T)*index, tail, (uint8_t *)&data[index]);
+                if(_window)
+                {
+                    // we don't have the tail, move it over in DF
+                    if (tail)
+                    {
+                        std::vector <uint8_t> moved(tail);
+                        _p->read(t.start + sizeof(T)*(index+1), tail, &moved[0]);
+                        _p->write(t.start + sizeof(T)*index, tail, &moved[0]);
+                    }
+                    _cached = 0;
+                }
+                else
+                {
+                    memmove(&data[index], &data[index+1], tail);
+                    // Write back the data
+                    if (tail)
+                        _p->write(t.start + sizeof(T)*index, tail, (uint8_t *)&data[index]);
+                }
                 _p->writeSTLVector(_address,t);
                 return true;
             }
@@ -121,10 +365,10 @@ namespace DFHack
             {
                 return t.start;
             };
-            // get vector end
-            inline uint32_t end ()
+            // get vector start, end and allocation end
+            inline const t_vecTriplet & triplet ()
             {
-                return t.end;
+                return t;
             };
             // get vector start
             inline const uint32_t alloc_end ()
@@ -132,5 +376,94 @@ namespace DFHack
                 return t.alloc_end;
             };
     };
+
+    /**
+     * Copies of the objects a vector of pointers points to, all read at once.
+     * Objects close to each other are read together, see Process::readBatchMerged.
+     * DF tends to allocate them next to each other, so one read often covers many of them.
+     * The copies are kept in the order of the pointers. T has to be a plain struct.
+     */
+    template <class T>
+    class DfPtrVector
+    {
+        private:
+            std::vector <uint32_t> _pointers;
+            std::vector <T> _objects;
+            // (pointer, index), sorted, for find()
+            std::vector < std::pair <uint32_t, uint32_t> > _sorted;
+        public:
+            DfPtrVector(){};
+            /**
+             * @param p the process
+             * @param pointers the pointers. null pointers give zeroed objects
+             * @param offset where T starts in an object, relative to the pointer
+             * @param max_gap see Process::readBatchMerged
+             */
+            void read(Process * p, const uint32_t * pointers, uint32_t count, int32_t offset = 0, uint32_t max_gap = 4096)
+            {
+                _pointers.assign(pointers, pointers + count);
+                _objects.resize(count);
+                _sorted.resize(count);
+                std::vector <t_readop> ops;
+                ops.reserve(count);
+                for(uint32_t i = 0; i < count; i++)
+                {
+                    _sorted[i] = std::make_pair(pointers[i], i);
+                    if(!pointers[i])
+                    {
+                        memset(&_objects[i], 0, sizeof(T));
+                        continue;
+                    }
+                    t_readop op = {pointers[i] + offset, sizeof(T), (uint8_t *) &_objects[i]};
+                    ops.push_back(op);
+                }
+                std::sort(_sorted.begin(), _sorted.end());
+                if(!ops.empty())
+                    p->readBatchMerged(&ops[0], ops.size(), max_gap);
+            }
+            void read(Process * p, DfVector <uint32_t> & pointers, int32_t offset = 0, uint32_t max_gap = 4096)
+            {
+                std::vector <uint32_t> copy(pointers.begin(), pointers.end());
+                read(p, copy.empty() ? 0 : &copy[0], copy.size(), offset, max_gap);
+            }
+            inline uint32_t size () const
+            {
+                return _objects.size();
+            };
+            inline const T& operator[] (uint32_t index) const
+            {
+                return _objects[index];
+            };
+            // to keep the copy up to date with what's written to DF
+            inline T& operator[] (uint32_t index)
+            {
+                return _objects[index];
+            };
+            // the pointer to the object at index
+            inline uint32_t address (uint32_t index) const
+            {
+                return _pointers[index];
+            };
+            // all the objects, in order
+            inline const std::vector <T> & objects () const
+            {
+                return _objects;
+            };
+            // index of the object a pointer points to, -1 if it's not in here
+            int32_t find (uint32_t pointer) const
+            {
+                typename std::vector < std::pair <uint32_t, uint32_t> >::const_iterator it;
+                it = std::lower_bound(_sorted.begin(), _sorted.end(), std::make_pair(pointer, (uint32_t) 0));
+                if(it == _sorted.end() || it->first != pointer)
+                    return -1;
+                return it->second;
+            };
+            void clear()
+            {
+                _pointers.clear();
+                _objects.clear();
+                _sorted.clear();
+            };
+    };
 }
 #endif // DFVECTOR_H_INCLUDED
@@ -296,6 +296,23 @@ namespace DFHack
         uint32_t birth_time;
     };
 
+    /**
+     * parts of a creature read by Creatures::ReadAll, or them together
+     * \ingroup grp_creatures
+     */
+    enum e_creatureparts
+    {
+        /// position, race, civ, flags, name, profession, sex, caste
+        CREATURE_BASIC = 1,
+        /// physical attributes, labors, mood, happiness, birth, artifact name, colors
+        CREATURE_ADVANCED = 2,
+        /// default soul: skills, traits and mental attributes
+        CREATURE_SOUL = 4,
+        /// current job
+        CREATURE_JOBS = 8,
+        CREATURE_ALL = 15
+    };
+
     class DFContextShared;
     /**
      * The Creatures module - allows reading all non-vermin creatures and their properties
@@ -317,6 +334,11 @@ namespace DFHack
             const uint16_t x1, const uint16_t y1,const uint16_t z1,
             const uint16_t x2, const uint16_t y2,const uint16_t z2);
         bool ReadCreature(const int32_t index, t_creature & furball);
+        /**
+         * read all the creatures, at least the parts in mask (e_creatureparts).
+         * over SHM, DF packs the creatures itself and sends them a whole window at a time.
+         */
+        bool ReadAll(uint32_t mask, std::vector<t_creature> & creatures);
         bool ReadJob(const t_creature * furball, std::vector<t_material> & mat);
 
         bool ReadInventoryIdx(const uint32_t index, std::vector<uint32_t> & item);
@@ -494,6 +494,77 @@ namespace DFHack
         int32_t mystery;
     } mapblock40d;
 
+    /**
+     * parts of a block read by Maps::ReadBlocks, or them together
+     * \ingroup grp_maps
+     */
+    enum e_blockparts
+    {
+        BLOCK_TILETYPES = 1,
+        BLOCK_DESIGNATIONS = 2,
+        BLOCK_OCCUPANCY = 4,
+        /// both temperature layers
+        BLOCK_TEMPERATURES = 8,
+        BLOCK_BIOME = 16,
+        /// global and local feature index
+        BLOCK_FEATURES = 32,
+        BLOCK_ALL = 63,
+        /// the mineral veins, Maps::ReadAllBlocks only
+        BLOCK_VEINS = 64
+    };
+    /**
+     * box of blocks in block coords, both corners inclusive
+     * \ingroup grp_maps
+     */
+    struct t_blockbox
+    {
+        uint32_t x1, y1, z1;
+        uint32_t x2, y2, z2;
+    };
+    /**
+     * receives the blocks read by Maps::ReadBlocks
+     * \ingroup grp_maps
+     */
+    class DFHACK_EXPORT BlockSink
+    {
+        public:
+        virtual ~BlockSink(){};
+        /**
+         * called for every valid block of the box, x outermost and z innermost.
+         * position, origin and blockflags are always filled in, the rest only if asked for.
+         * temp1 and temp2 are 0 unless BLOCK_TEMPERATURES was asked for.
+         */
+        virtual void block(const mapblock40d & block, const t_temperatures * temp1, const t_temperatures * temp2) = 0;
+    };
+    /**
+     * receives the blocks read by Maps::ReadAllBlocks, from several threads at once
+     * \ingroup grp_maps
+     */
+    class DFHACK_EXPORT ParallelBlockSink
+    {
+        public:
+        virtual ~ParallelBlockSink(){};
+        /**
+         * called for every valid block of the map by the worker that read it. a worker only
+         * ever passes its own number, so whatever is kept per worker needs no locking.
+         * the parts are filled in like for BlockSink::block, veins is 0 unless BLOCK_VEINS was asked for.
+         */
+        virtual void block(uint32_t worker, const mapblock40d & block, const t_temperatures * temp1,
+                           const t_temperatures * temp2, const std::vector<t_vein> * veins) = 0;
+    };
+    /**
+     * one entry of the map change journal, see Maps::PollChangedBlocks
+     * \ingroup grp_maps
+     */
+    struct t_blockchange
+    {
+        DFCoord position;
+        /// frame the change was seen in, counted from the start of the journal
+        uint32_t frame;
+        /// the whole map has to be re-read, position means nothing
+        bool everything;
+    };
+
     class DFContextShared;
     /**
      * The Maps module
@@ -508,6 +579,13 @@ namespace DFHack
         ~Maps();
         bool Start();
         bool Finish();
+        /**
+         * Like Start, but keeps the block pointer table from the last Start when the map
+         * pointer, the map size and the x array haven't changed. Only the region position
+         * gets updated then. Falls back to Start when anything moved or Start wasn't called.
+         * Meant for tools that poll the map over and over.
+         */
+        bool Refresh();
         
         // read region surroundings, get their vectors of geolayers so we can do translation (or just hand the translation table to the client)
         // returns an array of 9 vectors of indices into stone matgloss
@@ -612,6 +690,41 @@ namespace DFHack
         /// read the whole map block at block coords (see DFTypes.h for the block structure)
         bool ReadBlock40d(uint32_t blockx, uint32_t blocky, uint32_t blockz, mapblock40d * buffer);
 
+        /**
+         * read the parts of all valid blocks in a box (clipped to the map) and pass them to a sink.
+         * mask is a combination of e_blockparts.
+         * over SHM, DF packs the blocks itself and sends them a whole window at a time.
+         */
+        bool ReadBlocks(const t_blockbox & box, uint32_t mask, BlockSink & sink);
+
+        /**
+         * read the parts in mask of all valid blocks, with 'threads' workers reading z columns
+         * of blocks in parallel, each through its own reader (see Process::createReader).
+         * mask is a combination of e_blockparts, BLOCK_VEINS included.
+         * if the process can't give out readers (SHM, Windows, buffered writes) or the mineral
+         * veins can't be told apart by their vtable yet, everything is read by ReadBlocks
+         * and ReadVeins on the calling thread, as worker 0.
+         * @return false if a worker failed to read its blocks
+         */
+        bool ReadAllBlocks(uint32_t mask, uint32_t threads, ParallelBlockSink & sink);
+
+        /**
+         * start the change journal of the SHM server. every 'interval' frames, DF hashes the
+         * parts in mask of the next 'budget' blocks and journals the ones that changed, so a
+         * full sweep of the map takes (blocks / budget) * interval frames.
+         * calling it again changes the settings. SHM only, needs DF suspended.
+         */
+        bool StartJournal(uint32_t mask = BLOCK_TILETYPES | BLOCK_DESIGNATIONS | BLOCK_OCCUPANCY, uint32_t interval = 1, uint32_t budget = 2048);
+        /// stop the change journal, for all clients
+        bool StopJournal();
+        /**
+         * get the blocks changed since the journal sequence number 'since' and move it forward.
+         * doesn't need DF suspended. start with since = 0. an entry with 'everything' set means
+         * everything has to be re-read: the first sweep is done, the map changed or the journal
+         * overflowed. returns false if there's no journal running.
+         */
+        bool PollChangedBlocks(uint32_t & since, std::vector<t_blockchange> & out);
+
         /// read/write block tile types
         bool ReadTileTypes(uint32_t blockx, uint32_t blocky, uint32_t blockz, tiletypes40d *buffer);
         bool WriteTileTypes(uint32_t blockx, uint32_t blocky, uint32_t blockz, tiletypes40d *buffer);
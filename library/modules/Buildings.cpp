@@ -24,6 +24,7 @@ distribution.
 
 #include "Internal.h"
 
+#include <stddef.h>
 #include <string>
 #include <vector>
 #include <map>
@@ -38,6 +39,7 @@ using namespace std;
 #include "dfhack/DFError.h"
 #include "dfhack/modules/Buildings.h"
 #include "ModuleFactory.h"
+#include "GatherPlan.h"
 using namespace DFHack;
 
 //raw
@@ -65,6 +67,10 @@ struct Buildings::Private
     uint32_t custom_workshop_name;
     int32_t custom_workshop_id;
     DfVector <uint32_t> * p_bld;
+    GatherPlan building_plan;
+    // all the buildings, read in one batch by the first Read after Start
+    vector <t_building> buildings;
+    bool buildingsRead;
     DFContextShared *d;
     Process * owner;
     bool Inited;
@@ -83,7 +89,15 @@ Buildings::Buildings(DFContextShared * d_)
     d->d = d_;
     d->owner = d_->p;
     d->p_bld = NULL;
+    d->buildingsRead = false;
     d->Inited = d->Started = d->hasCustomWorkshops = false;
+    // t_building_df40d -> t_building
+    GatherPlan & plan = d->building_plan;
+    plan.add(offsetof(t_building_df40d, vtable), sizeof(uint32_t), offsetof(t_building, vtable));
+    plan.add(offsetof(t_building_df40d, x1), 2 * sizeof(uint32_t), offsetof(t_building, x1)); // x1, y1
+    plan.add(offsetof(t_building_df40d, x2), 2 * sizeof(uint32_t), offsetof(t_building, x2)); // x2, y2
+    plan.add(offsetof(t_building_df40d, z), sizeof(uint32_t), offsetof(t_building, z));
+    plan.add(offsetof(t_building_df40d, material), sizeof(t_matglossPair), offsetof(t_building, material));
     VersionInfo * mem = d->d->offset_descriptor;
     OffsetGroup * OG_build = mem->getGroup("Buildings");
     d->Inited = true;
@@ -126,6 +140,7 @@ bool Buildings::Start(uint32_t & numbuildings)
     if(!d->Inited)
         return false;
     d->p_bld = new DfVector <uint32_t> (d->owner, d->buildings_vector);
+    d->buildingsRead = false;
     numbuildings = d->p_bld->size();
     d->Started = true;
     return true;
@@ -135,26 +150,23 @@ bool Buildings::Read (const uint32_t index, t_building & building)
 {
     if(!d->Started)
         return false;
-    t_building_df40d bld_40d;
-
     // read pointer from vector at position
     uint32_t temp = d->p_bld->at (index);
-    //d->p_bld->read(index,(uint8_t *)&temp);
 
     //read building from memory
-    d->owner->read (temp, sizeof (t_building_df40d), (uint8_t *) &bld_40d);
+    if(!d->buildingsRead)
+    {
+        uint32_t size = d->p_bld->size();
+        d->buildings.resize(size);
+        if(size)
+            d->building_plan.read(d->owner, &d->p_bld->at(0), size, &d->buildings[0], sizeof(t_building));
+        d->buildingsRead = true;
+    }
+    building = d->buildings[index];
 
-    // transform
     int32_t type = -1;
     d->owner->getDescriptor()->resolveObjectToClassID (temp, type);
     building.origin = temp;
-    building.vtable = bld_40d.vtable;
-    building.x1 = bld_40d.x1;
-    building.x2 = bld_40d.x2;
-    building.y1 = bld_40d.y1;
-    building.y2 = bld_40d.y2;
-    building.z = bld_40d.z;
-    building.material = bld_40d.material;
     building.type = type;
     return true;
 }
@@ -166,6 +178,8 @@ bool Buildings::Finish()
         delete d->p_bld;
         d->p_bld = NULL;
     }
+    d->buildings.clear();
+    d->buildingsRead = false;
     d->Started = false;
     return true;
 }
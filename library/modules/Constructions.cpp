@@ -45,6 +45,9 @@ struct Constructions::Private
     uint32_t construction_vector;
     // translation
     DfVector <uint32_t> * p_cons;
+    // all the constructions, read in bulk by the first Read after Start
+    DfPtrVector <t_construction> constructions;
+    bool constructionsRead;
 
     DFContextShared *d;
     Process * owner;
@@ -63,6 +66,7 @@ Constructions::Constructions(DFContextShared * d_)
     d->d = d_;
     d->owner = d_->p;
     d->p_cons = 0;
+    d->constructionsRead = false;
     d->Inited = d->Started = false;
     VersionInfo * mem = d->d->offset_descriptor;
     d->construction_vector = mem->getGroup("Constructions")->getAddress ("vector");
@@ -79,6 +83,7 @@ Constructions::~Constructions()
 bool Constructions::Start(uint32_t & numconstructions)
 {
     d->p_cons = new DfVector <uint32_t> (d->owner, d->construction_vector);
+    d->constructionsRead = false;
     numconstructions = d->p_cons->size();
     d->Started = true;
     return true;
@@ -93,7 +98,12 @@ bool Constructions::Read (const uint32_t index, t_construction & construction)
     uint32_t temp = d->p_cons->at (index);
 
     //read construction from memory
-    d->owner->read (temp, sizeof (t_construction), (uint8_t *) &construction);
+    if(!d->constructionsRead)
+    {
+        d->constructions.read(d->owner, *d->p_cons);
+        d->constructionsRead = true;
+    }
+    construction = d->constructions[index];
 
     // transform
     construction.origin = temp;
@@ -107,6 +117,8 @@ bool Constructions::Finish()
         delete d->p_cons;
         d->p_cons = NULL;
     }
+    d->constructions.clear();
+    d->constructionsRead = false;
     d->Started = false;
     return true;
 }
@@ -43,6 +43,10 @@ using namespace std;
 #include "dfhack/modules/Materials.h"
 #include "dfhack/modules/Creatures.h"
 #include "ModuleFactory.h"
+#include "GatherPlan.h"
+#include "shms.h"
+#include "mod-core.h"
+#include "mod-creature40d.h"
 
 using namespace DFHack;
 
@@ -106,6 +110,9 @@ struct Creatures::Private
         int32_t job_material_flags_o;
         // creature job material stuff
     } creatures;
+    // plain fields of a creature, fetched in one go
+    GatherPlan creature_plan;
+    size_t soul_field;
     uint32_t creature_module;
     uint32_t dwarf_race_index_addr;
     uint32_t dwarf_civ_id_addr;
@@ -114,6 +121,13 @@ struct Creatures::Private
     DfVector <uint32_t> *p_cre;
     DFContextShared *d;
     Process *owner;
+    // e_creatureparts we have offsets for
+    uint32_t parts;
+    void readParts(t_creature & furball, uint32_t soul, uint32_t mask);
+    // SHM creature module, used for CREATURE_EXPORT_ALL
+    bool shmTried;
+    bool hasSHMExport;
+    bool initSHMExport();
 };
 
 Module* DFHack::createCreatures(DFContextShared * d)
@@ -130,6 +144,7 @@ Creatures::Creatures(DFContextShared* _d)
     d->Started = false;
     d->IdMapReady = false;
     d->p_cre = NULL;
+    d->shmTried = d->hasSHMExport = false;
     d->d->InitReadNames(); // throws on error
     VersionInfo * minfo = d->d->offset_descriptor;
     OffsetGroup *OG_Creatures = minfo->getGroup("Creatures");
@@ -224,6 +239,50 @@ Creatures::Creatures(DFContextShared* _d)
         catch(Error::All&){};
     }
     catch(Error::All&){};
+
+    GatherPlan & plan = d->creature_plan;
+    if(d->Ft_basic)
+    {
+        plan.add(creatures.id_offset, sizeof(uint32_t), offsetof(t_creature, id));
+        plan.add(creatures.pos_offset, 3 * sizeof (uint16_t), offsetof(t_creature, x)); // xyz really
+        plan.add(creatures.race_offset, sizeof(uint32_t), offsetof(t_creature, race));
+        plan.add(creatures.civ_offset, sizeof(int32_t), offsetof(t_creature, civ));
+        plan.add(creatures.sex_offset, sizeof(uint8_t), offsetof(t_creature, sex));
+        plan.add(creatures.caste_offset, sizeof(uint16_t), offsetof(t_creature, caste));
+        plan.add(creatures.flags1_offset, sizeof(uint32_t), offsetof(t_creature, flags1));
+        plan.add(creatures.flags2_offset, sizeof(uint32_t), offsetof(t_creature, flags2));
+        plan.add(creatures.profession_offset, sizeof(uint8_t), offsetof(t_creature, profession));
+    }
+    if(d->Ft_advanced)
+    {
+        plan.add(creatures.happiness_offset, sizeof(uint32_t), offsetof(t_creature, happiness));
+        // physical attributes
+        plan.add(creatures.physical_offset, sizeof(t_attrib) * NUM_CREATURE_PHYSICAL_ATTRIBUTES, offsetof(t_creature, strength));
+        // mood stuff
+        plan.add(creatures.mood_offset, sizeof(int16_t), offsetof(t_creature, mood));
+        plan.add(creatures.mood_skill_offset, sizeof(int16_t), offsetof(t_creature, mood_skill));
+        // labors
+        plan.add(creatures.labors_offset, NUM_CREATURE_LABORS, offsetof(t_creature, labors));
+        plan.add(creatures.birth_year_offset, sizeof(int32_t), offsetof(t_creature, birth_year));
+        plan.add(creatures.birth_time_offset, sizeof(uint32_t), offsetof(t_creature, birth_time));
+    }
+    if(d->Ft_soul)
+    {
+        d->soul_field = plan.add(creatures.default_soul_offset, sizeof(uint32_t));
+    }
+    if(d->Ft_jobs)
+    {
+        plan.add(creatures.current_job_offset, sizeof(uint32_t), offsetof(t_creature, current_job) + offsetof(t_job, occupationPtr));
+    }
+    d->parts = 0;
+    if(d->Ft_basic)
+        d->parts |= CREATURE_BASIC;
+    if(d->Ft_advanced)
+        d->parts |= CREATURE_ADVANCED;
+    if(d->Ft_soul)
+        d->parts |= CREATURE_SOUL;
+    if(d->Ft_jobs)
+        d->parts |= CREATURE_JOBS;
     d->Inited = true;
 }
 
@@ -231,16 +290,23 @@ Creatures::~Creatures()
 {
     if(d->Started)
         Finish();
+    if(d->p_cre)
+        delete d->p_cre;
 }
 
 bool Creatures::Start( uint32_t &numcreatures )
 {
     if(d->Ft_basic)
     {
-        d->p_cre = new DfVector <uint32_t> (d->owner, d->creatures.vector);
+        // the copy is kept between polls to reuse its storage, but it's read again every time.
+        // creatures come and go without the vector moving or changing size
+        if(!d->p_cre)
+            d->p_cre = new DfVector <uint32_t> (d->owner, d->creatures.vector);
+        else
+            d->p_cre->reload();
+        d->IdMapReady = false;
         d->Started = true;
         numcreatures =  d->p_cre->size();
-        d->IdMapReady = false;
         return true;
     }
     return false;
@@ -248,67 +314,53 @@ bool Creatures::Start( uint32_t &numcreatures )
 
 bool Creatures::Finish()
 {
-    if(d->p_cre)
-    {
-        delete d->p_cre;
-        d->p_cre = 0;
-    }
     d->Started = false;
     return true;
 }
 
+// append a read of 'length' bytes at 'address' to a batch
+static inline void pushReadOp(t_readop * ops, size_t & nops, uint32_t address, uint32_t length, void * target)
+{
+    t_readop op = {address, length, (uint8_t *) target};
+    ops[nops++] = op;
+}
+
 bool Creatures::ReadCreature (const int32_t index, t_creature & furball)
 {
     if(!d->Started) return false;
     memset(&furball, 0, sizeof(t_creature));
-    // SHM fast path
-    Process * p = d->owner;
 
     // read pointer from vector at position
     uint32_t addr_cr = d->p_cre->at (index);
     furball.origin = addr_cr;
-    Private::t_offsets &offs = d->creatures;
+
+    // all the plain fields go into one batch, pointers we have to follow come back with it
+    d->creature_plan.read(d->owner, addr_cr, &furball);
+    uint32_t soul = 0;
+    if(d->Ft_soul)
+        soul = d->creature_plan.get<uint32_t>(0, d->soul_field);
+    d->readParts(furball, soul, CREATURE_ALL);
+    return true;
+}
+
+// what the creature plan can't fetch: strings, names and things behind pointers
+void Creatures::Private::readParts(t_creature & furball, uint32_t soul, uint32_t mask)
+{
+    Process * p = owner;
+    uint32_t addr_cr = furball.origin;
+    t_offsets &offs = creatures;
 
     //read creature from memory
-    if(d->Ft_basic)
+    if(Ft_basic && (mask & CREATURE_BASIC))
     {
         // name
-        d->d->readName(furball.name,addr_cr + offs.name_offset);
-
-        // basic stuff
-        p->readDWord (addr_cr + offs.id_offset, furball.id);
-        p->read (addr_cr + offs.pos_offset, 3 * sizeof (uint16_t), (uint8_t *) & (furball.x)); // xyz really
-        p->readDWord (addr_cr + offs.race_offset, furball.race);
-        furball.civ = p->readDWord (addr_cr + offs.civ_offset);
-        p->readByte (addr_cr + offs.sex_offset, furball.sex);
-        p->readWord (addr_cr + offs.caste_offset, furball.caste);
-        p->readDWord (addr_cr + offs.flags1_offset, furball.flags1.whole);
-        p->readDWord (addr_cr + offs.flags2_offset, furball.flags2.whole);
+        d->readName(furball.name,addr_cr + offs.name_offset);
         // custom profession
         p->readSTLString(addr_cr + offs.custom_profession_offset, furball.custom_profession, sizeof(furball.custom_profession));
-        // profession
-        furball.profession = p->readByte (addr_cr + offs.profession_offset);
     }
-    if(d->Ft_advanced)
+    if(Ft_advanced && (mask & CREATURE_ADVANCED))
     {
-        // happiness
-        p->readDWord (addr_cr + offs.happiness_offset, furball.happiness);
-
-        // physical attributes
-        p->read(addr_cr + offs.physical_offset,
-            sizeof(t_attrib) * NUM_CREATURE_PHYSICAL_ATTRIBUTES,
-            (uint8_t *)&furball.strength);
-
-        // mood stuff
-        furball.mood = (int16_t) p->readWord (addr_cr + offs.mood_offset);
-        furball.mood_skill = p->readWord (addr_cr + offs.mood_skill_offset);
-        d->d->readName(furball.artifact_name, addr_cr + offs.artifact_name_offset);
-
-        // labors
-        p->read (addr_cr + offs.labors_offset, NUM_CREATURE_LABORS, furball.labors);
-
-        furball.birth_year = p->readDWord (addr_cr + offs.birth_year_offset );
-        furball.birth_time = p->readDWord (addr_cr + offs.birth_time_offset );
+        d->readName(furball.artifact_name, addr_cr + offs.artifact_name_offset);
         /*
          * p->readDWord(temp + offs.creature_pregnancy_offset, furball.pregnancy_timer);
          */
@@ -333,13 +385,12 @@ bool Creatures::ReadCreature (const int32_t index, t_creature & furball)
             p->read(temp2,sizeof(t_like),(uint8_t *) &furball.likes[i]);
         }*/
     }
-    if(d->Ft_soul)
+    if(Ft_soul && (mask & CREATURE_SOUL))
     {
         /*
         // enum soul pointer vector
         DfVector <uint32_t> souls(p,temp + offs.creature_soul_vector_offset);
         */
-        uint32_t soul = p->readDWord(addr_cr + offs.default_soul_offset);
         furball.has_default_soul = false;
 
         if(soul)
@@ -347,38 +398,58 @@ bool Creatures::ReadCreature (const int32_t index, t_creature & furball)
             furball.has_default_soul = true;
             // get first soul's skills
             DfVector <uint32_t> skills(p, soul + offs.soul_skills_vector_offset);
-            furball.defaultSoul.numSkills = skills.size();
-
-            for (uint32_t i = 0; i < furball.defaultSoul.numSkills;i++)
+            uint32_t numSkills = skills.size();
+            if(numSkills > 256)
+                numSkills = 256;
+            furball.defaultSoul.numSkills = numSkills;
+
+            // skill fields, mental attributes and traits in one go
+            vector <t_readop> soulops(numSkills * 3 + 2);
+            size_t nsoulops = 0;
+            vector <uint8_t> ids(numSkills);
+            vector <uint8_t> ratings(numSkills);
+            vector <uint16_t> experience(numSkills);
+            for (uint32_t i = 0; i < numSkills;i++)
             {
                 uint32_t temp2 = skills[i];
                 // a byte: this gives us 256 skills maximum.
-                furball.defaultSoul.skills[i].id = p->readByte (temp2);
-                furball.defaultSoul.skills[i].rating =
-                    p->readByte (temp2 + offsetof(t_skill, rating));
-                furball.defaultSoul.skills[i].experience =
-                    p->readWord (temp2 + offsetof(t_skill, experience));
+                pushReadOp(&soulops[0], nsoulops, temp2, sizeof(uint8_t), &ids[i]);
+                pushReadOp(&soulops[0], nsoulops, temp2 + offsetof(t_skill, rating), sizeof(uint8_t), &ratings[i]);
+                pushReadOp(&soulops[0], nsoulops, temp2 + offsetof(t_skill, experience), sizeof(uint16_t), &experience[i]);
             }
-
             // mental attributes are part of the soul
-            p->read(soul + offs.soul_mental_offset,
+            pushReadOp(&soulops[0], nsoulops, soul + offs.soul_mental_offset,
                 sizeof(t_attrib) * NUM_CREATURE_MENTAL_ATTRIBUTES,
-                (uint8_t *)&furball.defaultSoul.analytical_ability);
-
+                &furball.defaultSoul.analytical_ability);
             // traits as well
-            p->read(soul + offs.soul_traits_offset,
+            pushReadOp(&soulops[0], nsoulops, soul + offs.soul_traits_offset,
                 sizeof (uint16_t) * NUM_CREATURE_TRAITS,
-                (uint8_t *) &furball.defaultSoul.traits);
+                &furball.defaultSoul.traits);
+            p->readBatch(&soulops[0], nsoulops);
+
+            for (uint32_t i = 0; i < numSkills;i++)
+            {
+                furball.defaultSoul.skills[i].id = ids[i];
+                furball.defaultSoul.skills[i].rating = ratings[i];
+                furball.defaultSoul.skills[i].experience = experience[i];
+            }
         }
     }
-    if(d->Ft_jobs)
+    if(Ft_jobs && (mask & CREATURE_JOBS))
     {
-        furball.current_job.occupationPtr = p->readDWord (addr_cr + offs.current_job_offset);
         if(furball.current_job.occupationPtr)
         {
+            uint8_t jobType;
+            uint16_t jobId;
+            t_readop jobops[] =
+            {
+                {furball.current_job.occupationPtr + offs.job_type_offset, sizeof(uint8_t), &jobType},
+                {furball.current_job.occupationPtr + offs.job_id_offset, sizeof(uint16_t), (uint8_t *) &jobId}
+            };
+            p->readBatch(jobops, sizeof(jobops) / sizeof(t_readop));
             furball.current_job.active = true;
-            furball.current_job.jobType = p->readByte (furball.current_job.occupationPtr + offs.job_type_offset );
-            furball.current_job.jobId = p->readWord (furball.current_job.occupationPtr + offs.job_id_offset);
+            furball.current_job.jobType = jobType;
+            furball.current_job.jobId = jobId;
         }
         else
         {
@@ -389,6 +460,211 @@ bool Creatures::ReadCreature (const int32_t index, t_creature & furball)
     {
         furball.current_job.active = false;
     }
+}
+
+/*
+ * Bulk creature reading
+ */
+
+// hook up the creature module of the SHM server, if we have one
+bool Creatures::Private::initSHMExport()
+{
+    if(shmTried)
+        return hasSHMExport;
+    shmTried = true;
+    char * shm = d->shm_start;
+    if(!shm || !Ft_basic || !owner->getModuleIndex("Creatures40d", CREATURES40D_VERSION, creature_module))
+        return false;
+    Server::Creatures::creature_offsets * init = (Server::Creatures::creature_offsets *) (shm + SHM_HEADER);
+    memset(init, 0, sizeof(Server::Creatures::creature_offsets));
+    try
+    {
+        init->vector_correct = d->offset_descriptor->getGroup("vector")->getOffset("start");
+    }
+    catch(Error::All &)
+    {
+        return false;
+    }
+    t_offsets & offs = creatures;
+    init->parts = parts;
+    init->creature_vector = offs.vector;
+    init->creature_id_offset = offs.id_offset;
+    init->creature_pos_offset = offs.pos_offset;
+    init->creature_race_offset = offs.race_offset;
+    init->creature_civ_offset = offs.civ_offset;
+    init->creature_sex_offset = offs.sex_offset;
+    init->creature_caste_offset = offs.caste_offset;
+    init->creature_flags1_offset = offs.flags1_offset;
+    init->creature_flags2_offset = offs.flags2_offset;
+    init->creature_profession_offset = offs.profession_offset;
+    init->creature_name_offset = offs.name_offset;
+    init->creature_custom_profession_offset = offs.custom_profession_offset;
+    if(Ft_advanced)
+    {
+        init->creature_happiness_offset = offs.happiness_offset;
+        init->creature_physical_offset = offs.physical_offset;
+        init->creature_mood_offset = offs.mood_offset;
+        init->creature_mood_skill_offset = offs.mood_skill_offset;
+        init->creature_labors_offset = offs.labors_offset;
+        init->creature_birth_year_offset = offs.birth_year_offset;
+        init->creature_birth_time_offset = offs.birth_time_offset;
+        init->creature_artifact_name_offset = offs.artifact_name_offset;
+        init->creature_appearance_vector_offset = offs.appearance_vector_offset;
+    }
+    if(Ft_soul)
+    {
+        init->creature_default_soul_offset = offs.default_soul_offset;
+        init->soul_skills_vector_offset = offs.soul_skills_vector_offset;
+        init->soul_mental_offset = offs.soul_mental_offset;
+        init->soul_traits_offset = offs.soul_traits_offset;
+    }
+    if(Ft_jobs)
+    {
+        init->creature_current_job_offset = offs.current_job_offset;
+        init->job_type_offset = offs.job_type_offset;
+        init->job_id_offset = offs.job_id_offset;
+    }
+    init->name_firstname_offset = d->name_firstname_offset;
+    init->name_nickname_offset = d->name_nickname_offset;
+    init->name_words_offset = d->name_words_offset;
+    init->name_parts_offset = d->name_parts_offset;
+    init->name_language_offset = d->name_language_offset;
+    init->name_set_offset = d->name_set_offset;
+    if(!owner->SetAndWait(Server::Creatures::CREATURE_INIT + (creature_module << 16)))
+        return false;
+    hasSHMExport = true;
+    return true;
+}
+
+namespace {
+    inline void importName(t_name & name, const Server::Creatures::shm_name & raw)
+    {
+        memcpy(name.first_name, raw.first_name, sizeof(name.first_name));
+        memcpy(name.nickname, raw.nickname, sizeof(name.nickname));
+        memcpy(name.words, raw.words, sizeof(name.words));
+        memcpy(name.parts_of_speech, raw.parts_of_speech, sizeof(name.parts_of_speech));
+        name.language = raw.language;
+        name.has_name = raw.has_name;
+    }
+    // unpack one record of CREATURE_EXPORT_ALL
+    void importCreature(t_creature & furball, const char * record, uint32_t mask)
+    {
+        using namespace Server::Creatures;
+        const shm_creaturerecord * head = (const shm_creaturerecord *) record;
+        furball.origin = head->origin;
+        const char * part = record + sizeof(shm_creaturerecord);
+        if(mask & CREATURE_BASIC)
+        {
+            const shm_creature_basic & basic = *(const shm_creature_basic *) part;
+            furball.id = basic.id;
+            furball.x = basic.x;
+            furball.y = basic.y;
+            furball.z = basic.z;
+            furball.race = basic.race;
+            furball.civ = basic.civ;
+            furball.sex = basic.sex;
+            furball.caste = basic.caste;
+            furball.flags1.whole = basic.flags1;
+            furball.flags2.whole = basic.flags2;
+            furball.profession = basic.profession;
+            importName(furball.name, basic.name);
+            memcpy(furball.custom_profession, basic.custom_profession, sizeof(furball.custom_profession));
+            part += sizeof(shm_creature_basic);
+        }
+        if(mask & CREATURE_ADVANCED)
+        {
+            const shm_creature_advanced & adv = *(const shm_creature_advanced *) part;
+            furball.happiness = adv.happiness;
+            memcpy(&furball.strength, adv.physical, sizeof(adv.physical));
+            furball.mood = adv.mood;
+            furball.mood_skill = adv.mood_skill;
+            furball.birth_year = adv.birth_year;
+            furball.birth_time = adv.birth_time;
+            memcpy(furball.labors, adv.labors, NUM_CREATURE_LABORS);
+            importName(furball.artifact_name, adv.artifact_name);
+            furball.nbcolors = adv.nbcolors;
+            memcpy(furball.color, adv.color, sizeof(furball.color));
+            part += sizeof(shm_creature_advanced);
+        }
+        if(mask & CREATURE_SOUL)
+        {
+            const shm_creature_soul & soul = *(const shm_creature_soul *) part;
+            furball.has_default_soul = soul.has_soul;
+            furball.defaultSoul.numSkills = soul.numSkills;
+            for(uint32_t i = 0; i < soul.numSkills; i++)
+            {
+                furball.defaultSoul.skills[i].id = soul.skills[i].id;
+                furball.defaultSoul.skills[i].rating = soul.skills[i].rating;
+                furball.defaultSoul.skills[i].experience = soul.skills[i].experience;
+            }
+            memcpy(&furball.defaultSoul.analytical_ability, soul.mental, sizeof(soul.mental));
+            memcpy(furball.defaultSoul.traits, soul.traits, sizeof(soul.traits));
+            part += sizeof(shm_creature_soul);
+        }
+        if(mask & CREATURE_JOBS)
+        {
+            const shm_creature_job & job = *(const shm_creature_job *) part;
+            furball.current_job.occupationPtr = job.occupationPtr;
+            furball.current_job.active = job.occupationPtr != 0;
+            furball.current_job.jobType = job.jobType;
+            furball.current_job.jobId = job.jobId;
+            part += sizeof(shm_creature_job);
+        }
+    }
+}
+
+bool Creatures::ReadAll(uint32_t mask, vector<t_creature> & creatures)
+{
+    creatures.clear();
+    if(!d->Started)
+        return false;
+    mask &= d->parts;
+    Process * p = d->owner;
+
+    if(d->initSHMExport())
+    {
+        char * shm = d->d->shm_start;
+        Server::Creatures::shm_creature_hdr * hdr = (Server::Creatures::shm_creature_hdr *) shm;
+        uint32_t recsize = Server::Creatures::exportCreatureSize(mask);
+        int32_t index = 0;
+        do
+        {
+            hdr->index = index;
+            hdr->mask = mask;
+            if(!p->SetAndWait(Server::Creatures::CREATURE_EXPORT_ALL + (d->creature_module << 16)) || hdr->error)
+                return false;
+            index = hdr->index;
+            uint32_t count = hdr->count;
+            if(creatures.empty())
+                creatures.reserve(hdr->total);
+            size_t first = creatures.size();
+            creatures.resize(first + count);
+            memset(&creatures[first], 0, count * sizeof(t_creature));
+            const char * record = shm + SHM_HEADER;
+            for(uint32_t i = 0; i < count; i++, record += recsize)
+            {
+                importCreature(creatures[first + i], record, mask);
+            }
+        } while(index != -1);
+        return true;
+    }
+
+    // plain fields of all the creatures in one batch, the rest one creature at a time
+    uint32_t size = d->p_cre->size();
+    if(!size)
+        return true;
+    creatures.resize(size);
+    memset(&creatures[0], 0, size * sizeof(t_creature));
+    d->creature_plan.read(p, &d->p_cre->at(0), size, &creatures[0], sizeof(t_creature));
+    for(uint32_t i = 0; i < size; i++)
+    {
+        t_creature & furball = creatures[i];
+        furball.origin = d->p_cre->at(i);
+        uint32_t soul = 0;
+        if(d->Ft_soul)
+            soul = d->creature_plan.get<uint32_t>(i, d->soul_field);
+        d->readParts(furball, soul, mask);
+    }
     return true;
 }
 
@@ -434,13 +710,13 @@ int32_t Creatures::FindIndexById(int32_t creature_id)
         d->IdMap.clear();
 
         Process * p = d->owner;
-        Private::t_offsets &offs = d->creatures;
 
-        uint32_t size = d->p_cre->size();
+        // all the IDs in one go
+        vector<uint8_t> ids;
+        uint32_t size = p->gatherVector(d->creatures.vector, d->creatures.id_offset, sizeof(int32_t), ids);
         for (uint32_t index = 0; index < size; index++)
         {
-            uint32_t temp = d->p_cre->at(index);
-            int32_t id = p->readDWord (temp + offs.id_offset);
+            int32_t id = *(int32_t *) &ids[index * sizeof(int32_t)];
             d->IdMap[id] = index;
         }
     }
@@ -45,6 +45,9 @@ struct Engravings::Private
     uint32_t engraving_vector;
     // translation
     DfVector <uint32_t> * p_engr;
+    // all the engravings, read in bulk by the first Read after Start
+    DfPtrVector <t_engraving> engravings;
+    bool engravingsRead;
 
     DFContextShared *d;
     Process * owner;
@@ -63,6 +66,7 @@ Engravings::Engravings(DFContextShared * d_)
     d->d = d_;
     d->owner = d_->p;
     d->p_engr = 0;
+    d->engravingsRead = false;
     d->Inited = d->Started = false;
     VersionInfo * mem = d->d->offset_descriptor;
     d->engraving_vector = mem->getGroup("Engravings")->getAddress ("vector");
@@ -79,6 +83,7 @@ Engravings::~Engravings()
 bool Engravings::Start(uint32_t & numengravings)
 {
     d->p_engr = new DfVector <uint32_t> (d->owner, d->engraving_vector);
+    d->engravingsRead = false;
     numengravings = d->p_engr->size();
     d->Started = true;
     return true;
@@ -93,7 +98,12 @@ bool Engravings::Read (const uint32_t index, dfh_engraving & engraving)
     uint32_t temp = d->p_engr->at (index);
 
     //read construction from memory
-    d->owner->read (temp, sizeof (t_engraving), (uint8_t *) &(engraving.s));
+    if(!d->engravingsRead)
+    {
+        d->engravings.read(d->owner, *d->p_engr);
+        d->engravingsRead = true;
+    }
+    engraving.s = d->engravings[index];
 
     // transform
     engraving.origin = temp;
@@ -105,6 +115,10 @@ bool Engravings::Write (const dfh_engraving & engraving)
     if(!d->Started) return false;
     //write engraving to memory
     d->owner->write (engraving.origin, sizeof (t_engraving), (uint8_t *) &(engraving.s));
+    // keep the copy in line
+    int32_t index = d->engravingsRead ? d->engravings.find(engraving.origin) : -1;
+    if(index != -1)
+        d->engravings[index] = engraving.s;
     return true;
 }
 
@@ -115,6 +129,8 @@ bool Engravings::Finish()
         delete d->p_engr;
         d->p_engr = NULL;
     }
+    d->engravings.clear();
+    d->engravingsRead = false;
     d->Started = false;
     return true;
 }
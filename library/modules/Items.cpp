@@ -24,11 +24,13 @@ distribution.
 
 #include "Internal.h"
 
+#include <stddef.h>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <cstdio>
 #include <map>
+#include <cstring>
 using namespace std;
 
 #include "ContextShared.h"
@@ -40,6 +42,7 @@ using namespace std;
 #include "dfhack/modules/Items.h"
 #include "dfhack/modules/Creatures.h"
 #include "ModuleFactory.h"
+#include "GatherPlan.h"
 
 using namespace DFHack;
 
@@ -67,11 +70,17 @@ private:
     Process * p;
     DataWidth dataWidth;
     uint32_t method;
+    // index in the owner's gather plan, if the value is read by it
+    size_t field;
 public:
     Accessor(uint32_t function, Process * p);
     Accessor(accessor_type type, int32_t constant, uint32_t offset1, uint32_t offset2, uint32_t dataWidth, Process * p);
     std::string dump();
     int32_t getValue(uint32_t objectPtr);
+    // declare the field we read, if any, in a gather plan
+    void planField(GatherPlan & plan);
+    // get the value from the plan's last read where possible
+    int32_t getValue(uint32_t objectPtr, const GatherPlan & plan);
     bool isConstant();
 };
 class ItemImprovementDesc
@@ -99,6 +108,7 @@ private:
     Process * p;
     bool hasDecoration;
     int idFieldOffset;
+    GatherPlan plan;
 public:
     ItemDesc(uint32_t VTable, Process * p);
     bool readItem(uint32_t itemptr, dfh_item & item);
@@ -179,6 +189,7 @@ static bool match_MOV_MEM(uint32_t &ptr, uint64_t v, int in_reg, int &out_reg, i
 Accessor::Accessor(uint32_t function, Process *p)
 {
     this->p = p;
+    this->field = GatherPlan::no_dest;
     this->type = ACCESSOR_CONSTANT;
     if(!p)
     {
@@ -336,6 +347,30 @@ int32_t Accessor::getValue(uint32_t objectPtr)
     }
 }
 
+void Accessor::planField(GatherPlan & plan)
+{
+    if(this->type != ACCESSOR_INDIRECT)
+        return;
+    this->field = plan.add(this->offset1, this->dataWidth == Data32 ? sizeof(int32_t) : sizeof(int16_t));
+}
+
+int32_t Accessor::getValue(uint32_t objectPtr, const GatherPlan & plan)
+{
+    if(this->field == GatherPlan::no_dest)
+        return getValue(objectPtr);
+    switch(this->dataWidth)
+    {
+    case Data32:
+        return plan.get<int32_t>(0, this->field);
+    case DataSigned16:
+        return plan.get<int16_t>(0, this->field);
+    case DataUnsigned16:
+        return plan.get<uint16_t>(0, this->field);
+    default:
+        return -1;
+    }
+}
+
 // FIXME: turn into a proper factory with caching
 Accessor * buildAccessor (OffsetGroup * I, Process * p, const char * name, uint32_t vtable)
 {
@@ -369,6 +404,16 @@ ItemDesc::ItemDesc(uint32_t VTable, Process *p)
     AQuantity = buildAccessor(Items, p, "item_quantity_accessor", VTable);
 
     idFieldOffset = Items->getOffset("id");
+    // the id, the base and whatever the accessors look at in one go
+    plan.add(Items, "id", sizeof(uint32_t), offsetof(dfh_item, id));
+    plan.add(0, sizeof(t_item), offsetof(dfh_item, base));
+    AMainType->planField(plan);
+    ASubType->planField(plan);
+    ASubIndex->planField(plan);
+    AIndex->planField(plan);
+    AQuality->planField(plan);
+    AWear->planField(plan);
+    AQuantity->planField(plan);
 
     this->vtable = VTable;
     this->p = p;
@@ -401,19 +446,18 @@ string ItemDesc::dumpAccessors()
 
 bool ItemDesc::readItem(uint32_t itemptr, DFHack::dfh_item &item)
 {
-    item.id = p->readDWord(itemptr+idFieldOffset);
-    p->read(itemptr, sizeof(t_item), (uint8_t*)&item.base);
-    item.matdesc.itemType = AMainType->getValue(itemptr);
-    item.matdesc.subType = ASubType->getValue(itemptr);
-    item.matdesc.subIndex = ASubIndex->getValue(itemptr);
-    item.matdesc.index = AIndex->getValue(itemptr);
-    item.quality = AQuality->getValue(itemptr);
-    item.quantity = AQuantity->getValue(itemptr);
+    plan.read(p, itemptr, &item);
+    item.matdesc.itemType = AMainType->getValue(itemptr, plan);
+    item.matdesc.subType = ASubType->getValue(itemptr, plan);
+    item.matdesc.subIndex = ASubIndex->getValue(itemptr, plan);
+    item.matdesc.index = AIndex->getValue(itemptr, plan);
+    item.quality = AQuality->getValue(itemptr, plan);
+    item.quantity = AQuantity->getValue(itemptr, plan);
     item.origin = itemptr;
     // FIXME: use templates. seriously.
     // Note: this accessor returns a 32-bit value with the higher
     // half sometimes containing garbage, so the cast is essential:
-    item.wear_level = (int16_t)this->AWear->getValue(itemptr);
+    item.wear_level = (int16_t)this->AWear->getValue(itemptr, plan);
     return true;
 }
 
@@ -428,6 +472,9 @@ class Items::Private
         uint32_t refVectorOffset;
         uint32_t idFieldOffset;
         uint32_t itemVectorAddress;
+        // kept between reads, see readItemVector
+        DfVector <uint32_t> * p_items;
+        GatherPlan id_plan;
         ClassNameCheck isOwnerRefClass;
         ClassNameCheck isContainerRefClass;
         ClassNameCheck isContainsRefClass;
@@ -438,6 +485,7 @@ Items::Items(DFContextShared * d_)
     d = new Private;
     d->d = d_;
     d->owner = d_->p;
+    d->p_items = 0;
 
     d->isOwnerRefClass = ClassNameCheck("general_ref_unit_itemownerst");
     d->isContainerRefClass = ClassNameCheck("general_ref_contained_in_itemst");
@@ -446,6 +494,7 @@ Items::Items(DFContextShared * d_)
     DFHack::OffsetGroup* itemGroup = d_->offset_descriptor->getGroup("Items");
     d->itemVectorAddress = itemGroup->getAddress("items_vector");
     d->idFieldOffset = itemGroup->getOffset("id");
+    d->id_plan.add(d->idFieldOffset, sizeof(int32_t));
     d->refVectorOffset = itemGroup->getOffset("item_ref_vector");
 }
 
@@ -462,16 +511,24 @@ bool Items::Finish()
 
 bool Items::readItemVector(std::vector<uint32_t> &items)
 {
-    DFHack::DfVector <uint32_t> p_items(d->owner, d->itemVectorAddress);
+    // the copy is kept to reuse its storage. the contents can change without the vector
+    // moving or changing size, so it's read again every time
+    if(!d->p_items)
+        d->p_items = new DfVector <uint32_t> (d->owner, d->itemVectorAddress);
+    else
+        d->p_items->reload();
+    DfVector <uint32_t> & p_items = *d->p_items;
 
-    d->idLookupTable.clear();
     items.resize(p_items.size());
+    if(p_items.size())
+        memcpy(&items[0], &p_items[0], p_items.size() * sizeof(uint32_t));
 
-    for (unsigned i = 0; i < p_items.size(); i++) {
-        uint32_t ptr = p_items[i];
-        items[i] = ptr;
-        d->idLookupTable[d->owner->readDWord(ptr + d->idFieldOffset)] = ptr;
-    }
+    d->idLookupTable.clear();
+    // all the IDs in one batch
+    if(p_items.size())
+        d->id_plan.read(d->owner, &p_items[0], p_items.size(), 0, 0);
+    for (unsigned i = 0; i < p_items.size(); i++)
+        d->idLookupTable[d->id_plan.get<int32_t>(i, 0)] = p_items[i];
 
     return true;
 }
@@ -501,6 +558,8 @@ Items::~Items()
     }
     d->descType.clear();
     d->descVTable.clear();
+    if(d->p_items)
+        delete d->p_items;
     delete d;
 }
 
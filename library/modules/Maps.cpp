@@ -24,8 +24,10 @@ distribution.
 
 #include "Internal.h"
 
+#include <stddef.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <map>
 #include <set>
 #include <cassert>
@@ -38,6 +40,11 @@ using namespace std;
 #include "dfhack/DFProcess.h"
 #include "dfhack/DFVector.h"
 #include "ModuleFactory.h"
+#include "GatherPlan.h"
+#include "WorkerThreads.h"
+#include "shms.h"
+#include "mod-core.h"
+#include "mod-maps.h"
 
 #define MAPS_GUARD if(!d->Started) throw DFHack::Error::ModuleNotInitialized();
 
@@ -69,10 +76,24 @@ struct Maps::Private
 {
     uint32_t * block;
     uint32_t x_block_count, y_block_count, z_block_count;
+    // where Start found the block table, so Refresh can tell whether it moved
+    uint32_t x_array_loc;
+    vector <uint32_t> x_columns;
+    void readGlobals(uint32_t * globals);
     int32_t regionX, regionY, regionZ;
     uint32_t worldSizeX, worldSizeY;
 
+    // SHM maps module, used for MAP_EXPORT_RANGE
     uint32_t maps_module;
+    bool shmTried;
+    bool hasSHMExport;
+    bool initSHMExport();
+    // declare the parts in mask for the blocks of a t_exportrec, returns the field of the flags pointer
+    size_t planParts(GatherPlan & plan, uint32_t mask);
+    // the change journal in the SHM segment, 0 until StartJournal
+    Server::Maps::shm_journal * journal;
+    // ReadVeins reads a vector for every block, this keeps it off the heap
+    DfVectorPool <uint32_t> vein_pool;
     struct t_offsets
     {
         uint32_t map_offset;// = d->offset_descriptor->getAddress ("map_data");
@@ -132,6 +153,13 @@ struct Maps::Private
         uint32_t tree_desc_offset;
     } offsets;
 
+    // everything ReadBlock40d needs but the flags
+    GatherPlan block_plan;
+    size_t flags_ptr_field;
+    // both temperatures, then the global and local feature indexes
+    GatherPlan temperature_plan;
+    GatherPlan feature_plan;
+
     DFContextShared *d;
     Process * owner;
     OffsetGroup *OG_vector;
@@ -161,7 +189,10 @@ Maps::Maps(DFContextShared* _d)
     Process *p = d->owner = _d->p;
     d->Inited = d->FeaturesStarted = d->Started = false;
     d->block = NULL;
+    d->x_array_loc = 0;
     d->usesWorldDataPtr = false;
+    d->shmTried = d->hasSHMExport = false;
+    d->journal = 0;
 
     DFHack::VersionInfo * mem = p->getDescriptor();
     Private::t_offsets &off = d->offsets;
@@ -214,6 +245,24 @@ Maps::Maps(DFContextShared* _d)
         {
             off.mystery = 0;
         }
+        GatherPlan & plan = d->block_plan;
+        plan.add(off.tile_type_offset, sizeof (tiletypes40d), offsetof(mapblock40d, tiletypes));
+        plan.add(off.designation_offset, sizeof (designations40d), offsetof(mapblock40d, designation));
+        plan.add(off.occupancy_offset, sizeof (occupancies40d), offsetof(mapblock40d, occupancy));
+        plan.add(off.biome_stuffs, sizeof (biome_indices40d), offsetof(mapblock40d, biome_indices));
+        plan.add(off.global_feature_offset, sizeof (int16_t), offsetof(mapblock40d, global_feature));
+        plan.add(off.local_feature_offset, sizeof (int16_t), offsetof(mapblock40d, local_feature));
+        plan.add(off.mystery, sizeof (int32_t), offsetof(mapblock40d, mystery));
+        // the flags are behind a pointer at the start of the block
+        d->flags_ptr_field = plan.add(0, sizeof (uint32_t));
+        // it's all one object. one read covering the whole layout beats several smaller ones
+        plan.setMaxGap(0xFFFFFFFF);
+        d->temperature_plan.add(off.temperature1_offset, sizeof (t_temperatures));
+        d->temperature_plan.add(off.temperature2_offset, sizeof (t_temperatures));
+        d->temperature_plan.setMaxGap(0xFFFFFFFF);
+        d->feature_plan.add(off.global_feature_offset, sizeof (int16_t));
+        d->feature_plan.add(off.local_feature_offset, sizeof (int16_t));
+        d->feature_plan.setMaxGap(0xFFFFFFFF);
         try
         {
             OffsetGroup *OG_Geology = OG_Maps->getGroup("geology");
@@ -300,6 +349,37 @@ Maps::~Maps()
     delete d;
 }
 
+// the map pointer, map size and region position, in one batch
+enum
+{
+    map_global_pointer,
+    map_global_x_count,
+    map_global_y_count,
+    map_global_z_count,
+    map_global_region_x,
+    map_global_region_y,
+    map_global_region_z,
+    map_global_count
+};
+
+void Maps::Private::readGlobals(uint32_t * globals)
+{
+    t_offsets & off = offsets;
+    const uint32_t addresses[map_global_count] =
+    {
+        off.map_offset, off.x_count_offset, off.y_count_offset, off.z_count_offset,
+        off.region_x_offset, off.region_y_offset, off.region_z_offset
+    };
+    t_readop ops[map_global_count];
+    for(int i = 0; i < map_global_count; i++)
+    {
+        ops[i].address = addresses[i];
+        ops[i].length = sizeof (uint32_t);
+        ops[i].buffer = (uint8_t *) &globals[i];
+    }
+    owner->readBatchMerged(ops, map_global_count);
+}
+
 /*-----------------------------------*
  *  Init the mapblock pointer array  *
  *-----------------------------------*/
@@ -313,8 +393,11 @@ bool Maps::Start()
     Process *p = d->owner;
     Private::t_offsets &off = d->offsets;
 
+    uint32_t globals[map_global_count];
+    d->readGlobals(globals);
+
     // get the map pointer
-    uint32_t x_array_loc = p->readDWord (off.map_offset);
+    uint32_t x_array_loc = globals[map_global_pointer];
     if (!x_array_loc)
     {
         return false;
@@ -322,9 +405,9 @@ bool Maps::Start()
 
     // get the size
     uint32_t mx, my, mz;
-    mx = d->x_block_count = p->readDWord (off.x_count_offset);
-    my = d->y_block_count = p->readDWord (off.y_count_offset);
-    mz = d->z_block_count = p->readDWord (off.z_count_offset);
+    mx = d->x_block_count = globals[map_global_x_count];
+    my = d->y_block_count = globals[map_global_y_count];
+    mz = d->z_block_count = globals[map_global_z_count];
 
     // test for wrong map dimensions
     if (mx == 0 || mx > 48 || my == 0 || my > 48 || mz == 0)
@@ -335,34 +418,68 @@ bool Maps::Start()
         //return false;
     }
 
-    // read position of the region inside DF world
-    p->readDWord (off.region_x_offset, (uint32_t &) d->regionX);
-    p->readDWord (off.region_y_offset, (uint32_t &) d->regionY);
-    p->readDWord (off.region_z_offset, (uint32_t &) d->regionZ);
+    // position of the region inside DF world
+    d->regionX = globals[map_global_region_x];
+    d->regionY = globals[map_global_region_y];
+    d->regionZ = globals[map_global_region_z];
 
-    // alloc array for pointers to all blocks
-    d->block = new uint32_t[mx*my*mz];
-    uint32_t *temp_x = new uint32_t[mx];
-    uint32_t *temp_y = new uint32_t[my];
+    // x array -> y columns -> z columns, one batch per level
+    vector <uint32_t> & temp_x = d->x_columns;
+    temp_x.resize(mx);
+    p->read (x_array_loc, mx * sizeof (uint32_t), (uint8_t *) &temp_x[0]);
 
-    p->read (x_array_loc, mx * sizeof (uint32_t), (uint8_t *) temp_x);
+    vector <uint32_t> temp_y(mx * my);
+    vector <t_readop> ops(mx);
     for (uint32_t x = 0; x < mx; x++)
     {
-        p->read (temp_x[x], my * sizeof (uint32_t), (uint8_t *) temp_y);
-        // y -> map column
-        for (uint32_t y = 0; y < my; y++)
-        {
-            p->read (temp_y[y],
-                   mz * sizeof (uint32_t),
-                   (uint8_t *) (d->block + x*my*mz + y*mz));
-        }
+        ops[x].address = temp_x[x];
+        ops[x].length = my * sizeof (uint32_t);
+        ops[x].buffer = (uint8_t *) &temp_y[x * my];
+    }
+    p->readBatchMerged(&ops[0], ops.size());
+
+    // alloc array for pointers to all blocks
+    d->block = new uint32_t[mx*my*mz];
+    ops.resize(mx * my);
+    for (uint32_t i = 0; i < mx * my; i++)
+    {
+        ops[i].address = temp_y[i];
+        ops[i].length = mz * sizeof (uint32_t);
+        ops[i].buffer = (uint8_t *) (d->block + i * mz);
     }
-    delete [] temp_x;
-    delete [] temp_y;
+    p->readBatchMerged(&ops[0], ops.size());
+
+    d->x_array_loc = x_array_loc;
     d->Started = true;
     return true;
 }
 
+bool Maps::Refresh()
+{
+    if(!d->Started)
+        return Start();
+
+    Process *p = d->owner;
+    uint32_t globals[map_global_count];
+    d->readGlobals(globals);
+    if(globals[map_global_pointer] != d->x_array_loc
+        || globals[map_global_x_count] != d->x_block_count
+        || globals[map_global_y_count] != d->y_block_count
+        || globals[map_global_z_count] != d->z_block_count)
+        return Start();
+
+    // DF allocates the whole table when it loads the map. same x array means same table
+    vector <uint32_t> temp_x(d->x_block_count);
+    p->read (d->x_array_loc, temp_x.size() * sizeof (uint32_t), (uint8_t *) &temp_x[0]);
+    if(temp_x != d->x_columns)
+        return Start();
+
+    d->regionX = globals[map_global_region_x];
+    d->regionY = globals[map_global_region_y];
+    d->regionZ = globals[map_global_region_z];
+    return true;
+}
+
 // getter for map size
 void Maps::getSize (uint32_t& x, uint32_t& y, uint32_t& z)
 {
@@ -388,6 +505,8 @@ bool Maps::Finish()
         delete [] d->block;
         d->block = NULL;
     }
+    d->x_columns.clear();
+    d->Started = false;
     return true;
 }
 
@@ -418,22 +537,485 @@ bool Maps::ReadBlock40d(uint32_t x, uint32_t y, uint32_t z, mapblock40d * buffer
     uint32_t addr = d->block[x*d->y_block_count*d->z_block_count + y*d->z_block_count + z];
     if (addr)
     {
+        // everything but the flags in one go
+        d->block_plan.read(p, addr, buffer);
         buffer->position = DFCoord(x,y,z);
-        p->read (addr + d->offsets.tile_type_offset, sizeof (buffer->tiletypes), (uint8_t *) buffer->tiletypes);
-        p->read (addr + d->offsets.designation_offset, sizeof (buffer->designation), (uint8_t *) buffer->designation);
-        p->read (addr + d->offsets.occupancy_offset, sizeof (buffer->occupancy), (uint8_t *) buffer->occupancy);
-        p->read (addr + d->offsets.biome_stuffs, sizeof (biome_indices40d), (uint8_t *) buffer->biome_indices);
-        p->readWord(addr + d->offsets.global_feature_offset, (uint16_t&) buffer->global_feature);
-        p->readWord(addr + d->offsets.local_feature_offset, (uint16_t&)buffer->local_feature);
-        p->readDWord(addr + d->offsets.mystery, (uint32_t&)buffer->mystery);
         buffer->origin = addr;
-        uint32_t addr_of_struct = p->readDWord(addr);
-        buffer->blockflags.whole = p->readDWord(addr_of_struct);
+        buffer->blockflags.whole = p->readDWord(d->block_plan.get<uint32_t>(0, d->flags_ptr_field));
         return true;
     }
     return false;
 }
 
+/*
+ * Bulk block reading
+ */
+
+// hook up the maps module of the SHM server, if we have one
+bool Maps::Private::initSHMExport()
+{
+    if(shmTried)
+        return hasSHMExport;
+    shmTried = true;
+    char * shm = d->shm_start;
+    if(!shm || !owner->getModuleIndex("Maps", MAPS_VERSION, maps_module))
+        return false;
+    // the server only needs the map and block offsets
+    Server::Maps::maps_offsets * init = (Server::Maps::maps_offsets *) (shm + SHM_HEADER);
+    memset(init, 0, sizeof(Server::Maps::maps_offsets));
+    init->map_offset = offsets.map_offset;
+    init->x_count_offset = offsets.x_count_offset;
+    init->y_count_offset = offsets.y_count_offset;
+    init->z_count_offset = offsets.z_count_offset;
+    init->tile_type_offset = offsets.tile_type_offset;
+    init->designation_offset = offsets.designation_offset;
+    init->occupancy_offset = offsets.occupancy_offset;
+    init->biome_stuffs = offsets.biome_stuffs;
+    init->temperature1_offset = offsets.temperature1_offset;
+    init->temperature2_offset = offsets.temperature2_offset;
+    init->global_feature_offset = offsets.global_feature_offset;
+    init->local_feature_offset = offsets.local_feature_offset;
+    if(!owner->SetAndWait(Server::Maps::MAP_INIT + (maps_module << 16)))
+        return false;
+    hasSHMExport = true;
+    return true;
+}
+
+namespace {
+    // what the fallback path of ReadBlocks gathers for one block
+    struct t_exportrec
+    {
+        mapblock40d block;
+        t_temperatures temp1;
+        t_temperatures temp2;
+    };
+    inline const char * importPart(void * dest, const char * part, size_t size)
+    {
+        memcpy(dest, part, size);
+        return part + size;
+    }
+}
+
+size_t Maps::Private::planParts(GatherPlan & plan, uint32_t mask)
+{
+    t_offsets &off = offsets;
+    if(mask & BLOCK_TILETYPES)
+        plan.add(off.tile_type_offset, sizeof (tiletypes40d), offsetof(mapblock40d, tiletypes));
+    if(mask & BLOCK_DESIGNATIONS)
+        plan.add(off.designation_offset, sizeof (designations40d), offsetof(mapblock40d, designation));
+    if(mask & BLOCK_OCCUPANCY)
+        plan.add(off.occupancy_offset, sizeof (occupancies40d), offsetof(mapblock40d, occupancy));
+    if(mask & BLOCK_TEMPERATURES)
+    {
+        plan.add(off.temperature1_offset, sizeof (t_temperatures), offsetof(t_exportrec, temp1));
+        plan.add(off.temperature2_offset, sizeof (t_temperatures), offsetof(t_exportrec, temp2));
+    }
+    if(mask & BLOCK_BIOME)
+        plan.add(off.biome_stuffs, sizeof (biome_indices40d), offsetof(mapblock40d, biome_indices));
+    if(mask & BLOCK_FEATURES)
+    {
+        plan.add(off.global_feature_offset, sizeof (int16_t), offsetof(mapblock40d, global_feature));
+        plan.add(off.local_feature_offset, sizeof (int16_t), offsetof(mapblock40d, local_feature));
+    }
+    return plan.add(0, sizeof (uint32_t));
+}
+
+bool Maps::ReadBlocks(const t_blockbox & box, uint32_t mask, BlockSink & sink)
+{
+    MAPS_GUARD
+    Process *p = d->owner;
+    uint32_t x2 = box.x2 < d->x_block_count ? box.x2 : d->x_block_count - 1;
+    uint32_t y2 = box.y2 < d->y_block_count ? box.y2 : d->y_block_count - 1;
+    uint32_t z2 = box.z2 < d->z_block_count ? box.z2 : d->z_block_count - 1;
+    if(box.x1 > x2 || box.y1 > y2 || box.z1 > z2)
+        return true;
+    bool temps = mask & BLOCK_TEMPERATURES;
+    t_exportrec rec = t_exportrec();
+
+    if(d->initSHMExport())
+    {
+        char * shm = d->d->shm_start;
+        Server::Maps::shm_maps_hdr * hdr = (Server::Maps::shm_maps_hdr *) shm;
+        uint32_t recsize = Server::Maps::exportRecordSize(mask);
+        uint32_t cursor = 0;
+        vector <char> window;
+        do
+        {
+            hdr->x = box.x1;
+            hdr->y = box.y1;
+            hdr->z = box.z1;
+            hdr->x2 = x2;
+            hdr->y2 = y2;
+            hdr->z2 = z2;
+            hdr->mask = mask;
+            hdr->cursor = cursor;
+            if(!p->SetAndWait(Server::Maps::MAP_EXPORT_RANGE + (d->maps_module << 16)) || hdr->error)
+                return false;
+            cursor = hdr->cursor;
+            uint32_t count = hdr->count;
+            // the sink may talk to the server too, get the records out of its way
+            window.resize(count * recsize + 1);
+            memcpy(&window[0], shm + SHM_HEADER, count * recsize);
+            const char * record = &window[0];
+            for(uint32_t i = 0; i < count; i++, record += recsize)
+            {
+                const Server::Maps::shm_blockrecord * head = (const Server::Maps::shm_blockrecord *) record;
+                mapblock40d & block = rec.block;
+                block.position = DFCoord(head->x, head->y, head->z);
+                block.origin = head->origin;
+                block.blockflags.whole = head->flags;
+                const char * part = record + sizeof(Server::Maps::shm_blockrecord);
+                if(mask & BLOCK_TILETYPES)
+                    part = importPart(&block.tiletypes, part, sizeof(tiletypes40d));
+                if(mask & BLOCK_DESIGNATIONS)
+                    part = importPart(&block.designation, part, sizeof(designations40d));
+                if(mask & BLOCK_OCCUPANCY)
+                    part = importPart(&block.occupancy, part, sizeof(occupancies40d));
+                if(temps)
+                {
+                    part = importPart(&rec.temp1, part, sizeof(t_temperatures));
+                    part = importPart(&rec.temp2, part, sizeof(t_temperatures));
+                }
+                if(mask & BLOCK_BIOME)
+                    part = importPart(&block.biome_indices, part, sizeof(biome_indices40d));
+                if(mask & BLOCK_FEATURES)
+                {
+                    part = importPart(&block.global_feature, part, sizeof(int16_t));
+                    part = importPart(&block.local_feature, part, sizeof(int16_t));
+                }
+                sink.block(block, temps ? &rec.temp1 : 0, temps ? &rec.temp2 : 0);
+            }
+        } while (cursor);
+        return true;
+    }
+
+    // no server, gather the parts of a z column of blocks at a time
+    GatherPlan plan;
+    size_t flags_ptr = d->planParts(plan, mask);
+
+    uint32_t sz = z2 - box.z1 + 1;
+    vector <uint32_t> bases(sz);
+    vector <uint32_t> zs(sz);
+    vector <t_exportrec> recs(sz, rec);
+    vector <t_readop> flags(sz);
+    for(uint32_t x = box.x1; x <= x2; x++)
+    {
+        for(uint32_t y = box.y1; y <= y2; y++)
+        {
+            const uint32_t * column = d->block + x*d->y_block_count*d->z_block_count + y*d->z_block_count;
+            size_t n = 0;
+            for(uint32_t z = box.z1; z <= z2; z++)
+            {
+                if(column[z])
+                {
+                    bases[n] = column[z];
+                    zs[n++] = z;
+                }
+            }
+            if(!n)
+                continue;
+            plan.read(p, &bases[0], n, &recs[0], sizeof(t_exportrec));
+            // the flags are behind a pointer, fetch them for the whole column at once
+            for(size_t i = 0; i < n; i++)
+            {
+                flags[i].address = plan.get<uint32_t>(i, flags_ptr);
+                flags[i].length = sizeof(uint32_t);
+                flags[i].buffer = (uint8_t *) &recs[i].block.blockflags.whole;
+            }
+            p->readBatch(&flags[0], n);
+            for(size_t i = 0; i < n; i++)
+            {
+                recs[i].block.position = DFCoord(x, y, zs[i]);
+                recs[i].block.origin = bases[i];
+                sink.block(recs[i].block, temps ? &recs[i].temp1 : 0, temps ? &recs[i].temp2 : 0);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Parallel block reading
+ */
+
+namespace {
+    // the vein vectors of more blocks than this are garbage
+    const uint32_t max_block_veins = 4096;
+
+    /*
+     * Reads the z columns of the map in parallel. Worker w takes every count-th column
+     * starting with column w, so the workers get about the same amount of underground.
+     */
+    class AllBlocksTask : public WorkerTask
+    {
+        public:
+            AllBlocksTask(const uint32_t * table, uint32_t mx, uint32_t my, uint32_t mz, uint32_t mask, ParallelBlockSink & sink)
+            : table(table), columns(mx * my), my(my), mz(mz), mask(mask), sink(sink)
+            {
+                failed = false;
+                flags_ptr = vein_field = 0;
+                mineral_vptr = 0;
+            };
+            const uint32_t * table;
+            uint32_t columns, my, mz;
+            uint32_t mask;
+            ParallelBlockSink & sink;
+            vector <ProcessReader *> readers;
+            // every worker makes its own copy, a plan keeps the data of the last read
+            GatherPlan plan;
+            size_t flags_ptr;
+            // first and last pointer of the vein vector, when reading veins
+            size_t vein_field;
+            uint32_t mineral_vptr;
+            // set by any worker that fails, never cleared
+            volatile bool failed;
+
+            void run(uint32_t worker)
+            {
+                try
+                {
+                    readColumns(worker);
+                }
+                catch (exception &)
+                {
+                    failed = true;
+                }
+            }
+        private:
+            void readColumns(uint32_t worker)
+            {
+                ProcessReader * r = readers[worker];
+                GatherPlan own = plan;
+                bool temps = mask & BLOCK_TEMPERATURES;
+                bool want_veins = mask & BLOCK_VEINS;
+                t_exportrec rec = t_exportrec();
+                vector <uint32_t> bases(mz);
+                vector <uint32_t> zs(mz);
+                vector <t_exportrec> recs(mz, rec);
+                vector <t_readop> ops;
+                vector < vector <t_vein> > veins(want_veins ? mz : 0);
+                vector <uint32_t> vein_ptrs;
+                vector <uint32_t> vein_counts(mz);
+                vector <t_vein> vein_data;
+                for(uint32_t column = worker; column < columns && !failed; column += readers.size())
+                {
+                    const uint32_t * blocks = table + column * mz;
+                    size_t n = 0;
+                    for(uint32_t z = 0; z < mz; z++)
+                    {
+                        if(blocks[z])
+                        {
+                            bases[n] = blocks[z];
+                            zs[n++] = z;
+                        }
+                    }
+                    if(!n)
+                        continue;
+                    own.read(r, &bases[0], n, &recs[0], sizeof(t_exportrec));
+                    // the flags are behind a pointer, fetch them for the whole column at once
+                    ops.resize(n);
+                    for(size_t i = 0; i < n; i++)
+                    {
+                        ops[i].address = own.get<uint32_t>(i, flags_ptr);
+                        ops[i].length = sizeof(uint32_t);
+                        ops[i].buffer = (uint8_t *) &recs[i].block.blockflags.whole;
+                    }
+                    r->readBatch(&ops[0], n);
+                    if(want_veins)
+                        readVeins(r, own, n, bases, vein_counts, vein_ptrs, vein_data, ops, veins);
+                    uint32_t x = column / my;
+                    uint32_t y = column % my;
+                    for(size_t i = 0; i < n; i++)
+                    {
+                        recs[i].block.position = DFCoord(x, y, zs[i]);
+                        recs[i].block.origin = bases[i];
+                        sink.block(worker, recs[i].block, temps ? &recs[i].temp1 : 0, temps ? &recs[i].temp2 : 0,
+                                   want_veins ? &veins[i] : 0);
+                    }
+                }
+            }
+            // the vein pointers of all the blocks in one batch, then all the veins in another
+            void readVeins(ProcessReader * r, GatherPlan & own, size_t n, const vector <uint32_t> & bases,
+                           vector <uint32_t> & counts, vector <uint32_t> & ptrs, vector <t_vein> & data,
+                           vector <t_readop> & ops, vector < vector <t_vein> > & veins)
+            {
+                uint32_t total = 0;
+                for(size_t i = 0; i < n; i++)
+                {
+                    const uint32_t * triplet = (const uint32_t *) own.field(i, vein_field);
+                    uint32_t count = triplet[1] > triplet[0] ? (triplet[1] - triplet[0]) / sizeof(uint32_t) : 0;
+                    counts[i] = count <= max_block_veins ? count : 0;
+                    total += counts[i];
+                }
+                ptrs.resize(total);
+                data.resize(total);
+                ops.clear();
+                for(size_t i = 0, first = 0; i < n; first += counts[i], i++)
+                {
+                    if(!counts[i])
+                        continue;
+                    const uint32_t * triplet = (const uint32_t *) own.field(i, vein_field);
+                    t_readop op = {triplet[0], counts[i] * (uint32_t) sizeof(uint32_t), (uint8_t *) &ptrs[first]};
+                    ops.push_back(op);
+                }
+                if(!ops.empty())
+                    r->readBatch(&ops[0], ops.size());
+                ops.resize(total);
+                for(uint32_t i = 0; i < total; i++)
+                {
+                    ops[i].address = ptrs[i];
+                    ops[i].length = sizeof(t_vein);
+                    ops[i].buffer = (uint8_t *) &data[i];
+                }
+                if(total)
+                    r->readBatch(&ops[0], total);
+                for(size_t i = 0, first = 0; i < n; first += counts[i], i++)
+                {
+                    veins[i].clear();
+                    for(uint32_t j = first; j < first + counts[i]; j++)
+                    {
+                        if(data[j].vtable != mineral_vptr)
+                            continue;
+                        data[j].address_of = ptrs[j];
+                        veins[i].push_back(data[j]);
+                    }
+                }
+            }
+    };
+
+    // runs a ParallelBlockSink on the calling thread, for processes that can't give out readers
+    class SerialBlockSink : public BlockSink
+    {
+        public:
+            SerialBlockSink(Maps * maps, bool want_veins, ParallelBlockSink & sink)
+            : maps(maps), want_veins(want_veins), sink(sink) {};
+            void block(const mapblock40d & block, const t_temperatures * temp1, const t_temperatures * temp2)
+            {
+                if(want_veins)
+                    maps->ReadVeins(block.position.x, block.position.y, block.position.z, &veins);
+                sink.block(0, block, temp1, temp2, want_veins ? &veins : 0);
+            }
+        private:
+            Maps * maps;
+            bool want_veins;
+            ParallelBlockSink & sink;
+            vector <t_vein> veins;
+    };
+}
+
+bool Maps::ReadAllBlocks(uint32_t mask, uint32_t threads, ParallelBlockSink & sink)
+{
+    MAPS_GUARD
+    Process *p = d->owner;
+    Private::t_offsets &off = d->offsets;
+    bool want_veins = mask & BLOCK_VEINS;
+    if(threads == 0)
+        threads = 1;
+
+    AllBlocksTask task(d->block, d->x_block_count, d->y_block_count, d->z_block_count, mask, sink);
+    // without the vtable of mineral veins, only ReadVeins can tell them apart
+    bool parallel = !want_veins || off.vein_mineral_vptr;
+    for(uint32_t i = 0; parallel && i < threads; i++)
+    {
+        ProcessReader * r = p->createReader();
+        if(r)
+            task.readers.push_back(r);
+        else
+            parallel = false;
+    }
+    if(!parallel)
+    {
+        for(size_t i = 0; i < task.readers.size(); i++)
+            delete task.readers[i];
+        t_blockbox everything = {0, 0, 0, d->x_block_count - 1, d->y_block_count - 1, d->z_block_count - 1};
+        SerialBlockSink serial(this, want_veins, sink);
+        return ReadBlocks(everything, mask & BLOCK_ALL, serial);
+    }
+
+    task.flags_ptr = d->planParts(task.plan, mask);
+    if(want_veins)
+    {
+        task.vein_field = task.plan.add(off.veinvector + d->OG_vector->getOffset("start"), 2 * sizeof(uint32_t));
+        task.mineral_vptr = off.vein_mineral_vptr;
+    }
+    runWorkers(task, threads);
+    for(size_t i = 0; i < task.readers.size(); i++)
+        delete task.readers[i];
+    return !task.failed;
+}
+
+/*
+ * Change journal
+ */
+
+bool Maps::StartJournal(uint32_t mask, uint32_t interval, uint32_t budget)
+{
+    if(!d->initSHMExport())
+        return false;
+    char * shm = d->d->shm_start;
+    Server::Maps::shm_maps_hdr * hdr = (Server::Maps::shm_maps_hdr *) shm;
+    hdr->mask = mask;
+    hdr->x = interval;
+    hdr->y = budget;
+    if(!d->owner->SetAndWait(Server::Maps::MAP_JOURNAL_START + (d->maps_module << 16)) || hdr->error)
+        return false;
+    // the server tells us where the journal is relative to our lane
+    d->journal = (Server::Maps::shm_journal *) (shm + hdr->address);
+    return true;
+}
+
+bool Maps::StopJournal()
+{
+    if(!d->journal)
+        return false;
+    d->journal = 0;
+    return d->owner->SetAndWait(Server::Maps::MAP_JOURNAL_STOP + (d->maps_module << 16));
+}
+
+bool Maps::PollChangedBlocks(uint32_t & since, vector<t_blockchange> & out)
+{
+    out.clear();
+    Server::Maps::shm_journal * journal = d->journal;
+    if(!journal || !d->owner->isAttached())
+        return false;
+    uint32_t capacity = journal->capacity;
+    uint32_t head = journal->head;
+    full_barrier
+    // the server doesn't wait for anyone, older entries are gone
+    uint32_t first = since;
+    bool lost = head - first > capacity;
+    if(lost)
+        first = head - capacity;
+    out.reserve(head - first + 1);
+    t_blockchange change;
+    change.everything = false;
+    for(uint32_t seq = first; seq != head; seq++)
+    {
+        const Server::Maps::shm_blockchange & entry = journal->entries[seq % capacity];
+        change.position = DFCoord(entry.x, entry.y, entry.z);
+        change.frame = entry.frame;
+        change.everything = entry.everything;
+        out.push_back(change);
+    }
+    full_barrier
+    // anything the server overwrote while we copied is garbage
+    uint32_t lapped = journal->head - capacity;
+    if((int32_t)(lapped - first) > 0)
+    {
+        lost = true;
+        out.erase(out.begin(), out.begin() + min<uint32_t>(lapped - first, out.size()));
+    }
+    if(lost)
+    {
+        change.position = DFCoord(0, 0, 0);
+        change.frame = journal->frame;
+        change.everything = true;
+        out.insert(out.begin(), change);
+    }
+    since = head;
+    return true;
+}
+
 /*
  * Tiletypes
  */
@@ -590,9 +1172,15 @@ bool Maps::ReadTemperatures(uint32_t x, uint32_t y, uint32_t z, t_temperatures *
     uint32_t addr = d->block[x*d->y_block_count*d->z_block_count + y*d->z_block_count + z];
     if (addr)
     {
-        if(temp1)
+        if(temp1 && temp2)
+        {
+            d->temperature_plan.read(d->owner, addr, 0);
+            memcpy(temp1, d->temperature_plan.field(0, 0), sizeof (t_temperatures));
+            memcpy(temp2, d->temperature_plan.field(0, 1), sizeof (t_temperatures));
+        }
+        else if(temp1)
             d->owner->read (addr + d->offsets.temperature1_offset, sizeof (t_temperatures), (uint8_t *) temp1);
-        if(temp2)
+        else if(temp2)
             d->owner->read (addr + d->offsets.temperature2_offset, sizeof (t_temperatures), (uint8_t *) temp2);
         return true;
     }
@@ -825,9 +1413,9 @@ bool Maps::ReadFeatures(uint32_t x, uint32_t y, uint32_t z, int16_t & local, int
     uint32_t addr = d->block[x*d->y_block_count*d->z_block_count + y*d->z_block_count + z];
     if (addr)
     {
-        Process * p = d->owner;
-        p->readWord(addr + d->offsets.global_feature_offset, (uint16_t&) global);
-        p->readWord(addr + d->offsets.local_feature_offset, (uint16_t&)local);
+        d->feature_plan.read(d->owner, addr, 0);
+        global = d->feature_plan.get<int16_t>(0, 0);
+        local = d->feature_plan.get<int16_t>(0, 1);
         return true;
     }
     return false;
@@ -945,7 +1533,7 @@ bool Maps::ReadVeins(uint32_t x, uint32_t y, uint32_t z, vector <t_vein>* veins,
     if (!addr) return false;
     // veins are stored as a vector of pointers to veins
     /*pointer is 4 bytes! we work with a 32bit program here, no matter what architecture we compile khazad for*/
-    DfVector <uint32_t> p_veins (p, addr + off.veinvector);
+    DfVector <uint32_t> p_veins (p, addr + off.veinvector, &d->vein_pool);
     uint32_t size = p_veins.size();
     // read all veins
     for (uint32_t i = 0; i < size;i++)
@@ -1223,10 +1811,12 @@ bool Maps::ReadVegetation(uint32_t x, uint32_t y, uint32_t z, std::vector<dfh_pl
 
     Private::t_offsets &off = d->offsets;
     DfVector<uint32_t> vegptrs(d->owner, addr + off.vegvector);
+    DfPtrVector<t_plant> sdata;
+    sdata.read(d->owner, vegptrs, off.tree_desc_offset);
     for(size_t i = 0; i < vegptrs.size(); i++)
     {
         d->d->readName(shrubbery.name,vegptrs[i]);
-        d->owner->read (vegptrs[i] + off.tree_desc_offset, sizeof (t_plant), (uint8_t *) &shrubbery.sdata);
+        shrubbery.sdata = sdata[i];
         shrubbery.address = vegptrs[i];
         plants->push_back(shrubbery);
     }
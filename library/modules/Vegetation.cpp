@@ -51,6 +51,9 @@ struct Vegetation::Private
     uint32_t tree_desc_offset;
     // translation
     DfVector <uint32_t> * p_veg;
+    // all the plants, read in bulk by the first Read after Start
+    DfPtrVector <t_plant> plants;
+    bool plantsRead;
 
     DFContextShared *d;
     Process * owner;
@@ -64,6 +67,8 @@ Vegetation::Vegetation(DFContextShared * d_)
     d->owner = d_->p;
     d->d = d_;
     d->Inited = d->Started = false;
+    d->p_veg = 0;
+    d->plantsRead = false;
     OffsetGroup * OG_Veg = d->d->offset_descriptor->getGroup("Vegetation");
     d->vegetation_vector = OG_Veg->getAddress ("vector");
     d->tree_desc_offset = OG_Veg->getOffset ("tree_desc_offset");
@@ -82,6 +87,7 @@ bool Vegetation::Start(uint32_t & numplants)
     if(!d->Inited)
         return false;
     d->p_veg = new DfVector <uint32_t> (d->owner, d->vegetation_vector);
+    d->plantsRead = false;
     numplants = d->p_veg->size();
     d->Started = true;
     return true;
@@ -94,9 +100,14 @@ bool Vegetation::Read (const uint32_t index, dfh_plant & shrubbery)
         return false;
     // read pointer from vector at position
     uint32_t temp = d->p_veg->at (index);
+    if(!d->plantsRead)
+    {
+        d->plants.read(d->owner, *d->p_veg, d->tree_desc_offset);
+        d->plantsRead = true;
+    }
     // read from memory
     d->d->readName(shrubbery.name,temp);
-    d->owner->read (temp + d->tree_desc_offset, sizeof (t_plant), (uint8_t *) &shrubbery.sdata);
+    shrubbery.sdata = d->plants[index];
     shrubbery.address = temp;
     return true;
 }
@@ -106,6 +117,10 @@ bool Vegetation::Write (dfh_plant & shrubbery)
     if(!d->Started)
         return false;
     d->owner->write (shrubbery.address + d->tree_desc_offset, sizeof (t_plant), (uint8_t *) &shrubbery.sdata);
+    // keep the copy in line
+    int32_t index = d->plantsRead ? d->plants.find(shrubbery.address) : -1;
+    if(index != -1)
+        d->plants[index] = shrubbery.sdata;
     return true;
 }
 
@@ -117,6 +132,8 @@ bool Vegetation::Finish()
         delete d->p_veg;
         d->p_veg = 0;
     }
+    d->plants.clear();
+    d->plantsRead = false;
     d->Started = false;
     return true;
 }
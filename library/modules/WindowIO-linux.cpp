@@ -32,6 +32,7 @@ using namespace std;
 
 #include <X11/Xlib.h>   //need for X11 functions
 #include <X11/keysym.h>
+#include <unistd.h>
 #include "ContextShared.h"
 #include "ModuleFactory.h"
 
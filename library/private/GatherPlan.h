@@ -0,0 +1,109 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#pragma once
+
+#ifndef GATHER_PLAN_H_INCLUDED
+#define GATHER_PLAN_H_INCLUDED
+
+#include <vector>
+
+namespace DFHack
+{
+    class Process;
+    class ProcessReader;
+    class OffsetGroup;
+    struct t_readop;
+    /**
+     * Reads a set of fields of DF objects with as few reads as possible.
+     * Fields are declared once as (offset in the DF object, size, offset in the output struct).
+     * Fields closer than the gap threshold are fetched by one covering span, all spans of
+     * all the objects go out as one batch and get scattered into the output structs.
+     * Spans of different objects close to each other are merged, see Process::readBatchMerged.
+     */
+    class GatherPlan
+    {
+        public:
+            /// for fields that are only needed through field()
+            static const size_t no_dest = (size_t) -1;
+
+            GatherPlan(uint32_t max_gap = 64);
+            /**
+             * declare a field
+             * @return field index for field()
+             */
+            size_t add(int32_t offset, uint32_t size, size_t dest = no_dest);
+            /// declare a field by its name in an OffsetGroup. throws like OffsetGroup::getOffset
+            size_t add(OffsetGroup * group, const char * name, uint32_t size, size_t dest = no_dest);
+            /// fields further apart than this many bytes are read separately
+            void setMaxGap(uint32_t max_gap);
+
+            /// read the fields of one object into out
+            void read(Process * p, uint32_t base, void * out);
+            /// read the fields of count objects into an array of output structs. out may be 0
+            void read(Process * p, const uint32_t * bases, size_t count, void * out, size_t stride);
+            /// same, through a reader of another thread. the plan belongs to that thread then
+            void read(ProcessReader * r, const uint32_t * bases, size_t count, void * out, size_t stride);
+            /// raw data of a field of the nth object of the last read
+            const uint8_t * field(size_t object, size_t index) const;
+            template <typename T>
+            T get(size_t object, size_t index) const
+            {
+                return *(const T *) field(object, index);
+            }
+
+            size_t numFields() const { return fields.size(); };
+            /// number of reads issued per object
+            size_t numSpans();
+        private:
+            void plan();
+            /// size the data for count objects and make the reads filling it. false if there's nothing to read
+            bool prepare(const uint32_t * bases, size_t count, std::vector<t_readop> & ops);
+            /// copy the fields with a destination out of the data
+            void scatter(size_t count, void * out, size_t out_stride);
+            struct t_field
+            {
+                int32_t offset;
+                uint32_t size;
+                size_t dest;
+                // where the field ends up in the gathered data of one object
+                uint32_t position;
+            };
+            struct t_span
+            {
+                int32_t offset;
+                uint32_t size;
+                uint32_t position;
+            };
+            std::vector<t_field> fields;
+            std::vector<t_span> spans;
+            // bytes gathered per object
+            uint32_t stride;
+            uint32_t max_gap;
+            bool planned;
+            std::vector<uint8_t> data;
+    };
+}
+#endif
@@ -27,10 +27,13 @@ distribution.
 #ifndef LINUX_PROCESS_H_INCLUDED
 #define LINUX_PROCESS_H_INCLUDED
 
+#include <set>
 #include "dfhack/DFProcess.h"
 
 namespace DFHack
 {
+    class PageCache;
+    class WriteBuffer;
     class LinuxProcessBase : public Process
     {
         protected:
@@ -41,6 +44,22 @@ namespace DFHack
             bool attached:1;
             bool suspended:1;
             bool identified:1;
+            // false if process_vm_readv isn't available, we fall back to pread
+            bool use_vm_readv:1;
+            bool use_vm_writev:1;
+            // 0 unless enabled by setReadCache
+            PageCache * cache;
+            void readDirect(uint32_t address, uint32_t length, uint8_t* buffer);
+            void readBatchDirect(const t_readop * ops, size_t n);
+            // pages in prefetched were counted as misses when they got fetched, they don't count as hits
+            void readCached(uint32_t address, uint32_t length, uint8_t* buffer, const std::set<uint32_t> * prefetched = 0);
+            // call whenever DF gets to run again
+            void invalidateCache();
+            // last seen contents of /proc/PID/maps, for rangeIndex
+            string maps_text;
+            bool ranges_stale:1;
+            // 0 unless enabled by setWriteBuffer
+            WriteBuffer * wbuf;
         public:
             LinuxProcessBase(uint32_t pid);
             ~LinuxProcessBase();
@@ -61,6 +80,15 @@ namespace DFHack
 
             void read( uint32_t address, uint32_t length, uint8_t* buffer);
             void write(uint32_t address, uint32_t length, uint8_t* buffer);
+            void readBatch(const t_readop * ops, size_t n);
+            ProcessReader * createReader();
+            bool readTolerant(uint32_t address, uint32_t length, uint8_t* buffer,
+                              std::vector<bool> & pages, uint8_t fill = 0xCC);
+
+            bool setReadCache(bool enable, uint32_t max_pages = 1024);
+            bool getReadCacheStats(uint64_t & hits, uint64_t & misses);
+            bool setWriteBuffer(bool enable);
+            void commitWrites();
 
             const std::string readCString (uint32_t offset);
 
@@ -74,6 +102,7 @@ namespace DFHack
 
             bool getThreadIDs(std::vector<uint32_t> & threads );
             void getMemRanges(std::vector<t_memrange> & ranges );
+            const t_memrange * rangeOf(uint32_t address);
             // get module index by name and version. bool 1 = error
             bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT) { OUTPUT=0; return false;};
             // get the SHM start if available
@@ -0,0 +1,84 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#ifndef PAGE_CACHE_H_INCLUDED
+#define PAGE_CACHE_H_INCLUDED
+
+#include <list>
+#include <map>
+
+namespace DFHack
+{
+    /**
+     * Bounded LRU cache of fixed-size memory pages.
+     * Doesn't know where the pages come from, the owner fills them after insert()
+     * and throws everything away with clear() when the pages can't be trusted anymore.
+     */
+    class PageCache
+    {
+        public:
+            enum
+            {
+                page_size = 4096,
+                page_mask = ~(page_size - 1)
+            };
+            PageCache(uint32_t max_pages);
+            ~PageCache();
+
+            /// get a cached page, counts a hit. 0 if the page isn't cached
+            uint8_t * find(uint32_t page);
+            /// like find, without counting a hit. for pages that were just inserted and counted as a miss
+            uint8_t * peek(uint32_t page);
+            /// is the page cached? counts nothing and leaves the LRU order alone
+            bool contains(uint32_t page) const { return pages.count(page) != 0; };
+            /// get storage for a page, evicting the least recently used one if full. counts a miss
+            uint8_t * insert(uint32_t page);
+            /// drop a single page (after a failed fill)
+            void erase(uint32_t page);
+            /// drop all pages
+            void clear();
+            /// update the cached pages overlapping a written area
+            void write(uint32_t address, uint32_t length, const uint8_t * source);
+
+            void setCapacity(uint32_t max_pages);
+            uint32_t getCapacity() { return max_pages; };
+
+            uint64_t hits;
+            uint64_t misses;
+        private:
+            struct t_page
+            {
+                uint8_t * data;
+                std::list<uint32_t>::iterator lru;
+            };
+            typedef std::map<uint32_t, t_page> page_map;
+            page_map pages;
+            // most recently used first
+            std::list<uint32_t> lru;
+            uint32_t max_pages;
+    };
+}
+#endif
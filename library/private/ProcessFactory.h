@@ -27,6 +27,7 @@ distribution.
 
 #include "dfhack/DFProcess.h"
 #include "dfhack/VersionInfoFactory.h"
+#include "dfhack/DFContextManager.h"
 
 namespace DFHack
 {
@@ -35,5 +36,19 @@ namespace DFHack
 #ifdef LINUX_BUILD
     Process* createWineProcess(uint32_t pid, VersionInfoFactory * factory);
 #endif
+    // open a snapshot file created by writeSnapshot
+    Process* createSnapshotProcess(const std::string & path, VersionInfoFactory * factory);
+    // capture all the memory of a suspended process into a file.
+    // with a parent, only the pages that changed since the parent are stored
+    bool writeSnapshot(Process * p, const std::string & path, const std::string & parent = "");
+    // wrap a process, recording everything read from it and written to it into a trace file.
+    // the wrapped process isn't deleted along with the recorder, unless adopted.
+    // 0 if the file can't be created
+    Process* createTraceRecorder(Process * inner, const std::string & path);
+    void adoptTracedProcess(Process * recorder);
+    // serve the memory recorded by a trace recorder
+    Process* createTraceReplay(const std::string & path, VersionInfoFactory * factory);
+    // a fake DF with generated contents, see ContextManager::OpenSynthetic
+    Process* createSyntheticProcess(const t_synthetic_params & params, VersionInfoFactory * factory);
 }
 #endif
@@ -67,6 +67,11 @@ namespace DFHack
 
         void read( uint32_t address, uint32_t length, uint8_t* buffer);
         void write(uint32_t address, uint32_t length, uint8_t* buffer);
+        // as many reads as fit into the SHM go over in one command
+        void readBatch(const t_readop * ops, size_t n);
+        uint32_t gatherVector(uint32_t address, int32_t offset, uint32_t length, std::vector<uint8_t> & out);
+        bool scan(const std::vector<t_memrange> & ranges, const t_scanquery & query, std::vector<uint64_t> & found);
+        bool filter(const std::vector<t_memrange> & ranges, const t_scanquery & query, std::vector<uint64_t> & found);
 
         const std::string readSTLString (uint32_t offset);
         size_t readSTLString (uint32_t offset, char * buffer, size_t bufcapacity);
@@ -90,7 +95,7 @@ namespace DFHack
         std::string getPath();
         // get module index by name and version. bool 1 = error
         bool getModuleIndex (const char * name, const uint32_t version, uint32_t & OUTPUT);
-        // get the SHM start if available
+        // get the start of our SHM lane if available
         char * getSHMStart (void);
         bool SetAndWait (uint32_t state);
     private:
@@ -112,6 +117,10 @@ namespace DFHack
         bool locked;
         bool identified;
         bool useYield;
+        bool useFutex;
+        uint32_t spin;
+        // slots for streamed transfers, 1 = no streaming
+        uint32_t slots;
         
         uint8_t vector_start;
 
@@ -133,6 +142,13 @@ namespace DFHack
 
         bool Aux_Core_Attach(bool & versionOK, pid_t& PID);
         bool SetAndWait (uint32_t state);
+        // SetAndWait in two halves, so we can work while the server does
+        void Post (uint32_t state);
+        bool Wait (uint32_t state);
+        // wait for the server to move a stream counter up to target
+        void StreamWait (volatile uint32_t & counter, uint32_t target);
+        // clean up and throw SHMServerDisappeared
+        void ServerDisappeared();
         bool GetLocks();
         bool AreLocksOk();
         void FreeLocks();
@@ -142,11 +158,13 @@ namespace DFHack
 // some helpful macros to keep the code bloat in check
 #define SHMCMD ( (uint32_t *) shm_addr)[attachmentIdx]
 #define D_SHMCMD ( (uint32_t *) (d->shm_addr))[d->attachmentIdx]
+#define SLEEPERS SHM_SLEEPERS(shm_addr)
 
-#define SHMHDR ((shm_core_hdr *)shm_addr)
-#define D_SHMHDR ((shm_core_hdr *)(d->shm_addr))
+// header and data are in our own lane
+#define SHMHDR ((shm_core_hdr *)SHM_LANE(shm_addr, attachmentIdx))
+#define D_SHMHDR ((shm_core_hdr *)SHM_LANE(d->shm_addr, d->attachmentIdx))
 
-#define SHMDATA(type) ((type *)(shm_addr + SHM_HEADER))
-#define D_SHMDATA(type) ((type *)(d->shm_addr + SHM_HEADER))
+#define SHMDATA(type) ((type *)(SHM_LANE(shm_addr, attachmentIdx) + SHM_HEADER))
+#define D_SHMDATA(type) ((type *)(SHM_LANE(d->shm_addr, d->attachmentIdx) + SHM_HEADER))
 
 #endif
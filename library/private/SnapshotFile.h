@@ -0,0 +1,95 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#ifndef SNAPSHOT_FILE_H_INCLUDED
+#define SNAPSHOT_FILE_H_INCLUDED
+
+/*
+ * On-disk layout of a memory snapshot:
+ *
+ * t_snapshot_header
+ * t_snapshot_range * num_ranges
+ * page contents, starting at SNAPSHOT_ALIGN, SNAPSHOT_PAGE bytes each
+ * for each captured range: page hash table, page offset table
+ *
+ * Both tables have one uint64_t per page of the range. The offset table
+ * points at the page contents in this file. A delta snapshot only stores
+ * the pages whose hash differs from its parent, the rest have offset
+ * SNAPSHOT_PARENT_PAGE and are looked up in the parent by address.
+ */
+namespace DFHack
+{
+    #define SNAPSHOT_MAGIC "DFHSNAP"
+    // increment on every change
+    #define SNAPSHOT_VERSION 2
+    #define SNAPSHOT_ALIGN 4096
+    #define SNAPSHOT_PAGE 4096
+    // page offset table entries that don't point into the file
+    #define SNAPSHOT_PARENT_PAGE 0ULL
+    #define SNAPSHOT_BAD_PAGE (~0ULL)
+
+    enum snapshot_range_flags
+    {
+        SNAP_READ = 1,
+        SNAP_WRITE = 2,
+        SNAP_EXECUTE = 4,
+        SNAP_SHARED = 8,
+        // the range has page tables
+        SNAP_CAPTURED = 16
+    };
+
+    struct t_snapshot_header
+    {
+        char magic[8];
+        uint32_t version;
+        // identity of the captured process, see VersionInfo
+        uint32_t os;
+        uint32_t pe;
+        uint32_t base;
+        char md5[40];
+        uint32_t pid;
+        uint32_t num_ranges;
+        char path[1024];
+        // 0 for a full snapshot, parent generation + 1 for a delta
+        uint32_t generation;
+        uint32_t reserved;
+        // path of the parent snapshot, empty for a full snapshot
+        char parent[1024];
+    };
+
+    struct t_snapshot_range
+    {
+        uint64_t start;
+        uint64_t end;
+        // file offsets of the page hash and page offset tables
+        uint64_t hashes;
+        uint64_t pages;
+        uint32_t flags;
+        uint32_t reserved;
+        char name[1024];
+    };
+}
+#endif
@@ -0,0 +1,97 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#ifndef TRACE_FILE_H_INCLUDED
+#define TRACE_FILE_H_INCLUDED
+
+/*
+ * On-disk layout of a read trace:
+ *
+ * t_trace_header
+ * records until the end of the file
+ *
+ * Every record starts with a 9 byte packed header: uint8_t type,
+ * uint32_t address, uint32_t length, followed by length bytes of data.
+ * All integers are little endian.
+ */
+namespace DFHack
+{
+    // fills the whole magic, no terminator
+    #define TRACE_MAGIC "DFHTRACE"
+    // increment on every change
+    #define TRACE_VERSION 1
+    #define TRACE_RECORD_HEADER 9
+
+    enum trace_record_type
+    {
+        // memory as returned by read and friends
+        TRACE_READ = 1,
+        // memory as passed to write and friends
+        TRACE_WRITE,
+        // result of readSTLString, the data is the string
+        TRACE_STL_STRING,
+        // string passed to writeSTLString
+        TRACE_WRITE_STL_STRING,
+        // result of readCString
+        TRACE_C_STRING,
+        // result of doReadClassName, address is the vtable pointer
+        TRACE_CLASSNAME,
+        // result of readSTLVector, the data is a t_vecTriplet
+        TRACE_STL_VECTOR,
+        // triplet passed to writeSTLVector
+        TRACE_WRITE_STL_VECTOR,
+        // result of getMemRanges. address is the number of ranges, the data is
+        // uint64_t start, uint64_t end, uint32_t flags, uint32_t name length, name
+        TRACE_MEMRANGES,
+        // markers, no data
+        TRACE_SUSPEND,
+        TRACE_RESUME
+    };
+
+    // t_memrange flags in TRACE_MEMRANGES
+    enum trace_range_flags
+    {
+        TRACE_RANGE_READ = 1,
+        TRACE_RANGE_WRITE = 2,
+        TRACE_RANGE_EXECUTE = 4,
+        TRACE_RANGE_SHARED = 8
+    };
+
+    struct t_trace_header
+    {
+        char magic[8];
+        uint32_t version;
+        // identity of the traced process, see VersionInfo
+        uint32_t os;
+        uint32_t pe;
+        uint32_t base;
+        char md5[40];
+        uint32_t pid;
+        uint32_t reserved;
+        char path[1024];
+    };
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#pragma once
+
+#ifndef WORKER_THREADS_H_INCLUDED
+#define WORKER_THREADS_H_INCLUDED
+
+namespace DFHack
+{
+    /**
+     * Work split among a few threads, see runWorkers.
+     * Exceptions must not leave run(), there's nobody to catch them on the other threads.
+     */
+    class WorkerTask
+    {
+        public:
+            virtual ~WorkerTask(){};
+            /// do the share of the work of worker number 'worker'
+            virtual void run(uint32_t worker) = 0;
+    };
+    /**
+     * run workers 0 to count - 1 of a task and wait for all of them. worker 0 runs on the
+     * calling thread, the others on threads of their own. workers that don't get a thread
+     * run on the calling thread after worker 0, so the whole task always gets done.
+     */
+    void runWorkers(WorkerTask & task, uint32_t count);
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+www.sourceforge.net/projects/dfhack
+Copyright (c) 2009 Petr Mrázek (peterix), Kenneth Ferland (Impaler[WrG]), dorf
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#ifndef WRITE_BUFFER_H_INCLUDED
+#define WRITE_BUFFER_H_INCLUDED
+
+#include <map>
+#include <vector>
+
+namespace DFHack
+{
+    /**
+     * Pending writes, kept sorted by address. Overlapping and adjacent writes
+     * are merged into one span, later writes win.
+     */
+    class WriteBuffer
+    {
+        public:
+            typedef std::map<uint32_t, std::vector<uint8_t> > span_map;
+
+            /// add a write
+            void add(uint32_t address, uint32_t length, const uint8_t * source);
+            /// patch freshly read memory with the pending writes
+            void overlay(uint32_t address, uint32_t length, uint8_t * target);
+            bool empty() { return spans.empty(); };
+            void clear() { spans.clear(); };
+            const span_map & getSpans() { return spans; };
+        private:
+            span_map spans;
+    };
+}
+#endif
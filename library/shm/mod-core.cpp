@@ -32,6 +32,7 @@ distribution.
 #include <string.h>
 #include <string>
 #include <vector>
+#include <map>
 
 #define SHM_INTERNAL // for things only visible to the SHM
 
@@ -39,6 +40,7 @@ distribution.
 #include "mod-core.h"
 #include "mod-maps.h"
 #include "mod-creature40d.h"
+#include "dfhack/DFProcess.h"
 
 std::vector <DFPP_module> module_registry;
 
@@ -49,11 +51,18 @@ extern int shmid;
 
 // file-globals
 bool useYield = 0;
+bool useFutex[SHM_MAX_CLIENTS] = {0};
+uint32_t spin = SHM_SPIN_START;
 int currentClient = -1;
+// the lane of currentClient, the modules work with this one
+char *shm_lane = 0;
+// client that wrote something since it suspended DF. nobody else writes until it resumes
+int writer = -1;
 
-#define SHMHDR ((shm_core_hdr *)shm)
+#define SHMHDR ((shm_core_hdr *)shm_lane)
 #define SHMCMD ((uint32_t *)shm )[currentClient]
-#define SHMDATA(type) ((type *)(shm + SHM_HEADER))
+#define SLEEPERS SHM_SLEEPERS(shm)
+#define SHMDATA(type) ((type *)(shm_lane + SHM_HEADER))
 
 void ReadRaw (void * data)
 {
@@ -121,10 +130,236 @@ void WriteSTLString (void * data)
     myStringPtr->assign( SHMDATA(const char) );
 }
 
+// all the reads in one go. the data goes right behind the descriptors, in order
+void ReadBatch (void * data)
+{
+    uint32_t count = SHMHDR->value;
+    shm_readop * ops = SHMDATA(shm_readop);
+    char * out = SHMDATA(char) + count * sizeof(shm_readop);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        memcpy(out, (void *) ops[i].address, ops[i].length);
+        out += ops[i].length;
+    }
+}
+
+// chase the pointers of a vector, copy the same slice of every object. null pointers give zeros
+void Gather (void * data)
+{
+    shm_gather * gather = SHMDATA(shm_gather);
+    uint32_t ** triplet = (uint32_t **) gather->vector;
+    uint32_t total = triplet[1] - triplet[0];
+    uint32_t length = gather->length;
+    uint32_t room = length ? (SHM_BODY - sizeof(shm_gather)) / length : 0;
+    uint32_t first = gather->first < total ? gather->first : total;
+    uint32_t count = total - first < room ? total - first : room;
+    char * out = (char *) (gather + 1);
+    for(uint32_t i = first; i < first + count; i++)
+    {
+        uint32_t object = triplet[0][i];
+        if(object)
+            memcpy(out, (char *) object + gather->offset, length);
+        else
+            memset(out, 0, length);
+        out += length;
+    }
+    gather->count = count;
+    gather->total = total;
+}
+
+/*
+ * Scans. The client hands us the readable ranges, we never touch anything outside of them.
+ */
+
+// the range containing address, 0 if there's none. ranges are sorted
+const shm_scanrange * scanRangeOf(const shm_scanrange * ranges, uint32_t numranges, uint32_t address)
+{
+    uint32_t lo = 0, hi = numranges;
+    while(lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if(ranges[mid].start <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo && address < ranges[lo - 1].end)
+        return &ranges[lo - 1];
+    return 0;
+}
+
+// does the thing at address match? 'end' is the end of the range it's in
+inline bool scanMatch(const shm_scan * scan, const shm_scanrange * ranges, const char * needle, uint32_t address, uint32_t end)
+{
+    const char * hay = (const char *) address;
+    switch(scan->kind)
+    {
+        case DFHack::SCAN_BYTES:
+            return end - address >= scan->size && memcmp(hay, needle, scan->size) == 0;
+        case DFHack::SCAN_INT:
+            if(end - address < scan->size)
+                return false;
+            switch(scan->size)
+            {
+                case 1: return *(uint8_t *) hay == (uint8_t) scan->value;
+                case 2: return *(uint16_t *) hay == (uint16_t) scan->value;
+                case 4: return *(uint32_t *) hay == (uint32_t) scan->value;
+                default: return *(uint64_t *) hay == scan->value;
+            }
+        case DFHack::SCAN_VECTOR:
+        {
+            if(end - address < 3 * sizeof(uint32_t))
+                return false;
+            const uint32_t * triplet = (const uint32_t *) hay;
+            if(triplet[0] > triplet[1] || triplet[1] > triplet[2])
+                return false;
+            if(scan->value != DFHack::SCAN_ANY_LENGTH)
+                return triplet[1] - triplet[0] == scan->value;
+            // any length: all three have to be in the same range
+            const shm_scanrange * r = scanRangeOf(ranges, scan->numranges, triplet[0]);
+            return r == scanRangeOf(ranges, scan->numranges, triplet[1])
+                && r == scanRangeOf(ranges, scan->numranges, triplet[2]);
+        }
+        case DFHack::SCAN_STRING:
+        {
+            // a pointer to the zero terminated needle
+            if(end - address < sizeof(uint32_t))
+                return false;
+            uint32_t target = *(const uint32_t *) hay;
+            const shm_scanrange * r = scanRangeOf(ranges, scan->numranges, target);
+            if(!r || r->end - target <= scan->size)
+                return false;
+            const char * str = (const char *) target;
+            return memcmp(str, needle, scan->size) == 0 && str[scan->size] == 0;
+        }
+    }
+    return false;
+}
+
+void Scan (void * data)
+{
+    shm_scan * scan = SHMDATA(shm_scan);
+    const shm_scanrange * ranges = (const shm_scanrange *) (scan + 1);
+    const char * needle = (const char *) (ranges + scan->numranges);
+    uint32_t * addresses = (uint32_t *) (needle + ((scan->size + 3) & ~3));
+    uint32_t room = (SHMDATA(char) + SHM_BODY - (char *) addresses) / sizeof(uint32_t);
+    uint32_t count = 0;
+    if(scan->numcandidates)
+    {
+        // filter, the matches go over the candidates
+        for(uint32_t i = 0; i < scan->numcandidates; i++)
+        {
+            const shm_scanrange * r = scanRangeOf(ranges, scan->numranges, addresses[i]);
+            if(r && addresses[i] - (uint32_t) (uint64_t) shm >= SHM_SIZE
+                && scanMatch(scan, ranges, needle, addresses[i], r->end))
+                addresses[count++] = addresses[i];
+        }
+        scan->count = count;
+        return;
+    }
+    uint32_t increment = scan->increment ? scan->increment : 1;
+    uint32_t budget = SHM_SCAN_BUDGET;
+    uint32_t shmStart = (uint32_t) (uint64_t) shm;
+    uint32_t range = scan->range;
+    uint32_t offset = scan->offset;
+    while(range < scan->numranges && count < room && budget)
+    {
+        uint32_t start = ranges[range].start;
+        uint32_t end = ranges[range].end;
+        uint32_t address = start + offset;
+        for(; address < end && count < room && budget; address += increment, budget--)
+        {
+            // we'd find the needle in the request itself
+            if(address - shmStart < SHM_SIZE)
+                continue;
+            if(scanMatch(scan, ranges, needle, address, end))
+                addresses[count++] = address;
+        }
+        if(address >= end)
+        {
+            range++;
+            offset = 0;
+        }
+        else
+        {
+            offset = address - start;
+        }
+    }
+    scan->range = range;
+    scan->offset = offset;
+    scan->count = count;
+}
+
+// wait until the client moves a stream counter up to target. false if the client went away
+bool StreamWait (volatile uint32_t & counter, uint32_t target)
+{
+    uint32_t cnt = 0;
+    while(counter < target)
+    {
+        CPU_RELAX
+        if(++cnt == 100000)
+        {
+            if(!isValidSHM(currentClient))
+                return false;
+            cnt = 0;
+        }
+    }
+    full_barrier
+    return true;
+}
+
+// fill the slots in turn, never more than one round ahead of the client
+void ReadStream (void * data)
+{
+    uint32_t slots = SHMHDR->value;
+    uint32_t slotsize = SHM_BODY / slots;
+    char * address = (char *) SHMHDR->address;
+    uint32_t left = SHMHDR->length;
+    SHMHDR->error = false;
+    for(uint32_t chunk = 0; left; chunk++)
+    {
+        if(chunk >= slots && !StreamWait(SHMHDR->drained, chunk - slots + 1))
+        {
+            SHMHDR->error = true;
+            return;
+        }
+        uint32_t size = left < slotsize ? left : slotsize;
+        memcpy(SHMDATA(char) + (chunk % slots) * slotsize, address, size);
+        full_barrier
+        SHMHDR->filled = chunk + 1;
+        address += size;
+        left -= size;
+    }
+}
+
+// take the chunks out of the slots as the client puts them in
+void WriteStream (void * data)
+{
+    uint32_t slots = SHMHDR->value;
+    uint32_t slotsize = SHM_BODY / slots;
+    char * address = (char *) SHMHDR->address;
+    uint32_t left = SHMHDR->length;
+    SHMHDR->error = false;
+    for(uint32_t chunk = 0; left; chunk++)
+    {
+        if(!StreamWait(SHMHDR->filled, chunk + 1))
+        {
+            SHMHDR->error = true;
+            return;
+        }
+        uint32_t size = left < slotsize ? left : slotsize;
+        memcpy(address, SHMDATA(char) + (chunk % slots) * slotsize, size);
+        full_barrier
+        SHMHDR->drained = chunk + 1;
+        address += size;
+        left -= size;
+    }
+}
+
 // MIT HAKMEM bitcount
 int bitcount(uint32_t n)
 {
-    register uint32_t tmp;
+    uint32_t tmp;
     
     tmp = n - ((n >> 1) & 033333333333) - ((n >> 2) & 011111111111);
     return ((tmp + (tmp >> 3)) & 030707070707) % 63;
@@ -138,6 +373,14 @@ void CoreAttach (void * data)
     uint32_t remote = SHMDATA(coreattach)->cl_affinity;
     uint32_t pool = local | remote;
     SHMDATA(coreattach)->sv_useYield = useYield = (bitcount(pool) == 1);
+    // sleep on the command word instead of spinning, if both sides can
+    SHMDATA(coreattach)->sv_useFutex = useFutex[currentClient] = SHM_HAS_FUTEX && SHMDATA(coreattach)->cl_useFutex;
+    // streamed transfers only pay off when both sides can run at the same time
+    uint32_t slots = SHMDATA(coreattach)->cl_slots;
+    if(slots > SHM_MAX_SLOTS) slots = SHM_MAX_SLOTS;
+    if(slots < 1 || useYield) slots = 1;
+    SHMDATA(coreattach)->sv_slots = slots;
+    SLEEPERS->client[currentClient] = 0;
     // return our PID
     SHMDATA(coreattach)->sv_PID = OS_getPID();
     // return core version
@@ -230,16 +473,25 @@ DFPP_module InitCore(void)
     core.set_command(CORE_READ_BYTE, FUNCTION,"Read BYTE",ReadByte, CORE_SUSPENDED);
     
     // raw writes
-    core.set_command(CORE_WRITE, FUNCTION, "Raw write", WriteRaw, CORE_SUSPENDED);
-    core.set_command(CORE_WRITE_QUAD, FUNCTION, "Write QUAD", WriteQuad, CORE_SUSPENDED);
-    core.set_command(CORE_WRITE_DWORD, FUNCTION, "Write DWORD", WriteDWord, CORE_SUSPENDED);
-    core.set_command(CORE_WRITE_WORD, FUNCTION, "Write WORD", WriteWord, CORE_SUSPENDED);
-    core.set_command(CORE_WRITE_BYTE, FUNCTION, "Write BYTE", WriteByte, CORE_SUSPENDED);
+    core.set_command(CORE_WRITE, FUNCTION, "Raw write", WriteRaw, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    core.set_command(CORE_WRITE_QUAD, FUNCTION, "Write QUAD", WriteQuad, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    core.set_command(CORE_WRITE_DWORD, FUNCTION, "Write DWORD", WriteDWord, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    core.set_command(CORE_WRITE_WORD, FUNCTION, "Write WORD", WriteWord, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    core.set_command(CORE_WRITE_BYTE, FUNCTION, "Write BYTE", WriteByte, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
     
     // stl string commands
     core.set_command(CORE_READ_STL_STRING, FUNCTION, "Read STL string", ReadSTLString, CORE_SUSPENDED);
     core.set_command(CORE_READ_C_STRING, CLIENT_WAIT, "RESERVED");
-    core.set_command(CORE_WRITE_STL_STRING, FUNCTION, "Write STL string", WriteSTLString, CORE_SUSPENDED);
+    core.set_command(CORE_WRITE_STL_STRING, FUNCTION, "Write STL string", WriteSTLString, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+
+    // batches
+    core.set_command(CORE_READ_BATCH, FUNCTION, "Read batch", ReadBatch, CORE_SUSPENDED);
+    core.set_command(CORE_GATHER, FUNCTION, "Gather from a vector of pointers", Gather, CORE_SUSPENDED);
+    core.set_command(CORE_SCAN, FUNCTION, "Scan memory", Scan, CORE_SUSPENDED);
+
+    // streams
+    core.set_command(CORE_READ_STREAM, FUNCTION, "Read stream", ReadStream, CORE_SUSPENDED);
+    core.set_command(CORE_WRITE_STREAM, FUNCTION, "Write stream", WriteStream, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
     return core;
 }
 
@@ -248,7 +500,7 @@ void InitModules (void)
     // create the core module
     module_registry.push_back(InitCore());
     module_registry.push_back(DFHack::Server::Maps::Init());
-    //module_registry.push_back(DFHack::Server::Creatures::Init());
+    module_registry.push_back(DFHack::Server::Creatures::Init());
     for(int i = 0; i < module_registry.size();i++)
     {
         fprintf(stderr,"Initialized module %s, version %d\n",module_registry[i].name.c_str(),module_registry[i].version);
@@ -266,99 +518,179 @@ void KillModules (void)
     module_registry.clear();
 }
 
-void SHM_Act (void)
+enum
 {
-    volatile uint32_t atomic = 0;
-    if(errorstate)
+    SERVE_DONE, // the client lets DF run
+    SERVE_WORKED, // we ran a command
+    SERVE_IDLE // nothing to do until the client (or the writer) moves
+};
+
+// handle whatever the current client has for us, in its own lane
+int ServeClient (void)
+{
+    // this is very important! copying two words separately from the command variable leads to inconsistency.
+    // Always copy the thing in one go.
+    // Also, this whole SHM thing probably only works on intel processors
+    volatile uint32_t atomic = SHMCMD;
+    full_barrier
+
+    DFPP_module & mod = module_registry[ ((shm_cmd)atomic).parts.module ];
+    DFPP_command & cmd = mod.commands[ ((shm_cmd)atomic).parts.command ];
+    if(cmd.type == CLIENT_WAIT)
     {
-        return;
+        return SERVE_IDLE;
     }
-    //static uint oldcl = 88;
-    for(currentClient = 0; currentClient < SHM_MAX_CLIENTS;currentClient++)
+    // writes are serialized, the other clients can only read until the writer resumes DF
+    if(cmd.access == ACCESS_EXCLUSIVE)
     {
-        // set the offset for the shared memory used for the client
-        uint32_t numwaits = 0;
-        check_again: // goto target!!!
-        if(numwaits == 10000)
+        if(writer != -1 && writer != currentClient)
         {
-            // this tests if there's a process on the other side
-            if(isValidSHM(currentClient))
-            {
-                numwaits = 0;
-            }
-            else
-            {
-                full_barrier
-                SHMCMD = CORE_RUNNING;
-                fprintf(stderr,"dfhack: Broke out of loop, other process disappeared.\n");
-            }
+            return SERVE_IDLE;
         }
-        full_barrier // I don't want the compiler to reorder my code.
+        writer = currentClient;
+    }
 
+    // set next state BEFORE we act on the command - good for locks
+    if(cmd.locking == LOCKING_LOCKS)
+    {
+        if(cmd.nextState != -1)
+        {
+            SHMCMD = cmd.nextState;
+            SHM_wake(&SHMCMD, &SLEEPERS->client[currentClient]);
+        }
+    }
 
-        //fprintf(stderr,"%d: %x %x\n",currentClient, (uint) SHMHDR, (uint) &(SHMHDR->cmd[currentClient]));
-        
-        // this is very important! copying two words separately from the command variable leads to inconsistency.
-        // Always copy the thing in one go.
-        // Also, this whole SHM thing probably only works on intel processors
-        atomic  = SHMCMD;
-        full_barrier
-        
-        DFPP_module & mod = module_registry[ ((shm_cmd)atomic).parts.module ];
-        DFPP_command & cmd = mod.commands[ ((shm_cmd)atomic).parts.command ];
-        /*
-        if(atomic == CORE_RUNNING)
+    if(cmd._function)
+    {
+        cmd._function(mod.modulestate);
+    }
+    full_barrier
+
+    // set next state AFTER we act on the command - good for busy waits
+    if(cmd.locking == LOCKING_BUSY)
+    {
+        // FIXME: WHAT HAPPENS WHEN A 'NEXTSTATE' IS FROM A DIFFERENT MODULE THAN 'CORE'? Yeah. It doesn't work.
+        if(cmd.nextState != -1)
         {
-            // we are running again for this process
-            // reaquire the suspend lock
-            OS_lockSuspendLock(currentClient);
-            continue;
+            SHMCMD = cmd.nextState;
+            SHM_wake(&SHMCMD, &SLEEPERS->client[currentClient]);
         }
-        full_barrier
-        */
-        // set next state BEFORE we act on the command - good for locks
-        if(cmd.locking == LOCKING_LOCKS)
+    }
+    full_barrier
+
+    if(cmd.type == CANCELLATION)
+    {
+        if(writer == currentClient)
         {
-            if(cmd.nextState != -1) SHMCMD = cmd.nextState;
+            writer = -1;
         }
-        
-        if(cmd._function)
+        // we are running again for this process
+        // reaquire the suspend lock
+        OS_lockSuspendLock(currentClient);
+        return SERVE_DONE;
+    }
+    return SERVE_WORKED;
+}
+
+/*
+ * Every client has its own lane, so all the clients that hold DF suspended
+ * are served in the same pass, round robin. One slow client doesn't hold up
+ * the others anymore. DF stays stalled in here until none of them holds it.
+ */
+void SHM_Act (void)
+{
+    if(errorstate)
+    {
+        return;
+    }
+    // the modules' own work, once per frame
+    for(unsigned int i = 0; i < module_registry.size(); i++)
+    {
+        if(module_registry[i].frame)
         {
-            cmd._function(mod.modulestate);
+            module_registry[i].frame(module_registry[i].modulestate);
         }
+    }
+    uint32_t numwaits[SHM_MAX_CLIENTS];
+    // clients that changed state on their way out (run, step) get looked at in the next pass
+    bool stepped[SHM_MAX_CLIENTS];
+    for(int i = 0; i < SHM_MAX_CLIENTS; i++)
+    {
+        numwaits[i] = 0;
+        stepped[i] = false;
+    }
+    while(1)
+    {
+        uint32_t doorbell = SLEEPERS->doorbell;
         full_barrier
-        
-        // set next state AFTER we act on the command - good for busy waits
-        if(cmd.locking == LOCKING_BUSY)
+        bool worked = false;
+        bool waiting = false;
+        bool canSleep = true;
+        for(currentClient = 0; currentClient < SHM_MAX_CLIENTS;currentClient++)
+        {
+            if(stepped[currentClient])
+            {
+                continue;
+            }
+            shm_lane = SHM_LANE(shm, currentClient);
+            if(numwaits[currentClient] >= 10000)
+            {
+                numwaits[currentClient] = 0;
+                // this tests if there's a process on the other side
+                if(!isValidSHM(currentClient))
+                {
+                    full_barrier
+                    SHMCMD = CORE_RUNNING;
+                    useFutex[currentClient] = false;
+                    if(writer == currentClient)
+                    {
+                        writer = -1;
+                    }
+                    fprintf(stderr,"dfhack: Broke out of loop, other process disappeared.\n");
+                }
+            }
+            uint32_t before = SHMCMD;
+            switch(ServeClient())
+            {
+                case SERVE_DONE:
+                    numwaits[currentClient] = 0;
+                    stepped[currentClient] = (SHMCMD != before);
+                    break;
+                case SERVE_WORKED:
+                    numwaits[currentClient]++; // watchdog timeout
+                    worked = true;
+                    break;
+                default:
+                    numwaits[currentClient]++; // watchdog timeout
+                    waiting = true;
+                    canSleep = canSleep && useFutex[currentClient];
+                    break;
+            }
+        }
+        if(!worked && !waiting)
         {
-            /*
-            char text [512];
-            char text2 [512];
-            sprintf (text,"Client %d invoked %d:%d = %x = %s\n",currentClient,((shm_cmd)atomic).parts.module,((shm_cmd)atomic).parts.command, cmd._function,cmd.name.c_str());
-            sprintf(text2, "Server set %d\n",cmd.nextState);
-            */
-            // FIXME: WHAT HAPPENS WHEN A 'NEXTSTATE' IS FROM A DIFFERENT MODULE THAN 'CORE'? Yeah. It doesn't work.
-            if(cmd.nextState != -1) SHMCMD = cmd.nextState;
-            //MessageBox(0,text,text2, MB_OK);
-            
-            //fflush(stderr); // make sure this finds its way to the terminal!
-            
+            break;
         }
-        full_barrier
-        
-        if(cmd.type != CANCELLATION)
+        if(worked)
+        {
+            continue;
+        }
+        // nothing to do until a client says so
+        if(canSleep)
         {
-            if(useYield)
+            // spin a bit, then sleep on the doorbell
+            if(!SHM_waitChange(&SLEEPERS->doorbell, doorbell, &SLEEPERS->server, spin, useYield))
             {
-                SCHED_YIELD
+                // timed out, check on the clients
+                for(int i = 0; i < SHM_MAX_CLIENTS; i++)
+                {
+                    numwaits[i] = 10000;
+                }
             }
-            numwaits ++; // watchdog timeout
-            goto check_again;
         }
-        full_barrier
-        
-        // we are running again for this process
-        // reaquire the suspend lock
-        OS_lockSuspendLock(currentClient);
+        else if(useYield)
+        {
+            SCHED_YIELD
+        }
     }
 }
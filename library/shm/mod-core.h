@@ -26,7 +26,12 @@ distribution.
 #define SHMS_CORE_H
 
 // increment on every core change
-#define CORE_VERSION 10
+#define CORE_VERSION 17
+
+// streamed transfers split the body into at most this many slots
+#define SHM_MAX_SLOTS 8
+// and this is how many clients ask for
+#define SHM_STREAM_SLOTS 4
 
 typedef struct
 {
@@ -36,6 +41,8 @@ typedef struct
     uint32_t length;
     uint32_t error;
     uint64_t Qvalue;
+    volatile uint32_t filled; // streams: chunks put into the slots so far
+    volatile uint32_t drained; // streams: chunks taken out of the slots so far
 } shm_core_hdr;
 
 typedef struct
@@ -51,12 +58,58 @@ typedef struct
     char name[256];
 } commandlookup;
 
+// one read of CORE_READ_BATCH
+typedef struct
+{
+    uint32_t address;
+    uint32_t length;
+} shm_readop;
+
+// CORE_GATHER, at the start of the data. the elements follow it
+typedef struct
+{
+    uint32_t vector; // address of the vector's start pointer
+    int32_t offset; // what to copy, relative to every pointer in the vector
+    uint32_t length; // bytes per element
+    uint32_t first; // first element to copy
+    uint32_t count; // sv -> cl, elements copied
+    uint32_t total; // sv -> cl, size of the vector
+} shm_gather;
+
+// CORE_SCAN, at the start of the data. followed by the ranges, the needle (padded to 4 bytes)
+// and the address list: candidates going in when filtering, matches going out
+typedef struct
+{
+    uint32_t kind; // e_scankind
+    uint32_t increment; // alignment of the matches of a range scan
+    uint32_t size; // bytes of the needle: pattern, integer or string
+    uint32_t numranges; // readable memory, sorted. scans stay inside, pointers are checked against it
+    uint32_t numcandidates; // filter these addresses instead of scanning the ranges
+    uint32_t range; // range scans: where to go on. range == numranges means done
+    uint32_t offset;
+    uint32_t count; // sv -> cl, matches
+    uint64_t value; // SCAN_INT: the integer. SCAN_VECTOR: length of the vector in bytes
+} shm_scan;
+
+typedef struct
+{
+    uint32_t start;
+    uint32_t end;
+} shm_scanrange;
+
+// places one CORE_SCAN call looks at before it returns, so other clients get their turn
+#define SHM_SCAN_BUDGET (64*1024*1024)
+
 typedef struct
 {
     uint32_t sv_version; // output
     uint32_t cl_affinity; // input
     uint32_t sv_PID; // output
     uint32_t sv_useYield; // output
+    uint32_t cl_useFutex; // input
+    uint32_t sv_useFutex; // output
+    uint32_t cl_slots; // input, slots wanted for streamed transfers
+    uint32_t sv_slots; // output, slots we can use. 1 = no streaming
 } coreattach;
 
 enum CORE_COMMAND
@@ -93,6 +146,16 @@ enum CORE_COMMAND
     CORE_READ_C_STRING,// client requests contents of a C string at address, max length (0 means zero terminated)
     CORE_WRITE_STL_STRING,// client wants to set STL string at address to something
 
+    // batches
+    CORE_READ_BATCH,// cl -> sv, value = number of shm_readop descriptors at the start of the data. sv -> cl, the data packed behind them
+    CORE_GATHER,// cl -> sv, a shm_gather. sv -> cl, 'length' bytes at 'offset' of every object of the vector, as many as fit
+    CORE_SCAN,// cl -> sv, a shm_scan. sv -> cl, a page of matching addresses
+
+    // streams, address + length, value = number of slots. the body is cut into that many slots
+    // and both sides work on different slots at the same time, synchronized by filled/drained
+    CORE_READ_STREAM,// sv -> cl, the server fills slots while the client drains them
+    CORE_WRITE_STREAM,// cl -> sv, the client fills slots while the server drains them
+
     // total commands
     NUM_CORE_CMDS
 };
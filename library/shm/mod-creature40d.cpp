@@ -1,30 +1,31 @@
 #include <string>
 #include <vector>
-#include <DFIntegers.h>
+#include <dfhack/DFIntegers.h>
 
 #include "shms.h"
 #include "mod-core.h"
 #include "mod-creature40d.h"
-#include <DFTypes.h>
-#include <modules/Creatures.h>
+#include <dfhack/DFTypes.h>
+#include <dfhack/modules/Creatures.h>
 
+#include <stddef.h>
 #include <string.h>
 #include <malloc.h>
 #include <vector>
 #include <stdio.h>
 
 extern char *shm;
+extern char *shm_lane;
 
 namespace DFHack{
     namespace Server{
         namespace Creatures{ // start of namespace
 
-#define SHMHDR ((shm_creature_hdr *)shm)
-#define SHMDATA(type) ((type *)(shm + SHM_HEADER))
+#define SHMHDR ((shm_creature_hdr *)shm_lane)
+#define SHMDATA(type) ((type *)(shm_lane + SHM_HEADER))
 
-void readName(t_name & name, char * address, creature_offsets & offsets)
+void readName(shm_name & name, char * address, creature_offsets & offsets)
 {
-    // custom profession
     std::string * fname = (std::string *) (address + offsets.name_firstname_offset);
     strncpy(name.first_name,fname->c_str(),127);
     name.first_name[127] = 0;
@@ -33,7 +34,21 @@ void readName(t_name & name, char * address, creature_offsets & offsets)
     strncpy(name.nickname,nname->c_str(),127);
     name.nickname[127] = 0;
     
-    memcpy(name.words, (void *)(address + offsets.name_words_offset), 48);
+    memcpy(name.words, (void *)(address + offsets.name_words_offset), sizeof(name.words));
+    memcpy(name.parts_of_speech, (void *)(address + offsets.name_parts_offset), sizeof(name.parts_of_speech));
+    name.language = *(uint32_t *) (address + offsets.name_language_offset);
+    name.has_name = *(uint8_t *) (address + offsets.name_set_offset);
+}
+
+// DF's vectors of pointers, start and end
+inline uint32_t * vectorStart(char * address, creature_offsets & offsets)
+{
+    return *(uint32_t **) (address + offsets.vector_correct);
+}
+inline uint32_t vectorSize(char * address, creature_offsets & offsets)
+{
+    uint32_t ** triplet = (uint32_t **) (address + offsets.vector_correct);
+    return triplet[1] - triplet[0];
 }
 
 void InitOffsets (void* data)
@@ -43,98 +58,118 @@ void InitOffsets (void* data)
     ((creature_modulestate *) data)->inited = true;
 }
 
-void ReadCreatureAtIndex(void *data)
+/*
+ * Pack the parts in mask of one creature into a record at out, in e_creatureparts order.
+ */
+void ExportCreature(char * out, char * temp, uint32_t index, uint32_t mask, creature_offsets & offsets)
 {
-    creature_modulestate * state = (creature_modulestate *) data;
-    creature_offsets & offsets = state->offsets;
-    std::vector<char *> * creaturev = (std::vector<char *> *) (offsets.creature_vector + offsets.vector_correct);
-    uint32_t length = creaturev->size();
-    int32_t index = SHMHDR->index;
-    
-    // read pointer from vector at position
-    char * temp = (char *) creaturev->at (index);
-    t_creature *furball = SHMDATA(t_creature);
-    furball->origin = (uint32_t) temp;
-    //read creature from memory
-    memcpy(&(furball->x),temp + offsets.creature_pos_offset,3* sizeof(uint16_t));
-    furball->type = *(uint32_t *) (temp + offsets.creature_type_offset);
-    furball->flags1.whole = *(uint32_t *) (temp + offsets.creature_flags1_offset);
-    furball->flags2.whole = *(uint32_t *) (temp + offsets.creature_flags2_offset);
-    // names
-    
-    readName(furball->name,temp + offsets.creature_name_offset, offsets);
-    readName(furball->squad_name, temp + offsets.creature_squad_name_offset, offsets);
-    readName(furball->artifact_name, temp + offsets.creature_artifact_name_offset, offsets);
-    
-    // custom profession
-    std::string * custprof = (std::string *) (temp + offsets.creature_custom_profession_offset);
-    strncpy(furball->custom_profession,custprof->c_str(),127);
-    furball->custom_profession[127] = 0;
-
-    // labors
-    memcpy(furball->labors, temp + offsets.creature_labors_offset, NUM_CREATURE_LABORS);
-    
-    // traits
-    memcpy(furball->traits, temp + offsets.creature_traits_offset, sizeof (uint16_t) * NUM_CREATURE_TRAITS);
-
-    typedef struct
+    memset(out, 0, exportCreatureSize(mask));
+    shm_creaturerecord * rec = (shm_creaturerecord *) out;
+    rec->origin = (uint32_t) (uint64_t) temp;
+    rec->index = index;
+    out += sizeof(shm_creaturerecord);
+    if(mask & CREATURE_BASIC)
     {
-        uint8_t id;
-        junk_fill <3> fill1;
-        uint8_t rating;
-        junk_fill <3> fill2;
-        uint16_t experience;
-    } raw_skill;
-    // learned skills
-    std::vector <void *> * skillv = (std::vector <void *> *) (temp + offsets.creature_skills_offset + offsets.vector_correct);
-    furball->numSkills = skillv->size();
-    for (uint32_t i = 0; i < furball->numSkills;i++)
+        shm_creature_basic * basic = (shm_creature_basic *) out;
+        basic->id = *(uint32_t *) (temp + offsets.creature_id_offset);
+        memcpy(&(basic->x),temp + offsets.creature_pos_offset,3* sizeof(uint16_t));
+        basic->race = *(uint32_t *) (temp + offsets.creature_race_offset);
+        basic->civ = *(int32_t *) (temp + offsets.creature_civ_offset);
+        basic->sex = *(uint8_t *) (temp + offsets.creature_sex_offset);
+        basic->caste = *(uint16_t *) (temp + offsets.creature_caste_offset);
+        basic->flags1 = *(uint32_t *) (temp + offsets.creature_flags1_offset);
+        basic->flags2 = *(uint32_t *) (temp + offsets.creature_flags2_offset);
+        basic->profession = *(uint8_t *) (temp + offsets.creature_profession_offset);
+        readName(basic->name, temp + offsets.creature_name_offset, offsets);
+        // custom profession
+        std::string * custprof = (std::string *) (temp + offsets.creature_custom_profession_offset);
+        strncpy(basic->custom_profession,custprof->c_str(),127);
+        basic->custom_profession[127] = 0;
+        out += sizeof(shm_creature_basic);
+    }
+    if(mask & CREATURE_ADVANCED)
     {
-        //skills.read(i, (uint8_t *) &temp2);
-        // a byte: this gives us 256 skills maximum.
-        furball->skills[i].id = ( (raw_skill*) skillv->at(i))->id;
-        furball->skills[i].rating = ( (raw_skill*) skillv->at(i))->rating;
-        furball->skills[i].experience = ( (raw_skill*) skillv->at(i))->experience;
+        shm_creature_advanced * adv = (shm_creature_advanced *) out;
+        adv->happiness = *(uint32_t *) (temp + offsets.creature_happiness_offset);
+        memcpy(adv->physical, temp + offsets.creature_physical_offset, sizeof(adv->physical));
+        adv->mood = *(int16_t *) (temp + offsets.creature_mood_offset);
+        adv->mood_skill = *(int16_t *) (temp + offsets.creature_mood_skill_offset);
+        adv->birth_year = *(int32_t *) (temp + offsets.creature_birth_year_offset);
+        adv->birth_time = *(uint32_t *) (temp + offsets.creature_birth_time_offset);
+        memcpy(adv->labors, temp + offsets.creature_labors_offset, NUM_CREATURE_LABORS);
+        readName(adv->artifact_name, temp + offsets.creature_artifact_name_offset, offsets);
+        char * app = temp + offsets.creature_appearance_vector_offset;
+        adv->nbcolors = vectorSize(app, offsets);
+        if(adv->nbcolors > MAX_COLORS)
+            adv->nbcolors = MAX_COLORS;
+        memcpy(adv->color, vectorStart(app, offsets), adv->nbcolors * sizeof(uint32_t));
+        out += sizeof(shm_creature_advanced);
     }
-    // profession
-    furball->profession = *(uint8_t *) (temp + offsets.creature_profession_offset);
-    // current job HACK: the job object isn't cleanly represented here
-    uint32_t jobIdAddr = *(uint32_t *) (temp + offsets.creature_current_job_offset);
-
-    if (jobIdAddr)
+    if(mask & CREATURE_SOUL)
     {
-        furball->current_job.active = true;
-        furball->current_job.jobId = *(uint8_t *) (jobIdAddr + offsets.creature_current_job_id_offset);
+        shm_creature_soul * soul = (shm_creature_soul *) out;
+        char * soulptr = (char *) (uintptr_t) *(uint32_t *) (temp + offsets.creature_default_soul_offset);
+        if(soulptr)
+        {
+            soul->has_soul = true;
+            char * skillv = soulptr + offsets.soul_skills_vector_offset;
+            uint32_t * skills = vectorStart(skillv, offsets);
+            soul->numSkills = vectorSize(skillv, offsets);
+            if(soul->numSkills > 256)
+                soul->numSkills = 256;
+            // same layout as t_skill, a byte of id and rating each
+            for(uint32_t i = 0; i < soul->numSkills; i++)
+            {
+                char * skill = (char *) (uintptr_t) skills[i];
+                soul->skills[i].id = *(uint8_t *) skill;
+                soul->skills[i].rating = *(uint8_t *) (skill + offsetof(t_skill, rating));
+                soul->skills[i].experience = *(uint16_t *) (skill + offsetof(t_skill, experience));
+            }
+            memcpy(soul->mental, soulptr + offsets.soul_mental_offset, sizeof(soul->mental));
+            memcpy(soul->traits, soulptr + offsets.soul_traits_offset, sizeof(soul->traits));
+        }
+        out += sizeof(shm_creature_soul);
     }
-    else
+    if(mask & CREATURE_JOBS)
     {
-        furball->current_job.active = false;
+        shm_creature_job * job = (shm_creature_job *) out;
+        job->occupationPtr = *(uint32_t *) (temp + offsets.creature_current_job_offset);
+        if(job->occupationPtr)
+        {
+            char * jobptr = (char *) (uintptr_t) job->occupationPtr;
+            job->jobType = *(uint8_t *) (jobptr + offsets.job_type_offset);
+            job->jobId = *(uint16_t *) (jobptr + offsets.job_id_offset);
+        }
+        out += sizeof(shm_creature_job);
     }
+}
 
-    //likes
-    std::vector <t_like *> * likev = (std::vector <t_like *> *) (temp + offsets.creature_likes_offset + offsets.vector_correct);
-    furball->numLikes = likev->size();
-    for(uint32_t i = 0;i<furball->numLikes;i++)
+void ReadCreatureAtIndex(void *data)
+{
+    creature_modulestate * state = (creature_modulestate *) data;
+    SHMHDR->count = 0;
+    // without CREATURE_INIT, there's no vector to look at
+    if(!state->inited)
     {
-        memcpy(&furball->likes[i], likev->at(i), sizeof(t_skill));
+        SHMHDR->error = true;
+        return;
     }
-
-    furball->mood = *(int16_t *) (temp + offsets.creature_mood_offset);
-
-
-    furball->happiness =  *(uint32_t *) (temp + offsets.creature_happiness_offset);
-    furball->id = *(uint32_t *) (temp + offsets.creature_id_offset);
-    furball->agility = *(uint32_t *) (temp + offsets.creature_agility_offset);
-    furball->strength = *(uint32_t *) (temp + offsets.creature_strength_offset);
-    furball->toughness = *(uint32_t *) (temp + offsets.creature_toughness_offset);
-    furball->money =  *(uint32_t *) (temp + offsets.creature_money_offset);
-    furball->squad_leader_id = *(int32_t*) (temp + offsets.creature_squad_leader_id_offset);
-    furball->sex = *(uint8_t*) (temp + offsets.creature_sex_offset);
-
-    furball->pregnancy_timer = *(uint32_t *)(temp+offsets.creature_pregnancy_offset);
-    furball->blood_max = *(int32_t*) (temp+offsets.creature_blood_max_offset);
-    furball->blood_current = *(int32_t*) (temp+offsets.creature_blood_current_offset);
-    furball->bleed_rate = *(uint32_t*) (temp+offsets.creature_bleed_offset);
+    creature_offsets & offsets = state->offsets;
+    char * creaturev = (char *) (uintptr_t) offsets.creature_vector;
+    uint32_t length = vectorSize(creaturev, offsets);
+    int32_t index = SHMHDR->index;
+    uint32_t mask = SHMHDR->mask & offsets.parts;
+    if(index < 0 || uint32_t(index) >= length)
+    {
+        SHMHDR->error = true;
+        return;
+    }
+    
+    // read pointer from vector at position
+    char * temp = (char *) (uintptr_t) vectorStart(creaturev, offsets)[index];
+    ExportCreature(SHMDATA(char), temp, index, mask, offsets);
+    SHMHDR->count = 1;
+    SHMHDR->error = false;
 }
 
 void FindNextCreatureInBox (void * data)
@@ -144,24 +179,30 @@ void FindNextCreatureInBox (void * data)
     if(index == -1) return;
         
     creature_modulestate * state = (creature_modulestate *) data;
+    if(!state->inited)
+    {
+        SHMHDR->index = -1;
+        SHMHDR->error = true;
+        return;
+    }
     creature_offsets & offsets = state->offsets;
     uint32_t x,y,z,x2,y2,z2;
     
     x = SHMHDR->x; x2 = SHMHDR->x2;
     y = SHMHDR->y; y2 = SHMHDR->y2;
-    z = SHMHDR->z; z2 = SHMHDR->x2;
+    z = SHMHDR->z; z2 = SHMHDR->z2;
 
-    std::vector<char *> * creaturev = (std::vector<char *> *) (offsets.creature_vector + offsets.vector_correct);
-    
-    uint32_t length = creaturev->size();
+    char * creaturev = (char *) (uintptr_t) offsets.creature_vector;
+    uint32_t * creatures = vectorStart(creaturev, offsets);
+    uint32_t length = vectorSize(creaturev, offsets);
     typedef uint16_t coords[3];
     
     // look at all creatures, starting at index
     // if you find one in the specified 'box', return the creature in the data
     // section and the index in the header
-    for(;index < length;index++)
+    for(;uint32_t(index) < length;index++)
     {
-        coords& coo = *(coords*) (creaturev->at(index) + offsets.creature_pos_offset);
+        coords& coo = *(coords*) ((char *) (uintptr_t) creatures[index] + offsets.creature_pos_offset);
         if(coo[0] >=x && coo[0] < x2
             && coo[1] >=y && coo[1] < y2
                 && coo[2] >=z && coo[2] < z2)
@@ -176,6 +217,41 @@ void FindNextCreatureInBox (void * data)
     SHMHDR->index = -1;
 }
 
+/*
+ * Pack as many creatures as fit into the window, starting at index. The client calls
+ * again with the returned index until it's -1.
+ */
+void ExportAll (void * data)
+{
+    creature_modulestate * state = (creature_modulestate *) data;
+    creature_offsets & offsets = state->offsets;
+    SHMHDR->count = 0;
+    if(!state->inited || SHMHDR->index < 0)
+    {
+        SHMHDR->error = true;
+        return;
+    }
+    char * creaturev = (char *) (uintptr_t) offsets.creature_vector;
+    uint32_t * creatures = vectorStart(creaturev, offsets);
+    uint32_t length = vectorSize(creaturev, offsets);
+    uint32_t mask = SHMHDR->mask & offsets.parts;
+    uint32_t recsize = exportCreatureSize(mask);
+    char * out = SHMDATA(char);
+    char * end = out + SHM_BODY;
+    uint32_t count = 0;
+    uint32_t index;
+    for(index = SHMHDR->index; index < length && out + recsize <= end; index++)
+    {
+        ExportCreature(out, (char *) (uintptr_t) creatures[index], index, mask, offsets);
+        out += recsize;
+        count++;
+    }
+    SHMHDR->index = index < length ? index : -1;
+    SHMHDR->count = count;
+    SHMHDR->total = length;
+    SHMHDR->error = false;
+}
+
 DFPP_module Init( void )
 {
     DFPP_module creatures;
@@ -190,6 +266,7 @@ DFPP_module Init( void )
     creatures.set_command(CREATURE_INIT, FUNCTION, "Supply the Creature40d module with offsets",InitOffsets,CORE_SUSPENDED);
     creatures.set_command(CREATURE_FIND_IN_BOX, FUNCTION, "Get next creature in a box, return new index or -1", FindNextCreatureInBox, CORE_SUSPENDED);
     creatures.set_command(CREATURE_AT_INDEX, FUNCTION, "Get creature at index", ReadCreatureAtIndex, CORE_SUSPENDED);
+    creatures.set_command(CREATURE_EXPORT_ALL, FUNCTION, "Export all creatures, one window at a time", ExportAll, CORE_SUSPENDED);
     
     return creatures;
 }
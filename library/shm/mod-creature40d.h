@@ -25,6 +25,13 @@ distribution.
 #ifndef MOD_CREATURES40D_H
 #define MOD_CREATURES40D_H
 
+#include <map>
+#include "dfhack/DFTypes.h"
+#include "dfhack/VersionInfo.h"
+#include "dfhack/DFProcess.h"
+#include "dfhack/modules/Materials.h"
+#include "dfhack/modules/Creatures.h"
+
 namespace DFHack
 {
     namespace Server
@@ -32,43 +39,50 @@ namespace DFHack
         namespace Creatures
         {
 
-#define CREATURES40D_VERSION 1
+#define CREATURES40D_VERSION 2
 typedef struct
 {
+    // parts of a creature the client has offsets for, e_creatureparts
+    uint32_t parts;
     // creature offsets
     uint32_t creature_vector;
+    uint32_t creature_id_offset;
     uint32_t creature_pos_offset;
-    uint32_t creature_type_offset;
+    uint32_t creature_race_offset;
+    int32_t creature_civ_offset;
+    uint32_t creature_sex_offset;
+    uint32_t creature_caste_offset;
     uint32_t creature_flags1_offset;
     uint32_t creature_flags2_offset;
+    uint32_t creature_profession_offset;
     uint32_t creature_name_offset;
     uint32_t creature_custom_profession_offset;
-    uint32_t creature_profession_offset;
-    uint32_t creature_sex_offset;
-    uint32_t creature_id_offset;
-    uint32_t creature_squad_name_offset;
-    uint32_t creature_squad_leader_id_offset;
-    uint32_t creature_money_offset;
-    uint32_t creature_current_job_offset;
-    uint32_t creature_current_job_id_offset;
-    uint32_t creature_strength_offset;
-    uint32_t creature_agility_offset;
-    uint32_t creature_toughness_offset;
-    uint32_t creature_skills_offset;
-    uint32_t creature_labors_offset;
+    // advanced
     uint32_t creature_happiness_offset;
-    uint32_t creature_traits_offset;
-    uint32_t creature_likes_offset;
-    uint32_t creature_artifact_name_offset;
+    uint32_t creature_physical_offset;
     uint32_t creature_mood_offset;
-    uint32_t creature_pregnancy_offset;
-    uint32_t creature_blood_max_offset;
-    uint32_t creature_blood_current_offset;
-    uint32_t creature_bleed_offset;
+    uint32_t creature_mood_skill_offset;
+    uint32_t creature_labors_offset;
+    uint32_t creature_birth_year_offset;
+    uint32_t creature_birth_time_offset;
+    uint32_t creature_artifact_name_offset;
+    uint32_t creature_appearance_vector_offset;
+    // soul
+    uint32_t creature_default_soul_offset;
+    uint32_t soul_skills_vector_offset;
+    uint32_t soul_mental_offset;
+    uint32_t soul_traits_offset;
+    // jobs
+    uint32_t creature_current_job_offset;
+    int32_t job_type_offset;
+    int32_t job_id_offset;
     // name offsets (needed for reading creature names)
     uint32_t name_firstname_offset;
     uint32_t name_nickname_offset;
     uint32_t name_words_offset;
+    uint32_t name_parts_offset;
+    uint32_t name_language_offset;
+    uint32_t name_set_offset;
     // HACK: vector address correction for SHM server
     int32_t vector_correct;
 } creature_offsets;
@@ -91,13 +105,112 @@ typedef struct
     uint32_t z2;
     // starting index
     int32_t index;
+    // parts to export, e_creatureparts
+    uint32_t mask;
+    // records in the window
+    uint32_t count;
+    // size of the creature vector
+    uint32_t total;
+    uint32_t error;
 } shm_creature_hdr;
 
+/*
+ * Exported creatures: a shm_creaturerecord followed by the parts in the mask,
+ * in e_creatureparts order. Every record of an export has the same size.
+ */
+typedef struct
+{
+    uint32_t origin;
+    uint32_t index; // in the creature vector
+} shm_creaturerecord;
+
+// strings are cut to 128 bytes, like in t_name
+typedef struct
+{
+    char first_name[128];
+    char nickname[128];
+    int32_t words[7];
+    uint16_t parts_of_speech[7];
+    uint32_t language;
+    uint32_t has_name;
+} shm_name;
+
+typedef struct
+{
+    uint32_t id;
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t caste;
+    uint32_t race;
+    int32_t civ;
+    uint32_t flags1;
+    uint32_t flags2;
+    uint8_t sex;
+    uint8_t profession;
+    uint16_t padding;
+    shm_name name;
+    char custom_profession[128];
+} shm_creature_basic;
+
+typedef struct
+{
+    uint32_t happiness;
+    t_attrib physical[NUM_CREATURE_PHYSICAL_ATTRIBUTES];
+    int16_t mood;
+    int16_t mood_skill;
+    int32_t birth_year;
+    uint32_t birth_time;
+    uint8_t labors[NUM_CREATURE_LABORS];
+    uint16_t padding;
+    shm_name artifact_name;
+    uint32_t nbcolors;
+    uint32_t color[MAX_COLORS];
+} shm_creature_advanced;
+
+typedef struct
+{
+    uint8_t id;
+    uint8_t rating;
+    uint16_t experience;
+} shm_skill;
+
+typedef struct
+{
+    uint32_t has_soul;
+    uint32_t numSkills;
+    t_attrib mental[NUM_CREATURE_MENTAL_ATTRIBUTES];
+    uint16_t traits[NUM_CREATURE_TRAITS];
+    shm_skill skills[256];
+} shm_creature_soul;
+
+typedef struct
+{
+    uint32_t occupationPtr;
+    uint32_t jobType;
+    uint32_t jobId;
+} shm_creature_job;
+
+inline uint32_t exportCreatureSize(uint32_t mask)
+{
+    uint32_t size = sizeof(shm_creaturerecord);
+    if(mask & CREATURE_BASIC)
+        size += sizeof(shm_creature_basic);
+    if(mask & CREATURE_ADVANCED)
+        size += sizeof(shm_creature_advanced);
+    if(mask & CREATURE_SOUL)
+        size += sizeof(shm_creature_soul);
+    if(mask & CREATURE_JOBS)
+        size += sizeof(shm_creature_job);
+    return size;
+}
+
 enum CREATURE_COMMAND
 {
     CREATURE_INIT = 0, // initialization
     CREATURE_FIND_IN_BOX,
     CREATURE_AT_INDEX,
+    CREATURE_EXPORT_ALL, // pack the whole creature vector into the window, resumable from index
     NUM_CREATURE_CMDS
 };
 DFPP_module Init(void);
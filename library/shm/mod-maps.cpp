@@ -15,6 +15,7 @@ using namespace DFHack::Server::Maps;
 #include <malloc.h>
 
 extern char *shm;
+extern char *shm_lane;
 
 //TODO: circular buffer streaming primitives required
 //TODO: commands can fail without the proper offsets. Hot to handle that?
@@ -23,9 +24,9 @@ namespace DFHack{
     namespace Server{ // start of namespace
         namespace Maps{ // start of namespace
 
-#define SHMHDR ((shm_maps_hdr *)shm)
+#define SHMHDR ((shm_maps_hdr *)shm_lane)
 #define SHMCMD ((shm_cmd *)shm)->pingpong
-#define SHMDATA(type) ((type *)(shm + SHM_HEADER))
+#define SHMDATA(type) ((type *)(shm_lane + SHM_HEADER))
 
 void NullCommand (void* data)
 {
@@ -101,6 +102,257 @@ void ReadBlockByCoords (void * data)
     ReadBlockByAddress(data); // I wonder... will this inline properly?
 }
 
+inline char * ExportPart(char * out, const char * block, uint32_t offset, uint32_t size)
+{
+    memcpy(out, block + offset, size);
+    return out + size;
+}
+
+/*
+ * Walk the block pointer array over a box (inclusive corners in x/y/z and x2/y2/z2)
+ * and pack as many blocks as fit into the window. The client calls again with the
+ * returned cursor until it reaches the end of the box.
+ */
+void ExportRange (void * data)
+{
+    maps_modulestate * state = (maps_modulestate *) data;
+    maps_offsets & offsets = state->offsets;
+    if(!state->inited)
+    {
+        SHMHDR->error = true;
+        return;
+    }
+    // clip the box to the map
+    uint32_t x1 = SHMHDR->x, y1 = SHMHDR->y, z1 = SHMHDR->z;
+    uint32_t x2 = SHMHDR->x2, y2 = SHMHDR->y2, z2 = SHMHDR->z2;
+    uint32_t mx = *(uint32_t *) (offsets.x_count_offset);
+    uint32_t my = *(uint32_t *) (offsets.y_count_offset);
+    uint32_t mz = *(uint32_t *) (offsets.z_count_offset);
+    mblock * *** mapArray = *(mblock * ****)offsets.map_offset;
+    // no map loaded
+    if(!mapArray || !mx || !my || !mz)
+    {
+        SHMHDR->error = true;
+        return;
+    }
+    if(x2 >= mx) x2 = mx - 1;
+    if(y2 >= my) y2 = my - 1;
+    if(z2 >= mz) z2 = mz - 1;
+    SHMHDR->count = 0;
+    SHMHDR->error = false;
+    if(x1 > x2 || y1 > y2 || z1 > z2)
+    {
+        SHMHDR->cursor = 0;
+        return;
+    }
+    uint32_t sy = y2 - y1 + 1;
+    uint32_t sz = z2 - z1 + 1;
+    uint32_t total = (x2 - x1 + 1) * sy * sz;
+
+    uint32_t mask = SHMHDR->mask;
+    uint32_t recsize = exportRecordSize(mask);
+    char * out = SHMDATA(char);
+    char * end = out + SHM_BODY;
+    uint32_t count = 0;
+    uint32_t index;
+    for(index = SHMHDR->cursor; index < total && out + recsize <= end; index++)
+    {
+        uint32_t z = z1 + index % sz;
+        uint32_t y = y1 + (index / sz) % sy;
+        uint32_t x = x1 + index / (sz * sy);
+        mblock * block = mapArray[x][y][z];
+        if(!block)
+            continue;
+        const char * raw = (const char *) block;
+        shm_blockrecord * rec = (shm_blockrecord *) out;
+        rec->x = x;
+        rec->y = y;
+        rec->z = z;
+        rec->padding = 0;
+        rec->flags = *block->ptr_to_dirty;
+        rec->origin = (uint32_t)(uint64_t)block;
+        char * part = out + sizeof(shm_blockrecord);
+        if(mask & BLOCK_TILETYPES)
+            part = ExportPart(part, raw, offsets.tile_type_offset, sizeof(tiletypes40d));
+        if(mask & BLOCK_DESIGNATIONS)
+            part = ExportPart(part, raw, offsets.designation_offset, sizeof(designations40d));
+        if(mask & BLOCK_OCCUPANCY)
+            part = ExportPart(part, raw, offsets.occupancy_offset, sizeof(occupancies40d));
+        if(mask & BLOCK_TEMPERATURES)
+        {
+            part = ExportPart(part, raw, offsets.temperature1_offset, sizeof(t_temperatures));
+            part = ExportPart(part, raw, offsets.temperature2_offset, sizeof(t_temperatures));
+        }
+        if(mask & BLOCK_BIOME)
+            part = ExportPart(part, raw, offsets.biome_stuffs, sizeof(biome_indices40d));
+        if(mask & BLOCK_FEATURES)
+        {
+            part = ExportPart(part, raw, offsets.global_feature_offset, sizeof(int16_t));
+            part = ExportPart(part, raw, offsets.local_feature_offset, sizeof(int16_t));
+        }
+        out += recsize;
+        count++;
+    }
+    // cursor == 0 means we're done
+    SHMHDR->cursor = index < total ? index : 0;
+    SHMHDR->count = count;
+}
+
+// word at a time, the parts are all multiples of 4 bytes
+inline uint32_t HashPart(uint32_t hash, const char * block, uint32_t offset, uint32_t size)
+{
+    const uint32_t * words = (const uint32_t *) (block + offset);
+    for(uint32_t i = 0; i < size / 4; i++)
+    {
+        hash = (hash ^ words[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+uint32_t HashBlock(const maps_offsets & offsets, const mblock * block, uint32_t mask)
+{
+    const char * raw = (const char *) block;
+    // a block that moved counts as changed too
+    uint32_t hash = ((uint32_t)(uint64_t)block ^ 0x811C9DC5) * 0x01000193;
+    hash = (hash ^ *block->ptr_to_dirty) * 0x01000193;
+    if(mask & BLOCK_TILETYPES)
+        hash = HashPart(hash, raw, offsets.tile_type_offset, sizeof(tiletypes40d));
+    if(mask & BLOCK_DESIGNATIONS)
+        hash = HashPart(hash, raw, offsets.designation_offset, sizeof(designations40d));
+    if(mask & BLOCK_OCCUPANCY)
+        hash = HashPart(hash, raw, offsets.occupancy_offset, sizeof(occupancies40d));
+    if(mask & BLOCK_TEMPERATURES)
+    {
+        hash = HashPart(hash, raw, offsets.temperature1_offset, sizeof(t_temperatures));
+        hash = HashPart(hash, raw, offsets.temperature2_offset, sizeof(t_temperatures));
+    }
+    if(mask & BLOCK_BIOME)
+        hash = HashPart(hash, raw, offsets.biome_stuffs, sizeof(biome_indices40d));
+    if(mask & BLOCK_FEATURES)
+    {
+        hash = (hash ^ *(uint16_t *)(raw + offsets.global_feature_offset)) * 0x01000193;
+        hash = (hash ^ *(uint16_t *)(raw + offsets.local_feature_offset)) * 0x01000193;
+    }
+    // 0 is reserved for 'no block'
+    return hash ? hash : 1;
+}
+
+void JournalAppend (uint32_t x, uint32_t y, uint32_t z, bool everything, uint32_t frame)
+{
+    shm_journal * journal = (shm_journal *) SHM_JOURNAL(shm);
+    uint32_t head = journal->head;
+    shm_blockchange & entry = journal->entries[head % journal->capacity];
+    entry.x = x;
+    entry.y = y;
+    entry.z = z;
+    entry.everything = everything;
+    entry.frame = frame;
+    // the entry has to be there before the clients can see it
+    full_barrier
+    journal->head = head + 1;
+}
+
+/*
+ * Runs every frame. Hashes the next few blocks of the sweep and journals the ones
+ * that changed since the last sweep.
+ */
+void JournalFrame (void * data)
+{
+    maps_modulestate * state = (maps_modulestate *) data;
+    journal_state & j = state->journal;
+    if(!state->inited || !j.on)
+        return;
+    shm_journal * journal = (shm_journal *) SHM_JOURNAL(shm);
+    j.frame++;
+    journal->frame = j.frame;
+    if(j.frame % j.interval)
+        return;
+    maps_offsets & offsets = state->offsets;
+    mblock * *** mapArray = *(mblock * ****)offsets.map_offset;
+    if(!mapArray)
+        return;
+    uint32_t mx = *(uint32_t *) (offsets.x_count_offset);
+    uint32_t my = *(uint32_t *) (offsets.y_count_offset);
+    uint32_t mz = *(uint32_t *) (offsets.z_count_offset);
+    // a new map. start over
+    if(mapArray != j.map || mx != j.x_count || my != j.y_count || mz != j.z_count)
+    {
+        free(j.hashes);
+        j.hashes = (uint32_t *) calloc(mx * my * mz, sizeof(uint32_t));
+        j.map = mapArray;
+        j.x_count = mx;
+        j.y_count = my;
+        j.z_count = mz;
+        j.cursor = 0;
+        j.primed = false;
+    }
+    uint32_t total = mx * my * mz;
+    if(!total || !j.hashes)
+        return;
+    for(uint32_t n = 0; n < j.budget; n++)
+    {
+        uint32_t index = j.cursor;
+        uint32_t z = index % mz;
+        uint32_t y = (index / mz) % my;
+        uint32_t x = index / (mz * my);
+        mblock * block = mapArray[x][y][z];
+        uint32_t hash = block ? HashBlock(offsets, block, j.mask) : 0;
+        if(j.primed && hash != j.hashes[index])
+            JournalAppend(x, y, z, false, j.frame);
+        j.hashes[index] = hash;
+        if(++j.cursor == total)
+        {
+            j.cursor = 0;
+            // everything the clients read from now on is covered by the journal
+            if(!j.primed)
+                JournalAppend(0, 0, 0, true, j.frame);
+            j.primed = true;
+            break;
+        }
+    }
+}
+
+void JournalStart (void * data)
+{
+    maps_modulestate * state = (maps_modulestate *) data;
+    journal_state & j = state->journal;
+    if(!state->inited)
+    {
+        SHMHDR->error = true;
+        return;
+    }
+    shm_journal * journal = (shm_journal *) SHM_JOURNAL(shm);
+    if(!j.on)
+    {
+        // keep head, clients may still hold sequence numbers from an earlier run
+        journal->capacity = MAP_JOURNAL_CAPACITY;
+        j.map = 0;
+        j.frame = 0;
+        j.on = true;
+    }
+    uint32_t mask = SHMHDR->mask ? SHMHDR->mask : BLOCK_TILETYPES | BLOCK_DESIGNATIONS | BLOCK_OCCUPANCY;
+    if(mask != j.mask)
+    {
+        // hashes over different parts don't compare
+        j.map = 0;
+        j.mask = mask;
+    }
+    j.interval = SHMHDR->x ? SHMHDR->x : 1;
+    j.budget = SHMHDR->y ? SHMHDR->y : 1;
+    SHMHDR->address = (uint32_t) (SHM_JOURNAL(shm) - shm_lane);
+    SHMHDR->error = false;
+}
+
+void JournalStop (void * data)
+{
+    maps_modulestate * state = (maps_modulestate *) data;
+    journal_state & j = state->journal;
+    free(j.hashes);
+    j.hashes = 0;
+    j.map = 0;
+    j.on = false;
+}
+
 DFPP_module Init( void )
 {
     DFPP_module maps;
@@ -123,6 +375,14 @@ DFPP_module Init( void )
 
     // really doesn't fit into 1MB, there should be a streaming variant to better utilize context switches
     maps.set_command(MAP_READ_BLOCKS_3D, FUNCTION, "Read a range of blocks between two sets of coords", NullCommand, CORE_SUSPENDED);
+
+    // the streaming variant: as many blocks as fit, the client comes back for the rest
+    maps.set_command(MAP_EXPORT_RANGE, FUNCTION, "Export the blocks of a box, one window at a time", ExportRange, CORE_SUSPENDED);
+
+    // the change journal lives behind the lanes, clients read it without suspending
+    maps.set_command(MAP_JOURNAL_START, FUNCTION, "Start journaling changed blocks", JournalStart, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    maps.set_command(MAP_JOURNAL_STOP, FUNCTION, "Stop journaling changed blocks", JournalStop, CORE_SUSPENDED, LOCKING_BUSY, ACCESS_EXCLUSIVE);
+    maps.frame = JournalFrame;
     
     return maps;
 }
@@ -26,6 +26,7 @@ distribution.
 #define MOD_MAPS_H
 
 #include "dfhack/DFTypes.h"
+#include "dfhack/modules/Maps.h"
 
 namespace DFHack
 {
@@ -34,7 +35,7 @@ namespace DFHack
         namespace Maps
         {
 // increment on every change
-#define MAPS_VERSION 5
+#define MAPS_VERSION 7
 typedef struct
 {
     uint32_t map_offset;// = d->offset_descriptor->getAddress ("map_data");
@@ -93,12 +94,53 @@ typedef struct
     uint32_t tree_desc_offset;
 } maps_offsets;
 
+// server side of the change journal
+typedef struct
+{
+    bool on;
+    bool primed; // first sweep is done, changes get journaled from now on
+    uint32_t mask; // e_blockparts to hash
+    uint32_t interval; // frames between two steps of the sweep
+    uint32_t budget; // blocks hashed per step
+    uint32_t frame;
+    uint32_t cursor; // next block of the sweep
+    void * map; // the map the hashes are for
+    uint32_t x_count, y_count, z_count;
+    uint32_t * hashes;
+} journal_state;
+
 typedef struct
 {
     bool inited;
     maps_offsets offsets;
+    journal_state journal;
 } maps_modulestate;
 
+/*
+ * The change journal, at SHM_JOURNAL. The server sweeps the map a few blocks per frame,
+ * hashing the blocks and appending the ones that changed. Clients read it without
+ * suspending DF: read head, copy the entries, read head again - whatever the server
+ * lapped in between is lost.
+ */
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t everything; // re-read the whole map: a new map, or the first sweep is done
+    uint32_t frame;
+} shm_blockchange;
+
+typedef struct
+{
+    volatile uint32_t head; // sequence number of the next entry, entry n is at n % capacity
+    uint32_t capacity;
+    volatile uint32_t frame; // frames since the journal started
+    uint32_t reserved;
+    shm_blockchange entries[1];
+} shm_journal;
+#define MAP_JOURNAL_CAPACITY ((SHM_JOURNAL_SIZE - sizeof(shm_journal)) / sizeof(shm_blockchange) + 1)
+
 typedef struct
 {
     shm_cmd cmd[SHM_MAX_CLIENTS]; // MANDATORY!
@@ -110,8 +152,38 @@ typedef struct
     uint32_t z2;
     uint32_t address;
     uint32_t error;
+    uint32_t mask; // MAP_EXPORT_RANGE: e_blockparts to export
+    uint32_t cursor; // MAP_EXPORT_RANGE: index of the next block in the box, in and out
+    uint32_t count; // MAP_EXPORT_RANGE: number of records in the window
 } shm_maps_hdr;
 
+/*
+ * MAP_EXPORT_RANGE record. The parts of the block follow right behind it,
+ * in e_blockparts order. Temperatures are both layers, features are global then local.
+ */
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t padding;
+    uint32_t flags;
+    uint32_t origin;
+} shm_blockrecord;
+
+// size of one exported block with its parts, the same for every block of an export
+inline uint32_t exportRecordSize(uint32_t mask)
+{
+    uint32_t size = sizeof(shm_blockrecord);
+    if(mask & BLOCK_TILETYPES) size += sizeof(tiletypes40d);
+    if(mask & BLOCK_DESIGNATIONS) size += sizeof(designations40d);
+    if(mask & BLOCK_OCCUPANCY) size += sizeof(occupancies40d);
+    if(mask & BLOCK_TEMPERATURES) size += 2 * sizeof(t_temperatures);
+    if(mask & BLOCK_BIOME) size += sizeof(biome_indices40d);
+    if(mask & BLOCK_FEATURES) size += 2 * sizeof(int16_t);
+    return size;
+}
+
 enum MAPS_COMMAND
 {
     MAP_INIT = 0, // initialization
@@ -124,6 +196,9 @@ enum MAPS_COMMAND
     MAP_READ_BLOCKS_3D, // read blocks between two coords (volumetric)
     MAP_READ_ALL_BLOCKS, // read the entire map
     MAP_REVEAL, // reveal the whole map
+    MAP_EXPORT_RANGE, // pack the blocks of a box into the window, resumable from a cursor
+    MAP_JOURNAL_START, // start journaling changed blocks. mask, x = interval, y = budget. address = journal - lane
+    MAP_JOURNAL_STOP, // stop journaling
     NUM_MAPS_CMDS
 };
 DFPP_module Init(void);
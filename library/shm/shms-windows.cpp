@@ -71,8 +71,7 @@ void OS_lockSuspendLock(int which)
         MessageBox(0,"Suspend lock locking failed. Further communication disabled!","Error", MB_OK);
         return;
     }
-    errorstate = 1;
-    MessageBox(0,"Server tried to lock already locked suspend lock?  Further communication disabled!","Error", MB_OK);
+    // already ours
     return;
 }
 
@@ -82,12 +81,7 @@ void OS_releaseSuspendLock(int which)
     if(which >=0 && which < SHM_MAX_CLIENTS)
         return;
     */
-    if(numheld != SHM_MAX_CLIENTS)
-    {
-        MessageBox(0,"Locking system failure. Further communication disabled!","Error", MB_OK);
-        errorstate = 1;
-        return;
-    }
+    // several clients can hold DF suspended at once, each in its own lane
     // lock hel by server and can be released -> OK
     if(held_DFCLSuspendMutex[which] == 1 && ReleaseMutex(DFCLSuspendMutex[which]))
     {
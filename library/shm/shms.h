@@ -5,7 +5,13 @@
 #define SHM_MAX_CLIENTS 4
 #define SHM_HEADER 1024 // 1kB reserved for a header
 #define SHM_BODY 1024*1024 // 4MB reserved for bulk data transfer
-#define SHM_SIZE SHM_HEADER+SHM_BODY
+#define SHM_LANE_SIZE (SHM_HEADER+SHM_BODY)
+// every client gets its own lane - a header and a data window. the command words of all clients are at the start of the first one
+#define SHM_LANE(base,which) ((char *)(base) + (which) * SHM_LANE_SIZE)
+// behind the lanes: the map change journal, written by the server every frame, read by the clients any time
+#define SHM_JOURNAL_SIZE 256*1024
+#define SHM_JOURNAL(base) SHM_LANE(base,SHM_MAX_CLIENTS)
+#define SHM_SIZE (SHM_LANE_SIZE*SHM_MAX_CLIENTS+SHM_JOURNAL_SIZE)
 //#define SHM_ALL_CLIENTS SHM_MAX_CLIENTS*(SHM_SIZE)
 //#define SHM_CL(client_idx) client_idx*(SHM_SIZE)
 
@@ -14,6 +20,17 @@
     // a full memory barrier! better be safe than sorry.
     #define full_barrier asm volatile("" ::: "memory"); __sync_synchronize();
     #define SCHED_YIELD sched_yield(); // a requirement for single-core
+    #if defined(__i386__) || defined(__x86_64__)
+        #define CPU_RELAX __builtin_ia32_pause();
+    #else
+        #define CPU_RELAX asm volatile("" ::: "memory");
+    #endif
+    #define SHM_HAS_FUTEX 1
+    #include <unistd.h>
+    #include <time.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+    #include <sched.h>
 #else
     // we need windows.h for Sleep()
     #define _WIN32_WINNT 0x0501 // needed for INPUT struct
@@ -21,6 +38,8 @@
     #define WIN32_LEAN_AND_MEAN
     #include <windows.h>
     #define SCHED_YIELD Sleep(0); // avoids infinite lockup on single core
+    #define CPU_RELAX YieldProcessor();
+    #define SHM_HAS_FUTEX 0
     // FIXME: detect MSVC here and use the right barrier magic
     #ifdef __MINGW32__
         #define full_barrier asm volatile("" ::: "memory");
@@ -31,12 +50,98 @@
     #endif
 #endif
 
+/*
+ * Futex handshake (negotiated in CORE_ATTACH).
+ * Clients ring the doorbell on every new command, the server sleeps on the doorbell
+ * when none of them has anything for it. A client sleeps on its own command word.
+ * Each side raises its flag before it goes to sleep, so the other one only pays
+ * for the wake syscall when somebody is actually asleep.
+ * All this lives at the very end of the first header, out of the way of the module headers.
+ */
+typedef struct
+{
+    volatile uint32_t doorbell; // bumped by the clients whenever they post a command
+    volatile uint32_t server; // server sleeps on the doorbell
+    volatile uint32_t client[SHM_MAX_CLIENTS]; // client sleeps, waiting for the server to answer
+} shm_sleepers;
+#define SHM_SLEEPERS(base) ((shm_sleepers *)((char *)(base) + SHM_HEADER - sizeof(shm_sleepers)))
+
+#define SHM_SPIN_MIN 128
+#define SHM_SPIN_MAX 16384
+#define SHM_SPIN_START 4096
+#define SHM_SLEEP_MS 100 // how often a sleeping side checks if the other one is still there
+
+// Wait for a command word to change from 'value'. Spins for a while first, then sleeps on the word.
+// The spin grows while answers keep arriving during the spin and shrinks when we end up sleeping,
+// so back-to-back commands stay fast and an idle wait costs next to nothing.
+// Returns false on timeout - time to check on the other side.
+inline bool SHM_waitChange(volatile uint32_t * word, uint32_t value, volatile uint32_t * sleeping, uint32_t & spin, bool yield)
+{
+    for(uint32_t i = 0; i < spin; i++)
+    {
+        if(*word != value)
+        {
+            if(spin < SHM_SPIN_MAX) spin *= 2;
+            return true;
+        }
+        if(yield)
+        {
+            SCHED_YIELD
+        }
+        else
+        {
+            CPU_RELAX
+        }
+    }
+    if(spin > SHM_SPIN_MIN) spin /= 2;
+#if SHM_HAS_FUTEX
+    *sleeping = 1;
+    full_barrier
+    struct timespec timeout = {0, SHM_SLEEP_MS * 1000000};
+    // returns right away if the word changed since we last looked
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, 0, 0);
+    *sleeping = 0;
+    full_barrier
+#endif
+    return *word != value;
+}
+
+// call after changing a command word, wakes up the other side if it sleeps on it
+inline void SHM_wake(volatile uint32_t * word, volatile uint32_t * sleeping)
+{
+#if SHM_HAS_FUTEX
+    full_barrier
+    if(*sleeping)
+    {
+        syscall(SYS_futex, word, FUTEX_WAKE, 1, 0, 0, 0);
+    }
+#endif
+}
+
+// client side: tell the server there's a new command
+inline void SHM_ring(shm_sleepers * sleepers)
+{
+#if SHM_HAS_FUTEX
+    __sync_fetch_and_add(&sleepers->doorbell, 1);
+    SHM_wake(&sleepers->doorbell, &sleepers->server);
+#else
+    sleepers->doorbell++;
+#endif
+}
+
 enum DFPP_Locking
 {
     LOCKING_BUSY = 0,
     LOCKING_LOCKS = 1
 };
 
+// commands that change DF are serialized - one client writes at a time, until it resumes DF
+enum DFPP_Access
+{
+    ACCESS_SHARED = 0,
+    ACCESS_EXCLUSIVE = 1
+};
+
 enum DFPP_CmdType
 {
     CANCELLATION, // we should jump out of the Act()
@@ -51,6 +156,7 @@ struct DFPP_command
     std::string name;
     uint32_t nextState;
     DFPP_Locking locking;
+    DFPP_Access access;
 };
 
 struct DFPP_module
@@ -60,6 +166,7 @@ struct DFPP_module
         name = "Uninitialized module";
         version = 0;
         modulestate = 0;
+        frame = 0;
     }
     // ALERT: the structures share state
     DFPP_module(const DFPP_module & orig)
@@ -68,14 +175,16 @@ struct DFPP_module
         name = orig.name;
         modulestate = orig.modulestate;
         version = orig.version;
+        frame = orig.frame;
     }
-    inline void set_command(const unsigned int index, const DFPP_CmdType type, const char * name, void (*_function)(void *) = 0,uint32_t nextState = -1, DFPP_Locking locking = LOCKING_BUSY)
+    inline void set_command(const unsigned int index, const DFPP_CmdType type, const char * name, void (*_function)(void *) = 0,uint32_t nextState = -1, DFPP_Locking locking = LOCKING_BUSY, DFPP_Access access = ACCESS_SHARED)
     {
         commands[index].type = type;
         commands[index].name = name;
         commands[index]._function = _function;
         commands[index].nextState = nextState;
         commands[index].locking = locking;
+        commands[index].access = access;
     }
     inline void reserve (unsigned int numcommands)
     {
@@ -87,6 +196,8 @@ struct DFPP_module
     uint32_t version; // version
     std::vector <DFPP_command> commands;
     void * modulestate;
+    // called once per SHM_Act, before the clients get served. may be 0
+    void (*frame)(void *);
 };
 
 union shm_cmd
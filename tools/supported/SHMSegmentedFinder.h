@@ -0,0 +1,92 @@
+#ifndef SHM_SEGMENTED_FINDER_H
+#define SHM_SEGMENTED_FINDER_H
+#include <vector>
+#include <string>
+#include <cstring>
+
+/*
+ * Searches like SegmentedFinder, but lets the process search itself where it can (SHM).
+ * Nothing gets copied out of DF, only the addresses of the matches come back.
+ * Only fixed queries work this way: bytes, integers, vectors and strings.
+ */
+class SHMSegmentedFinder
+{
+    public:
+    SHMSegmentedFinder(std::vector <DFHack::t_memrange>& ranges, DFHack::Context * DF)
+        : ranges_(ranges), p_(DF->getProcess())
+    {
+        // nothing to search, just see if the process says it could
+        std::vector <uint64_t> nothing;
+        available = p_->scan(std::vector <DFHack::t_memrange>(), integer(0, 4, 4), nothing);
+    }
+    // can the process search? if not, use SegmentedFinder
+    bool isAvailable()
+    {
+        return available;
+    }
+    bool Find (const DFHack::t_scanquery & query, std::vector <uint64_t> &found)
+    {
+        found.clear();
+        p_->scan(ranges_, query, found);
+        return !found.empty();
+    }
+    bool Filter (const DFHack::t_scanquery & query, std::vector <uint64_t> &found)
+    {
+        p_->filter(ranges_, query, found);
+        return !found.empty();
+    }
+    bool Incremental (const DFHack::t_scanquery & query, std::vector <uint64_t> &found)
+    {
+        if(found.empty())
+            return Find(query, found);
+        return Filter(query, found);
+    }
+
+    // the queries
+    static DFHack::t_scanquery integer(uint32_t value, uint32_t size, uint32_t alignment)
+    {
+        DFHack::t_scanquery q;
+        q.kind = DFHack::SCAN_INT;
+        q.increment = alignment;
+        q.size = size;
+        q.value = value;
+        return q;
+    }
+    // a vector triplet with this length in bytes, or any sane one
+    static DFHack::t_scanquery vector(uint64_t bytes = DFHack::SCAN_ANY_LENGTH)
+    {
+        DFHack::t_scanquery q;
+        q.kind = DFHack::SCAN_VECTOR;
+        q.increment = 4;
+        q.size = 0;
+        q.value = bytes;
+        return q;
+    }
+    static DFHack::t_scanquery bytes(const void * data, size_t length)
+    {
+        DFHack::t_scanquery q;
+        q.kind = DFHack::SCAN_BYTES;
+        q.increment = 1;
+        q.size = 0;
+        q.value = 0;
+        q.needle.assign((const char *) data, length);
+        return q;
+    }
+    // a pointer to the string
+    static DFHack::t_scanquery string(const char * str)
+    {
+        DFHack::t_scanquery q;
+        q.kind = DFHack::SCAN_STRING;
+        q.increment = 1;
+        q.size = 0;
+        q.value = 0;
+        q.needle = str;
+        return q;
+    }
+    private:
+    std::vector <DFHack::t_memrange> ranges_;
+    DFHack::Process * p_;
+    bool available;
+};
+
+#endif // SHM_SEGMENTED_FINDER_H
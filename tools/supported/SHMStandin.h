@@ -0,0 +1,18 @@
+#ifndef SHM_STANDIN_H
+#define SHM_STANDIN_H
+#include <string>
+
+// what the buffer of dfshmstandin is filled with, so clients can check what they read
+inline uint8_t standinPattern(uint32_t offset)
+{
+    return (uint8_t) (offset * 31 + (offset >> 8) + 7);
+}
+
+// the strings it has
+const char * const standinShortString = "Urist";
+inline std::string standinLongString()
+{
+    return std::string("Urist McStandin, ") + std::string(200, 'x');
+}
+
+#endif // SHM_STANDIN_H
@@ -3,6 +3,7 @@
 #include <malloc.h>
 #include <iosfwd>
 #include <iterator>
+#include <algorithm>
 
 class SegmentedFinder;
 class SegmentFinder
@@ -17,17 +18,18 @@ class SegmentFinder
         {
             mr_.buffer = (uint8_t *)malloc (mr_.end - mr_.start);
             _SF = SF;
-            try
+            // bad pages are skipped, the rest of the range is still searched
+            if(!DF->getProcess()->readTolerant(mr_.start,(mr_.end - mr_.start),mr_.buffer,pages))
             {
-                DF->ReadRaw(mr_.start,(mr_.end - mr_.start),mr_.buffer);
-                valid = true;
+                size_t bad = count(pages.begin(), pages.end(), false);
+                cout << "Range 0x" << hex << mr_.start << " - 0x" <<  mr_.end << dec << ": "
+                     << bad << " of " << pages.size() << " pages not readable." << endl;
             }
-            catch (DFHack::Error::MemoryAccessDenied &)
+            valid = find(pages.begin(), pages.end(), true) != pages.end();
+            if(!valid)
             {
                 free(mr_.buffer);
-                valid = false;
                 mr.valid = false; // mark the range passed in as bad
-                cout << "Range 0x" << hex << mr_.start << " - 0x" <<  mr_.end << dec << " not readable." << endl;
             }
         }
     }
@@ -40,6 +42,17 @@ class SegmentFinder
     {
         return valid;
     }
+    // is the byte at offset from the start of the range readable?
+    bool isGood(uint64_t offset)
+    {
+        return pages[((mr_.start & (DFHack::Process::tolerant_page - 1)) + offset) / DFHack::Process::tolerant_page];
+    }
+    // offset of the next page boundary after offset
+    uint64_t nextPage(uint64_t offset)
+    {
+        uint64_t pos = mr_.start + offset;
+        return (pos | (DFHack::Process::tolerant_page - 1)) + 1 - mr_.start;
+    }
     template <class needleType, class hayType, typename comparator >
     bool Find (needleType needle, const uint8_t increment , vector <uint64_t> &newfound, comparator oper)
     {
@@ -47,6 +60,11 @@ class SegmentFinder
         //loop
         for(uint64_t offset = 0; offset < (mr_.end - mr_.start) - sizeof(hayType); offset += increment)
         {
+            if(!isGood(offset))
+            {
+                offset = nextPage(offset) - increment;
+                continue;
+            }
             if( oper(_SF,(hayType *)(mr_.buffer + offset), needle) )
                 newfound.push_back(mr_.start + offset);
         }
@@ -61,6 +79,11 @@ class SegmentFinder
         //loop
         for(uint64_t offset = start - mr_.start; offset < stopper; offset +=1)
         {
+            if(!isGood(offset))
+            {
+                offset = nextPage(offset) - 1;
+                continue;
+            }
             if( oper(_SF,(hayType *)(mr_.buffer + offset), needle) )
                 return mr_.start + offset;
         }
@@ -76,6 +99,8 @@ class SegmentFinder
             if(mr_.isInRange(found[i]))
             {
                 uint64_t corrected = found[i] - mr_.start;
+                if(!isGood(corrected))
+                    continue;
                 if( oper(_SF,(hayType *)(mr_.buffer + corrected), needle) )
                     newfound.push_back(found[i]);
             }
@@ -87,6 +112,7 @@ class SegmentFinder
     SegmentedFinder * _SF;
     DFHack::Context * _DF;
     DFHack::t_memrange mr_;
+    vector <bool> pages;
     bool valid;
 };
 
@@ -100,6 +126,8 @@ class SegmentedFinder
         {
             segments.push_back(new SegmentFinder(ranges[i], DF, this));
         }
+        // sorted, so address lookups can do a binary search
+        sort(segments.begin(), segments.end(), segmentBefore);
     }
     ~SegmentedFinder()
     {
@@ -110,13 +138,18 @@ class SegmentedFinder
     }
     SegmentFinder * getSegmentForAddress (uint64_t addr)
     {
-        for(size_t i = 0; i < segments.size(); i++)
+        // find the last segment starting at or before addr
+        size_t lo = 0, hi = segments.size();
+        while (lo < hi)
         {
-            if(segments[i]->mr_.isInRange(addr))
-            {
-                return segments[i];
-            }
+            size_t mid = (lo + hi) / 2;
+            if(segments[mid]->mr_.start <= addr)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
+        if(lo && segments[lo - 1]->mr_.isInRange(addr))
+            return segments[lo - 1];
         return 0;
     }
     template <class needleType, class hayType, typename comparator >
@@ -170,13 +203,10 @@ class SegmentedFinder
     template <typename T>
     T * Translate(uint64_t address)
     {
-        for(size_t i = 0; i < segments.size(); i++)
-        {
-            if(segments[i]->mr_.isInRange(address))
-            {
-                return (T *) (segments[i]->mr_.buffer + address - segments[i]->mr_.start);
-            }
-        }
+        SegmentFinder * sf = getSegmentForAddress(address);
+        // unreadable segments have no buffer
+        if(sf && sf->valid && sf->isGood(address - sf->mr_.start))
+            return (T *) (sf->mr_.buffer + address - sf->mr_.start);
         return 0;
     }
 
@@ -198,6 +228,10 @@ class SegmentedFinder
         return false;
     }
     private:
+    static bool segmentBefore(const SegmentFinder * a, const SegmentFinder * b)
+    {
+        return a->mr_.start < b->mr_.start;
+    }
     DFHack::Context * _DF;
     vector <SegmentFinder *> segments;
 };
@@ -43,6 +43,8 @@ int main (int argc, char** argv)
             cin.ignore();
         return 1;
     }
+    // lots of small writes, send them all at once when we detach
+    DF->getProcess()->setWriteBuffer(true);
     DFHack::Maps *Mapz = DF->getMaps();
 
     // init the map
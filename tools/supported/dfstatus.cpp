@@ -6,6 +6,8 @@
 
 #ifndef LINUX_BUILD
     #include <windows.h>
+#else
+    #include <unistd.h>
 #endif
 
 #include <time.h>
@@ -1,4 +1,5 @@
 // This program exports the entire map from DF. Takes roughly 6.6 seconds for 1000 cycles on my Linux machine. ~px
+// Usage: dfexpbench [iterations] [threads]. With threads, Maps::ReadAllBlocks gets timed too.
 
 #include <iostream>
 #include <vector>
@@ -10,6 +11,24 @@ using namespace std;
 
 #include <DFHack.h>
 #include <dfhack/extra/termutil.h>
+#include <dfhack/extra/stopwatch.h>
+// counts the blocks per worker, a cache line apart so the workers don't fight over them
+class CountingSink : public DFHack::ParallelBlockSink
+{
+    public:
+    struct t_count
+    {
+        uint64_t blocks;
+        char padding[56];
+    };
+    vector <t_count> counts;
+    void block(uint32_t worker, const DFHack::mapblock40d & block, const DFHack::t_temperatures * temp1,
+               const DFHack::t_temperatures * temp2, const std::vector<DFHack::t_vein> * veins)
+    {
+        counts[worker].blocks++;
+    }
+};
+
 void print_progress (int current, int total)
 {
     if(total < 100)
@@ -30,15 +49,25 @@ void print_progress (int current, int total)
 int main (int numargs, char** args)
 {
     bool temporary_terminal = TemporaryTerminal();
-    time_t start, end;
-    double time_diff;
+    uint64_t start, end;
+    // time spent in each kind of sweep over the map
+    uint64_t block_ms = 0, temperature_ms = 0, feature_ms = 0, parallel_ms = 0;
+    uint64_t parallel_blocks = 0;
+    CountingSink sink;
 
     unsigned int iterations = 0;
-    if (numargs == 2)
+    // ReadAllBlocks is only timed if a number of threads is given
+    unsigned int threads = 0;
+    if (numargs >= 2)
     {
         istringstream input (args[1],istringstream::in);
         input >> iterations;
     }
+    if (numargs >= 3)
+    {
+        istringstream input (args[2],istringstream::in);
+        input >> threads;
+    }
     if(iterations == 0)
         iterations = 1000;
 
@@ -46,6 +75,8 @@ int main (int numargs, char** args)
     uint32_t num_blocks = 0;
     uint64_t bytes_read = 0;
     DFHack::mapblock40d Block;
+    DFHack::t_temperatures temp1, temp2;
+    int16_t local, global;
     DFHack::Maps *Maps = 0;
     DFHack::ContextManager DFMgr("Memory.xml");
     DFHack::Context *DF;
@@ -63,7 +94,7 @@ int main (int numargs, char** args)
         return 1;
     }
 
-    time(&start);
+    start = GetTimeMs64();
 
     cout << "doing " << iterations << " iterations" << endl;
     for(uint32_t i = 0; i< iterations;i++)
@@ -72,6 +103,7 @@ int main (int numargs, char** args)
         if(!Maps->Start())
             break;
         Maps->getSize(x_max,y_max,z_max);
+        uint64_t sweep = GetTimeMs64();
         for(uint32_t x = 0; x< x_max;x++)
         {
             for(uint32_t y = 0; y< y_max;y++)
@@ -87,14 +119,46 @@ int main (int numargs, char** args)
                 }
             }
         }
+        block_ms += GetTimeMs64() - sweep;
+        sweep = GetTimeMs64();
+        for(uint32_t x = 0; x< x_max;x++)
+            for(uint32_t y = 0; y< y_max;y++)
+                for(uint32_t z = 0; z< z_max;z++)
+                    Maps->ReadTemperatures(x, y, z, &temp1, &temp2);
+        temperature_ms += GetTimeMs64() - sweep;
+        sweep = GetTimeMs64();
+        for(uint32_t x = 0; x< x_max;x++)
+            for(uint32_t y = 0; y< y_max;y++)
+                for(uint32_t z = 0; z< z_max;z++)
+                    Maps->ReadFeatures(x, y, z, local, global);
+        feature_ms += GetTimeMs64() - sweep;
+        if(threads)
+        {
+            sink.counts.assign(threads, CountingSink::t_count());
+            sweep = GetTimeMs64();
+            Maps->ReadAllBlocks(DFHack::BLOCK_ALL | DFHack::BLOCK_VEINS, threads, sink);
+            parallel_ms += GetTimeMs64() - sweep;
+            for(unsigned int t = 0; t < threads; t++)
+                parallel_blocks += sink.counts[t].blocks;
+        }
         Maps->Finish();
     }
     DF->Detach();
-    time(&end);
-    time_diff = difftime(end, start);
+    end = GetTimeMs64();
     cout << num_blocks << " blocks read" << endl;
     cout << bytes_read / (1024 * 1024) << " MB" << endl;
-    cout << "map export tests done in " << time_diff << " seconds." << endl;
+    if(num_blocks)
+    {
+        cout << "ReadBlock40d:     " << block_ms << " ms, " << block_ms * 1000.0 / num_blocks << " us per block" << endl;
+        cout << "ReadTemperatures: " << temperature_ms << " ms, " << temperature_ms * 1000.0 / num_blocks << " us per block" << endl;
+        cout << "ReadFeatures:     " << feature_ms << " ms, " << feature_ms * 1000.0 / num_blocks << " us per block" << endl;
+    }
+    if(parallel_blocks)
+    {
+        cout << "ReadAllBlocks, " << threads << " threads, all parts and veins: " << parallel_ms << " ms, "
+             << parallel_ms * 1000.0 / parallel_blocks << " us per block" << endl;
+    }
+    cout << "map export tests done in " << (end - start) / 1000.0 << " seconds." << endl;
     if(temporary_terminal)
     {
         cout << "Done. Press any key to continue" << endl;
@@ -21,6 +21,7 @@ using namespace std;
 
 #include <DFHack.h>
 #include "SegmentedFinder.h"
+#include "SHMSegmentedFinder.h"
 
 inline void printRange(DFHack::t_memrange * tpr)
 {
@@ -238,6 +239,13 @@ void FindIntegers(DFHack::ContextManager & DFMgr, vector <DFHack::t_memrange>& r
         DFMgr.Refresh();
         DFHack::Context * DF = DFMgr.getSingleContext();
         DF->Attach();
+        SHMSegmentedFinder ssf(ranges,DF);
+        if(ssf.isAvailable())
+        {
+            ssf.Incremental(SHMSegmentedFinder::integer(test1, size, alignment), found);
+            DF->Detach();
+            continue;
+        }
         SegmentedFinder sf(ranges,DF);
         switch(size)
         {
@@ -271,10 +279,18 @@ void FindVectorByLength(DFHack::ContextManager & DFMgr, vector <DFHack::t_memran
         DFMgr.Refresh();
         DFHack::Context * DF = DFMgr.getSingleContext();
         DF->Attach();
-        SegmentedFinder sf(ranges,DF);
-        //sf.Incremental<int ,vecTriplet>(0,4,found,vectorAll);
-        //sf.Filter<uint32_t,vecTriplet>(length * element_size,found,vectorLength<uint32_t>);
-        sf.Incremental<uint32_t,vecTriplet>(length * element_size, 4 , found, vectorLength<uint32_t>);
+        SHMSegmentedFinder ssf(ranges,DF);
+        if(ssf.isAvailable())
+        {
+            ssf.Incremental(SHMSegmentedFinder::vector(length * element_size), found);
+        }
+        else
+        {
+            SegmentedFinder sf(ranges,DF);
+            //sf.Incremental<int ,vecTriplet>(0,4,found,vectorAll);
+            //sf.Filter<uint32_t,vecTriplet>(length * element_size,found,vectorLength<uint32_t>);
+            sf.Incremental<uint32_t,vecTriplet>(length * element_size, 4 , found, vectorLength<uint32_t>);
+        }
         DF->Detach();
     }
 }
@@ -366,8 +382,16 @@ void FindStrBufs(DFHack::ContextManager & DFMgr, vector <DFHack::t_memrange>& ra
         DFMgr.Refresh();
         DFHack::Context * DF = DFMgr.getSingleContext();
         DF->Attach();
-        SegmentedFinder sf(ranges,DF);
-        sf.Find< const char * ,uint32_t>(select.c_str(),1,found, findStrBuffer);
+        SHMSegmentedFinder ssf(ranges,DF);
+        if(ssf.isAvailable())
+        {
+            ssf.Find(SHMSegmentedFinder::bytes(select.c_str(), select.size()), found);
+        }
+        else
+        {
+            SegmentedFinder sf(ranges,DF);
+            sf.Find< const char * ,uint32_t>(select.c_str(),1,found, findStrBuffer);
+        }
         DF->Detach();
     }
 }
@@ -383,8 +407,16 @@ void FindStrings(DFHack::ContextManager & DFMgr, vector <DFHack::t_memrange>& ra
         DFMgr.Refresh();
         DFHack::Context * DF = DFMgr.getSingleContext();
         DF->Attach();
-        SegmentedFinder sf(ranges,DF);
-        sf.Incremental< const char * ,uint32_t>(select.c_str(),1,found, findString);
+        SHMSegmentedFinder ssf(ranges,DF);
+        if(ssf.isAvailable())
+        {
+            ssf.Incremental(SHMSegmentedFinder::string(select.c_str()), found);
+        }
+        else
+        {
+            SegmentedFinder sf(ranges,DF);
+            sf.Incremental< const char * ,uint32_t>(select.c_str(),1,found, findString);
+        }
         DF->Detach();
     }
 }
@@ -398,8 +430,16 @@ void FindData(DFHack::ContextManager & DFMgr, vector <DFHack::t_memrange>& range
         DFMgr.Refresh();
         DFHack::Context * DF = DFMgr.getSingleContext();
         DF->Attach();
-        SegmentedFinder sf(ranges,DF);
-        sf.Incremental< Bytestream ,uint32_t>(select,1,found, findBytestream);
+        SHMSegmentedFinder ssf(ranges,DF);
+        if(ssf.isAvailable())
+        {
+            ssf.Incremental(SHMSegmentedFinder::bytes(select.d->object, select.d->length), found);
+        }
+        else
+        {
+            SegmentedFinder sf(ranges,DF);
+            sf.Incremental< Bytestream ,uint32_t>(select,1,found, findBytestream);
+        }
         DF->Detach();
     }
 }
@@ -4,6 +4,7 @@
 //  -p : don't show plants
 //  -s : don't show slade
 //  -t : don't show demon temple
+//  -f <file> : read from a snapshot made by dfsnapshot instead of DF
 
 //#include <cstdlib>
 #include <iostream>
@@ -27,10 +28,10 @@ typedef std::map<DFHack::DFCoord, FeatureListPointer> FeatureMap;
 typedef std::vector<DFHack::dfh_plant> PlantList;
 
 bool parseOptions(int argc, char **argv, bool &showHidden, bool &showPlants,
-                  bool &showSlade, bool &showTemple)
+                  bool &showSlade, bool &showTemple, std::string &snapshot)
 {
     char c;
-    xgetopt opt(argc, argv, "apst");
+    xgetopt opt(argc, argv, "apstf:");
     opt.opterr = 0;
     while ((c = opt()) != -1)
     {
@@ -48,6 +49,9 @@ bool parseOptions(int argc, char **argv, bool &showHidden, bool &showPlants,
         case 't':
             showTemple = false;
             break;
+        case 'f':
+            snapshot = opt.optarg;
+            break;
         case '?':
             switch (opt.optopt)
             {
@@ -110,8 +114,9 @@ int main(int argc, char *argv[])
     bool showPlants = true;
     bool showSlade = true;
     bool showTemple = true;
+    std::string snapshot;
 
-    if (!parseOptions(argc, argv, showHidden, showPlants, showSlade, showTemple))
+    if (!parseOptions(argc, argv, showHidden, showPlants, showSlade, showTemple, snapshot))
     {
         return -1;
     }
@@ -119,7 +124,14 @@ int main(int argc, char *argv[])
     uint32_t x_max = 0, y_max = 0, z_max = 0;
     DFHack::ContextManager manager("Memory.xml");
 
-    DFHack::Context *context = manager.getSingleContext();
+    DFHack::Context *context;
+    if (snapshot.empty())
+        context = manager.getSingleContext();
+    else if (!(context = manager.OpenSnapshot(snapshot)))
+    {
+        std::cerr << "Unable to open snapshot " << snapshot << std::endl;
+        return 1;
+    }
     if (!context->Attach())
     {
         std::cerr << "Unable to attach to DF!" << std::endl;
@@ -0,0 +1,421 @@
+// Measures the SHM bridge: round trip latency of the core commands, suspend and resume,
+// and sustained bulk bandwidth. Starts its own dfshmstandin, so DF isn't needed.
+// Prints percentiles and a histogram for every test, optionally CSV too.
+// Usage: dfshmbench [-n iterations] [-r suspend/resume rounds] [-t seconds of bulk transfer]
+//                   [-f stand-in frames per second] [-c csv file]
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+using namespace std;
+
+#include <DFHack.h>
+#include "SHMStandin.h"
+
+static double now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// a running dfshmstandin and the addresses of its test objects
+struct t_standin
+{
+    pid_t pid;
+    uint32_t dword;
+    uint32_t buffer;
+    uint32_t size;
+    uint32_t shortstring;
+    uint32_t longstring;
+};
+
+// start dfshmstandin from our own folder, wait until it says where things are
+static bool launchStandin(int fps, t_standin & s)
+{
+    char self[1024];
+    int len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if(len == -1)
+    {
+        perror("readlink");
+        return false;
+    }
+    self[len] = 0;
+    string path = self;
+    path = path.substr(0, path.rfind('/') + 1) + "dfshmstandin";
+    char fpsarg[16];
+    sprintf(fpsarg, "%d", fps);
+    int out[2];
+    if(pipe(out))
+    {
+        perror("pipe");
+        return false;
+    }
+    s.pid = fork();
+    if(s.pid == -1)
+    {
+        perror("fork");
+        return false;
+    }
+    if(s.pid == 0)
+    {
+        close(out[0]);
+        dup2(out[1], 1);
+        execl(path.c_str(), "dfshmstandin", "-f", fpsarg, (char *) 0);
+        perror(path.c_str());
+        _exit(1);
+    }
+    close(out[1]);
+    FILE * f = fdopen(out[0], "r");
+    int n = fscanf(f, "%x %x %u %x %x", &s.dword, &s.buffer, &s.size, &s.shortstring, &s.longstring);
+    fclose(f);
+    if(n != 5)
+    {
+        cerr << "the stand-in server didn't start" << endl;
+        waitpid(s.pid, 0, 0);
+        return false;
+    }
+    return true;
+}
+
+static void stopStandin(t_standin & s)
+{
+    kill(s.pid, SIGTERM);
+    waitpid(s.pid, 0, 0);
+}
+
+struct t_result
+{
+    string name;
+    vector <double> samples; // seconds per operation
+    double rate; // bytes per second, 0 if nothing was moved
+};
+
+static double percentile(const vector <double> & sorted, double p)
+{
+    size_t i = (size_t) (p * sorted.size());
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+// the results have to be sorted
+static void printTable(vector <t_result> & results)
+{
+    cout << left << setw(20) << "test" << right << setw(8) << "count";
+    const char * columns[] = {"mean", "min", "p50", "p90", "p99", "p99.9", "max"};
+    for(int i = 0; i < 7; i++)
+        cout << setw(9) << columns[i];
+    cout << setw(10) << "MB/s" << endl;
+    cout << fixed << setprecision(1);
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const vector <double> & s = results[i].samples;
+        double mean = 0;
+        for(size_t j = 0; j < s.size(); j++)
+            mean += s[j];
+        mean /= s.size();
+        cout << left << setw(20) << results[i].name << right << setw(8) << s.size()
+             << setw(9) << mean * 1e6 << setw(9) << s[0] * 1e6
+             << setw(9) << percentile(s, 0.5) * 1e6 << setw(9) << percentile(s, 0.9) * 1e6
+             << setw(9) << percentile(s, 0.99) * 1e6 << setw(9) << percentile(s, 0.999) * 1e6
+             << setw(9) << s[s.size() - 1] * 1e6;
+        if(results[i].rate)
+            cout << setw(10) << results[i].rate / 1000000.0;
+        cout << endl;
+    }
+    cout << "(times in microseconds)" << endl;
+}
+
+// power of two buckets, in microseconds
+static void printHistogram(const t_result & result)
+{
+    vector <uint32_t> buckets(32, 0);
+    for(size_t i = 0; i < result.samples.size(); i++)
+    {
+        uint32_t us = (uint32_t) (result.samples[i] * 1e6);
+        int b = 0;
+        while(us && b < 31)
+        {
+            us >>= 1;
+            b++;
+        }
+        buckets[b]++;
+    }
+    int first = 0, last = 31;
+    while(!buckets[first])
+        first++;
+    while(!buckets[last])
+        last--;
+    uint32_t most = *max_element(buckets.begin(), buckets.end());
+    cout << endl << result.name << endl;
+    for(int b = first; b <= last; b++)
+    {
+        cout << "  < " << setw(8) << (1u << b) << " us |" << left
+             << setw(40) << string((size_t) buckets[b] * 40 / most, '#') << right
+             << setw(8) << buckets[b] << endl;
+    }
+}
+
+// the results have to be sorted
+static bool writeCSV(const string & path, vector <t_result> & results)
+{
+    ofstream csv(path.c_str());
+    if(!csv)
+    {
+        cerr << "can't write " << path << endl;
+        return false;
+    }
+    csv << "test,count,mean_us,min_us,p50_us,p90_us,p99_us,p999_us,max_us,mb_per_s" << endl;
+    csv << fixed << setprecision(3);
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const vector <double> & s = results[i].samples;
+        double mean = 0;
+        for(size_t j = 0; j < s.size(); j++)
+            mean += s[j];
+        mean /= s.size();
+        csv << results[i].name << "," << s.size() << "," << mean * 1e6 << "," << s[0] * 1e6
+            << "," << percentile(s, 0.5) * 1e6 << "," << percentile(s, 0.9) * 1e6
+            << "," << percentile(s, 0.99) * 1e6 << "," << percentile(s, 0.999) * 1e6
+            << "," << s[s.size() - 1] * 1e6 << ",";
+        if(results[i].rate)
+            csv << results[i].rate / 1000000.0;
+        csv << endl;
+    }
+    return true;
+}
+
+enum e_op
+{
+    OP_READ_DWORD,
+    OP_READ,
+    OP_WRITE_DWORD,
+    OP_WRITE,
+    OP_READ_STRING,
+};
+
+struct t_test
+{
+    const char * name;
+    e_op op;
+    uint32_t size;
+};
+
+// one round trip. false if the stand-in gave us something it doesn't have
+static bool doOp(DFHack::Process * p, const t_standin & s, const t_test & test, vector <uint8_t> & data)
+{
+    uint32_t value;
+    switch(test.op)
+    {
+        case OP_READ_DWORD:
+            p->readDWord(s.dword, value);
+            return value == 0xDEADBEEF;
+        case OP_READ:
+            p->read(s.buffer, test.size, &data[0]);
+            return true;
+        case OP_WRITE_DWORD:
+            p->writeDWord(s.dword, 0xDEADBEEF);
+            return true;
+        case OP_WRITE:
+            p->write(s.buffer, test.size, &data[0]);
+            return true;
+        case OP_READ_STRING:
+            if(test.size)
+                return p->readSTLString(s.longstring) == standinLongString();
+            return p->readSTLString(s.shortstring) == standinShortString;
+    }
+    return false;
+}
+
+static bool checkBuffer(const vector <uint8_t> & data, uint32_t offset, uint32_t size)
+{
+    for(uint32_t i = 0; i < size; i++)
+    {
+        if(data[i] != standinPattern(offset + i))
+            return false;
+    }
+    return true;
+}
+
+static bool runBench(DFHack::Process * p, const t_standin & s, int iterations, int rounds, double seconds,
+                     vector <t_result> & results)
+{
+    const uint32_t chunk = 1024 * 1024;
+    vector <uint8_t> data(chunk);
+    // the writes put back what the reads got, so the buffer stays the same
+    p->read(s.buffer, chunk, &data[0]);
+    if(!checkBuffer(data, 0, chunk))
+    {
+        cerr << "the stand-in's buffer doesn't read back right" << endl;
+        return false;
+    }
+    const t_test tests[] =
+    {
+        {"read dword", OP_READ_DWORD, 4},
+        {"read 4 KiB", OP_READ, 4 * 1024},
+        {"read 64 KiB", OP_READ, 64 * 1024},
+        {"read 1 MiB", OP_READ, 1024 * 1024},
+        {"write dword", OP_WRITE_DWORD, 4},
+        {"write 4 KiB", OP_WRITE, 4 * 1024},
+        {"write 64 KiB", OP_WRITE, 64 * 1024},
+        {"read short string", OP_READ_STRING, 0},
+        {"read long string", OP_READ_STRING, 1},
+    };
+    for(size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++)
+    {
+        t_result r;
+        r.name = tests[t].name;
+        r.samples.reserve(iterations);
+        for(int i = 0; i < iterations / 10; i++)
+            doOp(p, s, tests[t], data);
+        for(int i = 0; i < iterations; i++)
+        {
+            double start = now();
+            bool ok = doOp(p, s, tests[t], data);
+            r.samples.push_back(now() - start);
+            if(!ok)
+            {
+                cerr << r.name << ": wrong data" << endl;
+                return false;
+            }
+        }
+        r.rate = 0;
+        if(tests[t].op == OP_READ || tests[t].op == OP_WRITE)
+        {
+            double total = 0;
+            for(size_t i = 0; i < r.samples.size(); i++)
+                total += r.samples[i];
+            r.rate = tests[t].size * r.samples.size() / total;
+        }
+        results.push_back(r);
+    }
+    if(!checkBuffer(data, 0, chunk))
+    {
+        cerr << "the reads don't match the stand-in's buffer" << endl;
+        return false;
+    }
+
+    // resuming is a message, suspending has to wait for the next frame
+    t_result resume, suspend;
+    resume.name = "resume";
+    suspend.name = "suspend";
+    resume.rate = suspend.rate = 0;
+    for(int i = 0; i < rounds; i++)
+    {
+        double start = now();
+        p->resume();
+        double resumed = now();
+        p->suspend();
+        suspend.samples.push_back(now() - resumed);
+        resume.samples.push_back(resumed - start);
+    }
+    results.push_back(resume);
+    results.push_back(suspend);
+
+    // sustained transfers, a chunk at a time through the whole buffer
+    uint32_t chunks = s.size / chunk;
+    if(!chunks)
+    {
+        cerr << "the stand-in's buffer is too small for bulk transfers" << endl;
+        return false;
+    }
+    // the writes put back what's there
+    vector <uint8_t> image(chunks * chunk);
+    for(uint32_t i = 0; i < image.size(); i++)
+        image[i] = standinPattern(i);
+    for(int write = 0; write < 2; write++)
+    {
+        t_result r;
+        r.name = write ? "bulk write" : "bulk read";
+        double start = now(), end = start + seconds, t = start;
+        for(uint32_t i = 0; t < end; i = (i + 1) % chunks)
+        {
+            if(write)
+                p->write(s.buffer + i * chunk, chunk, &image[i * chunk]);
+            else
+                p->read(s.buffer + i * chunk, chunk, &image[i * chunk]);
+            double done = now();
+            r.samples.push_back(done - t);
+            t = done;
+        }
+        r.rate = (double) chunk * r.samples.size() / (t - start);
+        results.push_back(r);
+    }
+    return true;
+}
+
+int main (int argc, char** argv)
+{
+    int iterations = 1000;
+    int rounds = 200;
+    double seconds = 2.0;
+    int fps = 100;
+    string csvpath;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        if(arg == "-n") iterations = atoi(argv[i + 1]);
+        else if(arg == "-r") rounds = atoi(argv[i + 1]);
+        else if(arg == "-t") seconds = atof(argv[i + 1]);
+        else if(arg == "-f") fps = atoi(argv[i + 1]);
+        else if(arg == "-c") csvpath = argv[i + 1];
+        else
+        {
+            cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if(iterations <= 0 || rounds <= 0 || seconds <= 0 || fps <= 0)
+    {
+        cerr << "all the numbers have to be positive" << endl;
+        return 1;
+    }
+    t_standin standin;
+    if(!launchStandin(fps, standin))
+        return 1;
+    vector <t_result> results;
+    bool ok = false;
+    try
+    {
+        DFHack::ContextManager DFMgr("Memory.xml");
+        DFHack::Context * DF = DFMgr.OpenSHM(standin.pid);
+        if(!DF)
+        {
+            cerr << "can't connect to the stand-in server" << endl;
+        }
+        else if(!DF->Attach())
+        {
+            cerr << "can't attach to the stand-in server" << endl;
+        }
+        else
+        {
+            ok = runBench(DF->getProcess(), standin, iterations, rounds, seconds, results);
+            DF->Detach();
+        }
+    }
+    catch (exception& e)
+    {
+        cerr << e.what() << endl;
+        ok = false;
+    }
+    stopStandin(standin);
+    if(!ok)
+        return 1;
+    for(size_t i = 0; i < results.size(); i++)
+        sort(results[i].samples.begin(), results[i].samples.end());
+    cout << "stand-in at " << fps << " frames per second" << endl << endl;
+    printTable(results);
+    for(size_t i = 0; i < results.size(); i++)
+        printHistogram(results[i]);
+    if(!csvpath.empty() && !writeCSV(csvpath, results))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Measures how the aggregate SHM read rate scales with the number of clients.
+// For 1 to N clients, every client suspends DF in its own lane and reads the same
+// memory range in a loop for a while. Needs a running DF with the SHM server.
+// Usage: dfshmlanes [-n max clients] [-t seconds] [-s read size in KiB]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+using namespace std;
+
+#include <DFHack.h>
+
+static double now()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// one client: attach, wait for the others, read for a while. writes bytes read to the pipe
+static int runClient(int out, int go, double seconds, uint32_t size)
+{
+    uint64_t total = 0;
+    try
+    {
+        DFHack::ContextManager DFMgr("Memory.xml");
+        DFHack::Context * DF = DFMgr.getSingleContext();
+        DF->Attach();
+        DFHack::Process * p = DF->getProcess();
+        // something big enough to read from
+        vector<DFHack::t_memrange> ranges;
+        p->getMemRanges(ranges);
+        uint32_t start = 0;
+        for(size_t i = 0; i < ranges.size(); i++)
+        {
+            if(ranges[i].read && ranges[i].end - ranges[i].start >= size)
+            {
+                start = ranges[i].start;
+                break;
+            }
+        }
+        if(!start)
+        {
+            cerr << "no readable range of " << size << " bytes" << endl;
+            return 1;
+        }
+        vector<uint8_t> buffer(size);
+        // everybody starts at the same time
+        char dummy;
+        if(read(go, &dummy, 1) != 1)
+            return 1;
+        double end = now() + seconds;
+        while(now() < end)
+        {
+            p->read(start, size, &buffer[0]);
+            total += size;
+        }
+        DF->Detach();
+    }
+    catch (exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return write(out, &total, sizeof(total)) == sizeof(total) ? 0 : 1;
+}
+
+int main (int argc, char** argv)
+{
+    int clients = 3;
+    double seconds = 2.0;
+    uint32_t size = 64 * 1024;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        if(arg == "-n") clients = atoi(argv[i + 1]);
+        else if(arg == "-t") seconds = atof(argv[i + 1]);
+        else if(arg == "-s") size = atoi(argv[i + 1]) * 1024;
+        else
+        {
+            cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    cout << "clients  aggregate MB/s  per client MB/s" << endl;
+    for(int n = 1; n <= clients; n++)
+    {
+        int results[2], start[2];
+        if(pipe(results) || pipe(start))
+        {
+            perror("pipe");
+            return 1;
+        }
+        for(int i = 0; i < n; i++)
+        {
+            if(fork() == 0)
+            {
+                close(results[0]);
+                close(start[1]);
+                _exit(runClient(results[1], start[0], seconds, size));
+            }
+        }
+        close(results[1]);
+        close(start[0]);
+        // give them time to attach, then let them all go
+        sleep(1);
+        for(int i = 0; i < n; i++)
+        {
+            if(write(start[1], "g", 1) != 1)
+                perror("write");
+        }
+        uint64_t total = 0, bytes;
+        int reported = 0;
+        while(read(results[0], &bytes, sizeof(bytes)) == sizeof(bytes))
+        {
+            total += bytes;
+            reported++;
+        }
+        for(int i = 0; i < n; i++)
+            wait(0);
+        close(results[0]);
+        close(start[1]);
+        if(reported != n)
+        {
+            cerr << n - reported << " of " << n << " clients failed" << endl;
+            return 1;
+        }
+        double rate = total / seconds / 1000000.0;
+        cout << setw(7) << n << setw(16) << fixed << setprecision(1) << rate << setw(17) << rate / n << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+// A stand-in for DF with the SHM server linked in, so the SHM bridge can be tested and
+// benchmarked without DF. The server gets called a frame at a time, like DF's render loop does.
+// Once the server is up, the addresses of the test objects go to stdout, in one line:
+// <dword> <buffer> <buffer size> <short string> <long string>
+// The buffer is filled with standinPattern(offset), see SHMStandin.h. Connect with ContextManager::OpenSHM.
+// Usage: dfshmstandin [-f frames per second] [-s buffer size in KiB]
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <new>
+#include <unistd.h>
+#include <sys/mman.h>
+using namespace std;
+
+#include <dfhack/DFIntegers.h>
+#include "SHMStandin.h"
+
+// the server's entry points, from shms-linux.cpp
+extern "C" int SDL_NumJoysticks(void);
+extern "C" void SDL_Quit(void);
+
+struct t_standin_objects
+{
+    uint32_t dword;
+    string shortstring;
+    string longstring;
+};
+
+volatile sig_atomic_t quit = 0;
+
+void onSignal(int)
+{
+    quit = 1;
+}
+
+// clients only see 32 bits of address. a 32-bit build gets nothing else anyway
+#ifndef MAP_32BIT
+    #define MAP_32BIT 0
+#endif
+void * alloc32(size_t size)
+{
+    void * mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if(mem == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    return mem;
+}
+
+int main (int argc, char** argv)
+{
+    int fps = 100;
+    uint32_t size = 16 * 1024 * 1024;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        if(arg == "-f") fps = atoi(argv[i + 1]);
+        else if(arg == "-s") size = atoi(argv[i + 1]) * 1024;
+        else
+        {
+            cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if(fps <= 0 || size == 0)
+    {
+        cerr << "frames per second and buffer size have to be positive" << endl;
+        return 1;
+    }
+    t_standin_objects * objects = new (alloc32(sizeof(t_standin_objects))) t_standin_objects;
+    objects->dword = 0xDEADBEEF;
+    objects->shortstring = standinShortString;
+    objects->longstring = standinLongString();
+    uint8_t * buffer = (uint8_t *) alloc32(size);
+    for(uint32_t i = 0; i < size; i++)
+        buffer[i] = standinPattern(i);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    // the first call brings the server up
+    if(SDL_NumJoysticks() == -1)
+    {
+        cerr << "the SHM server didn't start" << endl;
+        return 1;
+    }
+    printf("%x %x %u %x %x\n", (uint32_t) (uint64_t) &objects->dword, (uint32_t) (uint64_t) buffer, size,
+           (uint32_t) (uint64_t) &objects->shortstring, (uint32_t) (uint64_t) &objects->longstring);
+    fflush(stdout);
+    useconds_t frame = 1000000 / fps;
+    while(!quit)
+    {
+        SDL_NumJoysticks();
+        usleep(frame);
+    }
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Saves all of DF's memory into a file, so tools can be run against a frozen fort
+// while DF keeps running. DF is only suspended while the file is being written.
+// Usage: dfsnapshot [file] [parent]
+// With a parent snapshot, only the memory pages that changed since the parent are saved.
+
+#include <iostream>
+#include <string>
+#include <ctime>
+using namespace std;
+
+#include <DFHack.h>
+#include <dfhack/extra/termutil.h>
+
+int main (int argc, char** argv)
+{
+    bool temporary_terminal = TemporaryTerminal();
+    string path = "df.snapshot";
+    string parent;
+    if(argc > 1)
+        path = argv[1];
+    if(argc > 2)
+        parent = argv[2];
+
+    DFHack::ContextManager DFMgr("Memory.xml");
+    DFHack::Context *DF;
+    try
+    {
+        DF = DFMgr.getSingleContext();
+        DF->Attach();
+    }
+    catch (exception& e)
+    {
+        cerr << e.what() << endl;
+        if(temporary_terminal)
+            cin.ignore();
+        return 1;
+    }
+
+    cout << "Writing snapshot to " << path << " ..." << endl;
+    clock_t start = clock();
+    bool ok = DF->WriteSnapshot(path, parent);
+    clock_t end = clock();
+    DF->Detach();
+    if(ok)
+        cout << "Done in " << double(end - start) / CLOCKS_PER_SEC << " seconds." << endl;
+    else
+        cerr << "Failed." << endl;
+    if(temporary_terminal)
+        cin.ignore();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+// Writes a synthetic DF memory image into a snapshot file, for running and benchmarking
+// tools without Dwarf Fortress: dfprospector -f file, or ContextManager::OpenSnapshot.
+// Usage: dfsynth [-x blocks] [-y blocks] [-z blocks] [-c creatures] [-i items] [-b buildings]
+//                [-s seed] [-v version] [file]
+// The same image can be used without a file: DFHACK_SYNTHETIC=12x12x40,100,2000,50 dfprospector
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+using namespace std;
+
+#include <DFHack.h>
+
+int main (int argc, char** argv)
+{
+    DFHack::t_synthetic_params params;
+    string path = "synthetic.snapshot";
+    for(int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if(arg.size() == 2 && arg[0] == '-' && i + 1 < argc)
+        {
+            const char * value = argv[++i];
+            switch(arg[1])
+            {
+                case 'x': params.x_blocks = atoi(value); break;
+                case 'y': params.y_blocks = atoi(value); break;
+                case 'z': params.z_blocks = atoi(value); break;
+                case 'c': params.creatures = atoi(value); break;
+                case 'i': params.items = atoi(value); break;
+                case 'b': params.buildings = atoi(value); break;
+                case 's': params.seed = atoi(value); break;
+                case 'v': params.version = value; break;
+                default:
+                    cerr << "unknown option " << arg << endl;
+                    return 1;
+            }
+        }
+        else
+            path = arg;
+    }
+
+    DFHack::ContextManager DFMgr("Memory.xml");
+    DFHack::Context *DF = DFMgr.OpenSynthetic(params);
+    if(!DF)
+    {
+        cerr << "Couldn't generate the image." << endl;
+        return 1;
+    }
+    DF->Attach();
+    cout << "Writing a " << params.x_blocks << "x" << params.y_blocks << "x" << params.z_blocks
+         << " block " << DF->getMemoryInfo()->getVersion() << " image to " << path << " ..." << endl;
+    clock_t start = clock();
+    bool ok = DF->WriteSnapshot(path);
+    clock_t end = clock();
+    DF->Detach();
+    if(ok)
+        cout << "Done in " << double(end - start) / CLOCKS_PER_SEC << " seconds." << endl;
+    else
+        cerr << "Failed." << endl;
+    return ok ? 0 : 1;
+}
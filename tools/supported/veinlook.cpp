@@ -740,7 +740,7 @@ int main(int argc, char *argv[])
         // Supend, read/write data
         DF->Suspend();
         // restart cleared modules
-        Maps->Start();
+        Maps->Refresh();
         if(hasmats)
         {
             Mats->Start();